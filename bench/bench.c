@@ -0,0 +1,343 @@
+// Standalone benchmark of the C core, no Python involved.
+//
+//   make -C bench && bench/bench [-t seconds] [path...]
+//
+// Every *.txt under the given paths (tests/url-various-datasets by default)
+// is read as one url per line; url_split, url_parse and quoting are each run
+// over the whole file until -t seconds have passed. ns/url and MB/s come from
+// the monotonic clock, cycles/byte and instructions/byte from perf_event_open
+// (shown as "-" where perf events are not available, e.g. in containers or
+// with kernel.perf_event_paranoid > 2).
+#define _GNU_SOURCE
+#include "parse.h"
+#include <dirent.h>
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+    B_NS_PER_SEC = 1000000000,
+    B_WARMUP_PASSES = 2,
+    B_QUOTE_EXPANSION = 3, // every byte may become %XX
+    B_MAX_FILES = 4096
+};
+
+typedef struct {
+    char *data; // the file, lines are not NUL-terminated
+    const char **urls;
+    size_t *lens;
+    size_t count;
+    size_t bytes; // sum of lens
+    char *path;
+} b_dataset_t;
+
+typedef struct {
+    int cycles_fd; // group leader, -1 without perf events
+    int instructions_fd;
+} b_perf_t;
+
+typedef struct {
+    uint64_t ns;
+    uint64_t cycles;
+    uint64_t instructions;
+    size_t passes;
+} b_sample_t;
+
+typedef struct {
+    const char *name;
+    // One pass over the dataset, returns something derived from every result
+    // so the work cannot be optimized away
+    size_t (*run)(const b_dataset_t *ds);
+} b_op_t;
+
+static url_scratch_t b_scratch;
+static url_quote_table_t b_quote_table;
+static char *b_quote_buf;
+
+static uint64_t b_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * B_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+static int b_perf_open(uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = group_fd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static void b_perf_init(b_perf_t *perf) {
+    perf->cycles_fd = b_perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+    perf->instructions_fd = -1;
+    if (perf->cycles_fd != -1) {
+        perf->instructions_fd =
+            b_perf_open(PERF_COUNT_HW_INSTRUCTIONS, perf->cycles_fd);
+    }
+}
+
+static uint64_t b_perf_read(int fd) {
+    uint64_t value = 0;
+    if (fd == -1 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+        return 0;
+    }
+    return value;
+}
+
+static size_t b_run_split(const b_dataset_t *ds) {
+    size_t sink = 0;
+    url_split_result_t result;
+    for (size_t i = 0; i < ds->count; i++) {
+        if (url_split(ds->urls[i], ds->lens[i], NULL, true, &b_scratch,
+                      &result) == URL_PARSE_OK) {
+            sink += result.netloc.length + result.query.length;
+        }
+        url_scratch_reset(&b_scratch);
+    }
+    return sink;
+}
+
+static size_t b_run_parse(const b_dataset_t *ds) {
+    size_t sink = 0;
+    url_parse_result_t result;
+    for (size_t i = 0; i < ds->count; i++) {
+        if (url_parse(ds->urls[i], ds->lens[i], NULL, true, &b_scratch,
+                      &result) == URL_PARSE_OK) {
+            sink += result.netloc.length + result.params.length;
+        }
+        url_scratch_reset(&b_scratch);
+    }
+    return sink;
+}
+
+// What quote(url) does once its safe set is compiled: measure, then write
+static size_t b_run_quote(const b_dataset_t *ds) {
+    size_t sink = 0;
+    for (size_t i = 0; i < ds->count; i++) {
+        size_t len = url_quote_len(ds->urls[i], ds->lens[i], &b_quote_table);
+        url_quote_write(ds->urls[i], ds->lens[i], &b_quote_table, b_quote_buf);
+        sink += len + (unsigned char)b_quote_buf[0];
+    }
+    return sink;
+}
+
+// Strict RFC 3986 check, next to the lenient url_split it builds on
+static size_t b_run_validate(const b_dataset_t *ds) {
+    size_t sink = 0;
+    for (size_t i = 0; i < ds->count; i++) {
+        size_t offset;
+        sink += url_validate(ds->urls[i], ds->lens[i], NULL, &offset) ==
+                        URL_PARSE_OK
+                    ? 1
+                    : offset;
+    }
+    return sink;
+}
+
+static const b_op_t b_OPS[] = {{"url_split", b_run_split},
+                               {"url_parse", b_run_parse},
+                               {"url_quote", b_run_quote},
+                               {"url_validate", b_run_validate}};
+
+static b_sample_t b_measure(const b_op_t *op, const b_dataset_t *ds,
+                            const b_perf_t *perf, double seconds) {
+    volatile size_t sink = 0;
+    for (int i = 0; i < B_WARMUP_PASSES; i++) {
+        sink += op->run(ds);
+    }
+
+    b_sample_t sample = {0};
+    uint64_t budget = (uint64_t)(seconds * B_NS_PER_SEC);
+    if (perf->cycles_fd != -1) {
+        ioctl(perf->cycles_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf->cycles_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    uint64_t start = b_now_ns();
+    do {
+        sink += op->run(ds);
+        sample.passes++;
+        sample.ns = b_now_ns() - start;
+    } while (sample.ns < budget);
+    if (perf->cycles_fd != -1) {
+        ioctl(perf->cycles_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        sample.cycles = b_perf_read(perf->cycles_fd);
+        sample.instructions = b_perf_read(perf->instructions_fd);
+    }
+    (void)sink;
+    return sample;
+}
+
+static bool b_load(const char *path, b_dataset_t *ds) {
+    memset(ds, 0, sizeof(*ds));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || !(ds->data = malloc(st.st_size + 1)) ||
+        fread(ds->data, 1, st.st_size, f) != (size_t)st.st_size) {
+        fclose(f);
+        free(ds->data);
+        ds->data = NULL;
+        return false;
+    }
+    fclose(f);
+
+    size_t size = (size_t)st.st_size, lines = 0;
+    for (size_t i = 0; i < size; i++) {
+        lines += ds->data[i] == '\n';
+    }
+    lines++;
+    ds->urls = malloc(lines * sizeof(*ds->urls));
+    ds->lens = malloc(lines * sizeof(*ds->lens));
+    if (!ds->urls || !ds->lens) {
+        return false;
+    }
+    for (size_t pos = 0; pos < size;) {
+        const char *nl = memchr(ds->data + pos, '\n', size - pos);
+        size_t end = nl ? (size_t)(nl - ds->data) : size;
+        if (end > pos) {
+            ds->urls[ds->count] = ds->data + pos;
+            ds->lens[ds->count++] = end - pos;
+            ds->bytes += end - pos;
+        }
+        pos = end + 1;
+    }
+    ds->path = strdup(path);
+    return ds->path != NULL;
+}
+
+static void b_free(b_dataset_t *ds) {
+    free(ds->data);
+    free(ds->urls);
+    free(ds->lens);
+    free(ds->path);
+}
+
+static int b_path_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Collect every *.txt file under path (or path itself if it is a file)
+static void b_collect(const char *path, char **files, size_t *nfiles) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "bench: %s: %s\n", path, strerror(errno));
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        if (*nfiles < B_MAX_FILES) {
+            files[(*nfiles)++] = strdup(path);
+        }
+        return;
+    }
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char *child;
+        if (asprintf(&child, "%s/%s", path, entry->d_name) < 0) {
+            break;
+        }
+        size_t n = strlen(child);
+        if (stat(child, &st) == 0 &&
+            (S_ISDIR(st.st_mode) ||
+             (n > 4 && strcmp(child + n - 4, ".txt") == 0))) {
+            b_collect(child, files, nfiles);
+        }
+        free(child);
+    }
+    closedir(dir);
+}
+
+int main(int argc, char **argv) {
+    double seconds = 0.5;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        if (opt == 't') {
+            seconds = atof(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-t seconds] [path...]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    static char *files[B_MAX_FILES];
+    size_t nfiles = 0;
+    if (optind == argc) {
+        b_collect("tests/url-various-datasets", files, &nfiles);
+    }
+    for (int i = optind; i < argc; i++) {
+        b_collect(argv[i], files, &nfiles);
+    }
+    if (nfiles == 0) {
+        fprintf(stderr, "bench: no dataset files (is the "
+                        "tests/url-various-datasets submodule checked out?)\n");
+        return 1;
+    }
+    qsort(files, nfiles, sizeof(*files), b_path_cmp);
+
+    b_perf_t perf;
+    b_perf_init(&perf);
+    url_quote_table_init(&b_quote_table, "/", 1, false);
+
+    printf("%-48s %-10s %9s %10s %9s %9s %9s\n", "dataset", "op", "urls",
+           "ns/url", "MB/s", "cyc/B", "ins/B");
+    for (size_t f = 0; f < nfiles; f++) {
+        b_dataset_t ds;
+        if (!b_load(files[f], &ds) || ds.count == 0) {
+            fprintf(stderr, "bench: cannot load %s\n", files[f]);
+            b_free(&ds);
+            free(files[f]);
+            continue;
+        }
+        size_t longest = 0;
+        for (size_t i = 0; i < ds.count; i++) {
+            longest = ds.lens[i] > longest ? ds.lens[i] : longest;
+        }
+        b_quote_buf = malloc(longest * B_QUOTE_EXPANSION + 1);
+        if (!b_quote_buf) {
+            return 1;
+        }
+
+        const char *name = strlen(ds.path) > 48
+                               ? ds.path + strlen(ds.path) - 48
+                               : ds.path;
+        for (size_t o = 0; o < sizeof(b_OPS) / sizeof(*b_OPS); o++) {
+            b_sample_t s = b_measure(&b_OPS[o], &ds, &perf, seconds);
+            double urls = (double)ds.count * s.passes;
+            double bytes = (double)ds.bytes * s.passes;
+            printf("%-48s %-10s %9zu %10.1f %9.1f", name, b_OPS[o].name,
+                   ds.count, s.ns / urls, bytes * 1e3 / s.ns);
+            if (s.cycles) {
+                printf(" %9.2f %9.2f\n", s.cycles / bytes,
+                       s.instructions / bytes);
+            } else {
+                printf(" %9s %9s\n", "-", "-");
+            }
+        }
+        free(b_quote_buf);
+        b_free(&ds);
+        free(files[f]);
+    }
+    url_scratch_free(&b_scratch);
+    return 0;
+}
@@ -0,0 +1,224 @@
+"""abf.urllib.parse vs urllib.parse over whole datasets.
+
+    python bench/bench_abfparse.py [path...] [--json out.json]
+    python bench/bench_abfparse.py --compare before.json
+
+Every *.txt under the given paths (tests/url-various-datasets by default) is
+read as one url per line, and every exported function is timed over all of
+them, with str and (ASCII) bytes input and as single calls and batch calls. The
+time of one pass is the best of --repeat runs, reported in ns per url next to
+the stdlib time of the same work. --json saves the abf timings, --compare
+reads them back and exits with 1 if any case got slower than --threshold or
+no longer runs (a case that raises on an input type is reported and skipped).
+"""
+import argparse
+import json
+import sys
+import time
+import urllib.parse
+from pathlib import Path
+
+import abf.urllib.parse
+
+abf_parse = abf.urllib.parse
+DEFAULT_DATASETS = Path(__file__).resolve().parent.parent / "tests" / "url-various-datasets"
+
+
+def discover_txt_files(paths):
+    for path in paths:
+        path = Path(path)
+        if path.is_file():
+            yield path
+        else:
+            yield from sorted(path.rglob("*.txt"))
+
+
+def load(path):
+    with open(path, "rb") as f:
+        lines = [line for line in f.read().split(b"\n") if line]
+    urls = [line.decode("utf-8", "surrogateescape") for line in lines]
+    # urllib.parse only takes ASCII bytes
+    return urls, [line for line in lines if line.isascii()]
+
+
+def queries(urls):
+    return [urllib.parse.urlsplit(u).query for u in urls]
+
+
+def joined(urls):
+    """The dataset as one chunk of newline terminated urls"""
+    nl = "\n" if isinstance(urls[0], str) else b"\n"
+    return [nl.join(urls) + nl]
+
+
+def stdlib_join_many(base, urls):
+    return [urllib.parse.urljoin(base, u) for u in urls]
+
+
+# name -> (kind, setup(urls) -> data, stdlib(data), abf(data))
+# setup turns the dataset (a list of str or of bytes) into the input of the
+# case; the stdlib callable is None where urllib.parse has no counterpart
+CASES = {
+    "urlsplit": ("single", None,
+                 lambda d: [urllib.parse.urlsplit(u) for u in d],
+                 lambda d: [abf_parse.urlsplit(u) for u in d]),
+    "urlparse": ("single", None,
+                 lambda d: [urllib.parse.urlparse(u) for u in d],
+                 lambda d: [abf_parse.urlparse(u) for u in d]),
+    "urlsplit lazy": ("single", None,
+                      lambda d: [urllib.parse.urlsplit(u) for u in d],
+                      lambda d: [abf_parse.urlsplit(u, lazy=True) for u in d]),
+    "urlparse hostname": ("single", None,
+                          lambda d: [urllib.parse.urlparse(u).hostname for u in d],
+                          lambda d: [abf_parse.urlparse(u).hostname for u in d]),
+    "urlunsplit": ("single", lambda d: [urllib.parse.urlsplit(u) for u in d],
+                   lambda d: [urllib.parse.urlunsplit(p) for p in d],
+                   lambda d: [abf_parse.urlunsplit(p) for p in d]),
+    "urlunparse": ("single", lambda d: [urllib.parse.urlparse(u) for u in d],
+                   lambda d: [urllib.parse.urlunparse(p) for p in d],
+                   lambda d: [abf_parse.urlunparse(p) for p in d]),
+    "urljoin": ("single", None,
+                lambda d: [urllib.parse.urljoin(d[0], u) for u in d],
+                lambda d: [abf_parse.urljoin(d[0], u) for u in d]),
+    "quote": ("single", None,
+              lambda d: [urllib.parse.quote(u) for u in d],
+              lambda d: [abf_parse.quote(u) for u in d]),
+    "quote_plus": ("single", None,
+                   lambda d: [urllib.parse.quote_plus(u) for u in d],
+                   lambda d: [abf_parse.quote_plus(u) for u in d]),
+    "unquote": ("single", None,
+                lambda d: [urllib.parse.unquote(u) for u in d],
+                lambda d: [abf_parse.unquote(u) for u in d]),
+    "unquote_plus": ("single", None,
+                     lambda d: [urllib.parse.unquote_plus(u) for u in d],
+                     lambda d: [abf_parse.unquote_plus(u) for u in d]),
+    "unquote_to_bytes": ("single", None,
+                         lambda d: [urllib.parse.unquote_to_bytes(u) for u in d],
+                         lambda d: [abf_parse.unquote_to_bytes(u) for u in d]),
+    "parse_qsl": ("single", queries,
+                  lambda d: [urllib.parse.parse_qsl(q) for q in d],
+                  lambda d: [abf_parse.parse_qsl(q) for q in d]),
+    "parse_qs": ("single", queries,
+                 lambda d: [urllib.parse.parse_qs(q) for q in d],
+                 lambda d: [abf_parse.parse_qs(q) for q in d]),
+    "urlencode": ("single", lambda d: [urllib.parse.parse_qsl(q) for q in queries(d)],
+                  lambda d: [urllib.parse.urlencode(p) for p in d],
+                  lambda d: [abf_parse.urlencode(p) for p in d]),
+    "WhatwgURL": ("single", None, None,
+                  lambda d: [abf_parse.WhatwgURL(u) if abf_parse.WhatwgURL.can_parse(u) else None
+                             for u in d]),
+    "canonicalize": ("single", None, None,
+                     lambda d: [abf_parse.canonicalize(u) for u in d]),
+    "fingerprint": ("single", None, None,
+                    lambda d: [abf_parse.fingerprint(u) for u in d]),
+    "urlsplit_many": ("batch", None,
+                      lambda d: [urllib.parse.urlsplit(u) for u in d],
+                      abf_parse.urlsplit_many),
+    "urlparse_many": ("batch", None,
+                      lambda d: [urllib.parse.urlparse(u) for u in d],
+                      abf_parse.urlparse_many),
+    "urlsplit_columns": ("batch", None,
+                         lambda d: [urllib.parse.urlsplit(u) for u in d],
+                         abf_parse.urlsplit_columns),
+    "iter_urlsplit": ("batch", joined,
+                      lambda d: [urllib.parse.urlsplit(u) for u in d[0].splitlines()],
+                      lambda d: list(abf_parse.iter_urlsplit(d))),
+    "fingerprint_many": ("batch", None, None, abf_parse.fingerprint_many),
+    "Joiner.join_many": ("batch", None,
+                         lambda d: stdlib_join_many(d[0], d),
+                         lambda d: abf_parse.Joiner(d[0]).join_many(d)),
+}
+
+
+def best_of(fn, data, repeat):
+    best = None
+    for _ in range(repeat):
+        start = time.perf_counter_ns()
+        fn(data)
+        elapsed = time.perf_counter_ns() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def selected(case, only):
+    return not only or any(o in case for o in only)
+
+
+def run(files, repeat, only):
+    """abf ns/url by "path::case::type", and why any case was skipped"""
+    results, skipped = {}, {}
+    print(f"{'dataset':<40} {'case':<24} {'type':<5} {'kind':<6} "
+          f"{'stdlib ns/url':>13} {'abf ns/url':>10} {'speedup':>8}")
+    for path in files:
+        urls, lines = load(path)
+        if not urls:
+            continue
+        name = str(path)[-40:]
+        for case, (kind, setup, stdlib_fn, abf_fn) in CASES.items():
+            if not selected(case, only):
+                continue
+            for typ, dataset in (("str", urls), ("bytes", lines)):
+                if not dataset:
+                    continue
+                try:
+                    data = setup(dataset) if setup else dataset
+                    abf_fn(data)
+                    if stdlib_fn:
+                        stdlib_fn(data)
+                except (TypeError, ValueError, UnicodeError) as e:
+                    # not supported for this input type
+                    skipped[f"{path}::{case}::{typ}"] = f"{type(e).__name__}: {e}"
+                    print(f"{name:<40} {case:<24} {typ:<5} {kind:<6} skipped: {type(e).__name__}: {e}")
+                    continue
+                abf_ns = best_of(abf_fn, data, repeat) / len(dataset)
+                std_ns = best_of(stdlib_fn, data, repeat) / len(dataset) if stdlib_fn else None
+                results[f"{path}::{case}::{typ}"] = abf_ns
+                std = f"{std_ns:13.1f}" if std_ns else f"{'-':>13}"
+                speedup = f"{std_ns / abf_ns:7.2f}x" if std_ns else f"{'-':>8}"
+                print(f"{name:<40} {case:<24} {typ:<5} {kind:<6} {std} {abf_ns:10.1f} {speedup}")
+    return results, skipped
+
+
+def compare(results, skipped, baseline, threshold):
+    """Count the cases that got slower or are missing from results"""
+    regressions = 0
+    for key, ns in sorted(results.items()):
+        before = baseline.get(key)
+        if before and ns > before * (1 + threshold):
+            regressions += 1
+            print(f"slower: {key}: {before:.1f} -> {ns:.1f} ns/url (+{(ns / before - 1) * 100:.0f}%)")
+    for key in sorted(baseline.keys() - results.keys()):
+        regressions += 1
+        print(f"missing: {key}: {skipped.get(key, 'not run')}")
+    return regressions
+
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("paths", nargs="*", default=[DEFAULT_DATASETS])
+    ap.add_argument("--repeat", type=int, default=5)
+    ap.add_argument("--case", action="append", help="only run cases containing this")
+    ap.add_argument("--json", help="write the abf ns/url of every case here")
+    ap.add_argument("--compare", help="a --json file from an earlier run")
+    ap.add_argument("--threshold", type=float, default=0.10)
+    args = ap.parse_args(argv)
+
+    files = list(discover_txt_files(args.paths))
+    if not files:
+        sys.exit("no dataset files (is the tests/url-various-datasets submodule checked out?)")
+    results, skipped = run(files, args.repeat, args.case)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=1, sort_keys=True)
+    if args.compare:
+        with open(args.compare) as f:
+            # cases left out with --case are not missing
+            baseline = {key: ns for key, ns in json.load(f).items()
+                        if selected(key.split("::")[-2], args.case)}
+        if compare(results, skipped, baseline, args.threshold):
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
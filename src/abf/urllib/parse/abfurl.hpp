@@ -0,0 +1,552 @@
+#ifndef ABFURL_HPP
+#define ABFURL_HPP
+
+#include <abfurl/parse.h>
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+/*
+ * C++20 view of parse.h: url_split / url_parse returning std::string_view
+ * components that point into the url. Header-only, on top of libabfurl.
+ *
+ * split() and parse() are constexpr: in a constant expression they run a
+ * C++ transcription of the C parser (same components, same errors), so url
+ * literals and routing tables can be parsed at compile time; at run time
+ * they call the C library. Either way nothing is copied, which leaves out
+ * urls with '\t', '\r' or '\n' (urllib.parse drops those, so the components
+ * would point into a cleaned copy): they give errc::invalid_input, except
+ * through a parser, which owns such copies.
+ */
+namespace abf::url {
+
+enum class errc : int {
+    ok = URL_PARSE_OK,
+    invalid_ipv6 = URL_PARSE_ERROR_INVALID_IPV6,
+    invalid_netloc = URL_PARSE_ERROR_INVALID_NETLOC,
+    out_of_memory = URL_PARSE_ERROR_OUT_OF_MEMORY,
+    invalid_input = URL_PARSE_ERROR_INVALID_INPUT,
+    aborted = URL_PARSE_ERROR_ABORTED,
+    invalid_scheme = URL_PARSE_ERROR_INVALID_SCHEME,
+    invalid_char = URL_PARSE_ERROR_INVALID_CHAR,
+    invalid_escape = URL_PARSE_ERROR_INVALID_ESCAPE,
+    invalid_port = URL_PARSE_ERROR_INVALID_PORT,
+    unknown = URL_PARSE_ERROR_UNKNOWN,
+};
+
+inline const char *strerror(errc err) noexcept {
+    return url_parse_strerror(static_cast<url_parse_error_t>(err));
+}
+
+// url_netloc_t: nullopt where urllib.parse has None
+struct netloc_info {
+    std::optional<std::string_view> username;
+    std::optional<std::string_view> password;
+    std::optional<std::string_view> hostname; // '[' ']' removed, as written
+    std::optional<std::string_view> port;     // nullopt when missing or empty
+    bool host_upper = false;                  // A-Z before any '%' zone
+
+    constexpr bool operator==(const netloc_info &) const = default;
+};
+
+struct split_result {
+    std::string_view scheme = {}, netloc = {}, path = {}, query = {},
+                     fragment = {};
+    netloc_info netloc_parts = {};
+    errc error = errc::ok;
+
+    constexpr explicit operator bool() const noexcept {
+        return error == errc::ok;
+    }
+    constexpr bool operator==(const split_result &) const = default;
+};
+
+struct parse_result {
+    std::string_view scheme = {}, netloc = {}, path = {}, params = {},
+                     query = {}, fragment = {};
+    bool has_params = false;
+    netloc_info netloc_parts = {};
+    errc error = errc::ok;
+
+    constexpr explicit operator bool() const noexcept {
+        return error == errc::ok;
+    }
+    constexpr bool operator==(const parse_result &) const = default;
+};
+
+// url_validate: offset is the byte at fault, 0 for a valid url
+struct validation {
+    errc error = errc::ok;
+    std::size_t offset = 0;
+
+    constexpr explicit operator bool() const noexcept {
+        return error == errc::ok;
+    }
+};
+
+namespace detail {
+
+inline constexpr std::size_t npos = std::string_view::npos;
+
+constexpr bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+constexpr bool is_hex(char c) {
+    return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+constexpr char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c;
+}
+
+// p_is_valid_scheme
+constexpr bool is_valid_scheme(std::string_view s) {
+    if (s.empty() || !is_alpha(s[0])) {
+        return false;
+    }
+    for (char c : s) {
+        if (!is_alpha(c) && !is_digit(c) && c != '+' && c != '-' &&
+            c != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (lower(a[i]) != lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// urllib.parse.uses_params
+constexpr bool uses_params(std::string_view scheme) {
+    constexpr std::string_view schemes[] = {
+        "",     "ftp",   "hdl",   "prospero", "http", "imap",
+        "https", "shttp", "rtsp", "rtsps",    "rtspu", "sip",
+        "sips",  "mms",   "sftp", "tel"};
+    for (std::string_view s : schemes) {
+        if (iequals(scheme, s)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// p_is_ipv4: a dotted quad without leading zeros
+constexpr bool is_ipv4(std::string_view s) {
+    for (int octet = 0; octet < 4; ++octet) {
+        std::size_t dot = s.find('.');
+        if ((octet < 3) == (dot == npos)) {
+            return false;
+        }
+        std::string_view part = s.substr(0, dot);
+        if (part.empty() || part.size() > 3 ||
+            (part.size() > 1 && part[0] == '0')) {
+            return false;
+        }
+        unsigned value = 0;
+        for (char c : part) {
+            if (!is_digit(c)) {
+                return false;
+            }
+            value = value * 10 + static_cast<unsigned>(c - '0');
+        }
+        if (value > 255) {
+            return false;
+        }
+        s = octet < 3 ? s.substr(dot + 1) : std::string_view();
+    }
+    return true;
+}
+
+// p_is_ipv6: ipaddress.IPv6Address rules
+constexpr bool is_ipv6(std::string_view s) {
+    constexpr std::size_t hextets = 8, max_parts = hextets + 1;
+    if (std::size_t pct = s.find('%'); pct != npos) {
+        std::string_view scope = s.substr(pct + 1);
+        if (scope.empty() || scope.find('%') != npos) {
+            return false;
+        }
+        s = s.substr(0, pct);
+    }
+    if (s.empty()) {
+        return false;
+    }
+
+    std::string_view parts[max_parts] = {};
+    std::size_t k = 0;
+    for (std::size_t i = 0;;) {
+        std::size_t colon = s.find(':', i);
+        if (k == max_parts) {
+            return false;
+        }
+        parts[k++] = s.substr(i, colon == npos ? npos : colon - i);
+        if (colon == npos) {
+            break;
+        }
+        i = colon + 1;
+    }
+    if (k < 3) {
+        return false;
+    }
+    bool v4 = parts[k - 1].find('.') != npos;
+    if (v4 && !is_ipv4(parts[k - 1])) {
+        return false;
+    }
+    std::size_t nhex = v4 ? k - 1 : k;
+    std::size_t nparts = v4 ? k + 1 : k;
+    if (nparts > max_parts) {
+        return false;
+    }
+
+    std::size_t skip = npos;
+    for (std::size_t j = 1; j + 1 < nparts; ++j) {
+        if (j < nhex && parts[j].empty()) {
+            if (skip != npos) {
+                return false;
+            }
+            skip = j;
+        }
+    }
+    bool first_empty = parts[0].empty();
+    bool last_empty = !v4 && parts[k - 1].empty();
+    std::size_t hi, lo;
+    if (skip != npos) {
+        hi = skip;
+        lo = nparts - skip - 1;
+        if ((first_empty && --hi) || (last_empty && --lo) ||
+            hi + lo >= hextets) {
+            return false;
+        }
+    } else {
+        if (nparts != hextets || first_empty || last_empty) {
+            return false;
+        }
+        hi = nparts;
+        lo = 0;
+    }
+    for (std::size_t j = 0; j < nhex; ++j) {
+        if (j >= hi && j < nparts - lo) {
+            continue;
+        }
+        if (parts[j].empty() || parts[j].size() > 4) {
+            return false;
+        }
+        for (char c : parts[j]) {
+            if (!is_hex(c)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// p_is_bracketed_host: IPvFuture or IPv6
+constexpr bool is_bracketed_host(std::string_view s) {
+    if (!s.empty() && s[0] == 'v') {
+        std::size_t i = 1;
+        while (i < s.size() && is_hex(s[i])) {
+            ++i;
+        }
+        return i > 1 && i + 1 < s.size() && s[i] == '.';
+    }
+    return is_ipv6(s);
+}
+
+// p_split_netloc
+constexpr errc split_netloc(std::string_view netloc, netloc_info &out) {
+    out = {};
+    if (netloc.empty()) {
+        return errc::ok;
+    }
+    std::size_t open = netloc.find('['), close = netloc.find(']');
+    if ((open == npos) != (close == npos)) {
+        return errc::invalid_ipv6;
+    }
+    if (open != npos) {
+        std::size_t stop = netloc.find(']', open + 1);
+        if (!is_bracketed_host(netloc.substr(
+                open + 1, stop == npos ? npos : stop - open - 1))) {
+            return errc::invalid_netloc;
+        }
+    }
+
+    std::string_view host = netloc;
+    if (std::size_t at = netloc.rfind('@'); at != npos) {
+        std::string_view userinfo = netloc.substr(0, at);
+        std::size_t colon = userinfo.find(':');
+        out.username = userinfo.substr(0, colon);
+        if (colon != npos) {
+            out.password = userinfo.substr(colon + 1);
+        }
+        host = netloc.substr(at + 1);
+    }
+
+    std::size_t host_end, colon;
+    if (std::size_t bracket = host.find('['); bracket != npos) {
+        host = host.substr(bracket + 1);
+        host_end = host.find(']');
+        colon = host_end == npos ? npos : host.find(':', host_end);
+    } else {
+        colon = host.find(':');
+        host_end = colon;
+    }
+    std::string_view hostname = host.substr(0, host_end);
+    out.hostname = hostname;
+    if (colon != npos && colon + 1 < host.size()) {
+        out.port = host.substr(colon + 1);
+    }
+    for (char c : hostname.substr(0, hostname.find('%'))) {
+        if (c >= 'A' && c <= 'Z') {
+            out.host_upper = true;
+            break;
+        }
+    }
+    return errc::ok;
+}
+
+// p_split. *semicolon: offset in the path of its first ';' after the last
+// '/', npos if there is none.
+constexpr split_result split(std::string_view url, std::string_view scheme,
+                             bool allow_fragments, std::size_t *semicolon) {
+    split_result r;
+    *semicolon = npos;
+    std::size_t ws = 0;
+    while (ws < url.size() && static_cast<unsigned char>(url[ws]) <= 0x20) {
+        ++ws;
+    }
+    url.remove_prefix(ws);
+    if (url.find_first_of("\t\r\n") != npos) {
+        r.error = errc::invalid_input;
+        return r;
+    }
+
+    if (std::size_t colon = url.find(':');
+        colon != npos && is_valid_scheme(url.substr(0, colon))) {
+        r.scheme = url.substr(0, colon);
+        url.remove_prefix(colon + 1);
+    } else {
+        r.scheme = scheme;
+    }
+    if (url.starts_with("//")) {
+        std::size_t end = url.find_first_of("/?#", 2);
+        r.netloc = url.substr(2, end == npos ? npos : end - 2);
+        url.remove_prefix(end == npos ? url.size() : end);
+    }
+    std::size_t path_end = url.find_first_of(allow_fragments ? "?#" : "?");
+    r.path = url.substr(0, path_end);
+    for (std::size_t i = 0; i < r.path.size(); ++i) {
+        if (r.path[i] == '/') {
+            *semicolon = npos;
+        } else if (r.path[i] == ';' && *semicolon == npos) {
+            *semicolon = i;
+        }
+    }
+    if (path_end != npos) {
+        std::string_view rest = url.substr(path_end + 1);
+        if (url[path_end] == '?') {
+            std::size_t hash = allow_fragments ? rest.find('#') : npos;
+            r.query = rest.substr(0, hash);
+            if (hash != npos) {
+                r.fragment = rest.substr(hash + 1);
+            }
+        } else {
+            r.fragment = rest;
+        }
+    }
+    r.error = split_netloc(r.netloc, r.netloc_parts);
+    return r;
+}
+
+constexpr parse_result parse(std::string_view url, std::string_view scheme,
+                             bool allow_fragments) {
+    std::size_t semicolon;
+    split_result s = split(url, scheme, allow_fragments, &semicolon);
+    parse_result r{.scheme = s.scheme,
+                   .netloc = s.netloc,
+                   .path = s.path,
+                   .query = s.query,
+                   .fragment = s.fragment,
+                   .netloc_parts = s.netloc_parts,
+                   .error = s.error};
+    if (r.error == errc::ok && semicolon != npos && uses_params(r.scheme)) {
+        r.params = r.path.substr(semicolon + 1);
+        r.path = r.path.substr(0, semicolon);
+        r.has_params = true;
+    }
+    return r;
+}
+
+inline std::string_view view(const url_component_t &c) {
+    return {c.start, c.length};
+}
+
+inline std::optional<std::string_view> optional_view(
+    const url_component_t &c) {
+    if (!c.start) {
+        return std::nullopt;
+    }
+    return view(c);
+}
+
+inline netloc_info from_c(const url_netloc_t &n) {
+    return {.username = optional_view(n.username),
+            .password = optional_view(n.password),
+            .hostname = optional_view(n.hostname),
+            .port = optional_view(n.port),
+            .host_upper = n.host_upper};
+}
+
+// The default scheme is applied here: the C one wants a NUL-terminated one
+inline split_result from_c(const url_split_result_t &c, url_parse_error_t err,
+                           std::string_view scheme) {
+    return {.scheme = c.scheme.start ? view(c.scheme) : scheme,
+            .netloc = view(c.netloc),
+            .path = view(c.path),
+            .query = view(c.query),
+            .fragment = view(c.fragment),
+            .netloc_parts = from_c(c.netloc_parts),
+            .error = static_cast<errc>(err)};
+}
+
+inline parse_result from_c(const url_parse_result_t &c, url_parse_error_t err,
+                           std::string_view scheme) {
+    parse_result r = {.scheme = c.scheme.start ? view(c.scheme) : scheme,
+                      .netloc = view(c.netloc),
+                      .path = view(c.path),
+                      .params = view(c.params),
+                      .query = view(c.query),
+                      .fragment = view(c.fragment),
+                      .has_params = c.has_params,
+                      .netloc_parts = from_c(c.netloc_parts),
+                      .error = static_cast<errc>(err)};
+    // The C parser saw no scheme, and "" uses params; the default may not
+    if (r.has_params && !c.scheme.start && !uses_params(scheme)) {
+        r.path = {r.path.data(), r.path.size() + 1 + r.params.size()};
+        r.params = {};
+        r.has_params = false;
+    }
+    return r;
+}
+
+} // namespace detail
+
+/* urllib.parse.urlsplit: scheme is the default scheme */
+constexpr split_result split(std::string_view url,
+                             std::string_view scheme = {},
+                             bool allow_fragments = true) noexcept {
+    if (std::is_constant_evaluated()) {
+        std::size_t semicolon;
+        return detail::split(url, scheme, allow_fragments, &semicolon);
+    }
+    url_scratch_t scratch = {nullptr};
+    url_split_result_t c = {}; // read by from_c even on errors
+    url_parse_error_t err = url_split(url.data(), url.size(), nullptr,
+                                      allow_fragments, &scratch, &c);
+    if (scratch.head) { // parsed from a cleaned copy
+        url_scratch_free(&scratch);
+        return {.error = errc::invalid_input};
+    }
+    return detail::from_c(c, err, scheme);
+}
+
+/* urllib.parse.urlparse */
+constexpr parse_result parse(std::string_view url,
+                             std::string_view scheme = {},
+                             bool allow_fragments = true) noexcept {
+    if (std::is_constant_evaluated()) {
+        return detail::parse(url, scheme, allow_fragments);
+    }
+    url_scratch_t scratch = {nullptr};
+    url_parse_result_t c = {};
+    url_parse_error_t err = url_parse(url.data(), url.size(), nullptr,
+                                      allow_fragments, &scratch, &c);
+    if (scratch.head) {
+        url_scratch_free(&scratch);
+        return {.error = errc::invalid_input};
+    }
+    return detail::from_c(c, err, scheme);
+}
+
+/* Strict RFC 3986 URI-reference check, run time only */
+inline validation validate(std::string_view url) noexcept {
+    std::size_t offset = 0;
+    url_parse_error_t err =
+        url_validate(url.data(), url.size(), nullptr, &offset);
+    return {.error = static_cast<errc>(err), .offset = offset};
+}
+
+/*
+ * Run-time parsing of any url, those with '\t', '\r' or '\n' included: their
+ * cleaned copies live in the parser's scratch memory, so their results stay
+ * valid until reset() or the parser's destruction.
+ */
+class parser {
+  public:
+    parser() = default;
+    parser(const parser &) = delete;
+    parser &operator=(const parser &) = delete;
+    parser(parser &&other) noexcept : scratch_(other.scratch_) {
+        other.scratch_.head = nullptr;
+    }
+    parser &operator=(parser &&other) noexcept {
+        if (this != &other) {
+            url_scratch_free(&scratch_);
+            scratch_ = other.scratch_;
+            other.scratch_.head = nullptr;
+        }
+        return *this;
+    }
+    ~parser() { url_scratch_free(&scratch_); }
+
+    split_result split(std::string_view url, std::string_view scheme = {},
+                       bool allow_fragments = true) noexcept {
+        url_split_result_t c = {};
+        url_parse_error_t err = url_split(url.data(), url.size(), nullptr,
+                                          allow_fragments, &scratch_, &c);
+        return detail::from_c(c, err, scheme);
+    }
+
+    parse_result parse(std::string_view url, std::string_view scheme = {},
+                       bool allow_fragments = true) noexcept {
+        url_parse_result_t c = {};
+        url_parse_error_t err = url_parse(url.data(), url.size(), nullptr,
+                                          allow_fragments, &scratch_, &c);
+        return detail::from_c(c, err, scheme);
+    }
+
+    /* Free the copies, invalidating the results that point into them */
+    void reset() noexcept { url_scratch_reset(&scratch_); }
+
+  private:
+    url_scratch_t scratch_ = {nullptr};
+};
+
+namespace literals {
+
+/* "https://example.com/"_url: a split_result, or a compile error */
+consteval split_result operator""_url(const char *s, std::size_t n) {
+    split_result r = abf::url::split(std::string_view(s, n));
+    if (!r) {
+        throw "invalid url literal";
+    }
+    return r;
+}
+
+} // namespace literals
+
+} // namespace abf::url
+
+#endif
@@ -0,0 +1,627 @@
+#define _GNU_SOURCE
+#include "canon.h"
+#include "pool.h"
+#include <stdlib.h>
+#include <strings.h>
+
+/*
+ * Canonicalization writes to a sink: either the output buffer or a running
+ * XXH64 state, so url_fingerprint hashes the very bytes url_canonicalize
+ * would write without building them. Components are emitted in runs up to
+ * the next '%'; only dot segments and sorted query fields need a list of
+ * spans, which point into the url.
+ */
+
+enum {
+    C_LOCAL_SPANS = 64, // path segments / query fields before a malloc
+    C_LOWER_CHUNK = 64,
+    C_BATCH_PARALLEL_MIN = 16384,
+    C_BATCH_CHUNK = 512
+};
+
+// clang-format off
+/* Hex digit value + 1, 0: not a hex digit */
+static const uint8_t c_HEX_DIGIT[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+// clang-format on
+
+static const char c_UPPER_HEX[] = "0123456789ABCDEF";
+
+/* RFC 3986 unreserved: ALPHA DIGIT - . _ ~ */
+static inline bool c_unreserved(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' ||
+           c == '~';
+}
+
+static inline char c_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c | 0x20) : c;
+}
+
+/*
+ * XXH64, streaming. Reads are little endian on every host so fingerprints
+ * can be stored and compared across machines.
+ */
+#define C_P1 0x9E3779B185EBCA87ULL
+#define C_P2 0xC2B2AE3D27D4EB4FULL
+#define C_P3 0x165667B19E3779F9ULL
+#define C_P4 0x85EBCA77C2B2AE63ULL
+#define C_P5 0x27D4EB2F165667C5ULL
+
+typedef struct {
+    uint64_t v[4];
+    uint64_t total_len;
+    uint64_t seed;
+    unsigned char mem[32]; // a partial stripe
+    size_t memsize;
+} c_xxh64_t;
+
+static inline uint64_t c_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t c_read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t c_read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t c_round(uint64_t acc, uint64_t input) {
+    acc += input * C_P2;
+    return c_rotl(acc, 31) * C_P1;
+}
+
+static inline uint64_t c_merge(uint64_t acc, uint64_t v) {
+    acc ^= c_round(0, v);
+    return acc * C_P1 + C_P4;
+}
+
+static void c_xxh64_init(c_xxh64_t *h, uint64_t seed) {
+    memset(h, 0, sizeof(*h));
+    h->seed = seed;
+    h->v[0] = seed + C_P1 + C_P2;
+    h->v[1] = seed + C_P2;
+    h->v[2] = seed;
+    h->v[3] = seed - C_P1;
+}
+
+static inline void c_xxh64_stripe(c_xxh64_t *h, const unsigned char *p) {
+    h->v[0] = c_round(h->v[0], c_read64(p));
+    h->v[1] = c_round(h->v[1], c_read64(p + 8));
+    h->v[2] = c_round(h->v[2], c_read64(p + 16));
+    h->v[3] = c_round(h->v[3], c_read64(p + 24));
+}
+
+static void c_xxh64_update(c_xxh64_t *h, const void *data, size_t len) {
+    const unsigned char *p = data, *end = p + len;
+    h->total_len += len;
+    if (h->memsize + len < sizeof(h->mem)) {
+        memcpy(h->mem + h->memsize, p, len);
+        h->memsize += len;
+        return;
+    }
+    if (h->memsize) {
+        size_t fill = sizeof(h->mem) - h->memsize;
+        memcpy(h->mem + h->memsize, p, fill);
+        c_xxh64_stripe(h, h->mem);
+        p += fill;
+        h->memsize = 0;
+    }
+    for (; end - p >= 32; p += 32) {
+        c_xxh64_stripe(h, p);
+    }
+    memcpy(h->mem, p, (size_t)(end - p));
+    h->memsize = (size_t)(end - p);
+}
+
+static uint64_t c_xxh64_digest(const c_xxh64_t *h) {
+    uint64_t acc;
+    if (h->total_len >= 32) {
+        acc = c_rotl(h->v[0], 1) + c_rotl(h->v[1], 7) + c_rotl(h->v[2], 12) +
+              c_rotl(h->v[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            acc = c_merge(acc, h->v[i]);
+        }
+    } else {
+        acc = h->seed + C_P5;
+    }
+    acc += h->total_len;
+
+    const unsigned char *p = h->mem, *end = p + h->memsize;
+    for (; end - p >= 8; p += 8) {
+        acc ^= c_round(0, c_read64(p));
+        acc = c_rotl(acc, 27) * C_P1 + C_P4;
+    }
+    if (end - p >= 4) {
+        acc ^= (uint64_t)c_read32(p) * C_P1;
+        acc = c_rotl(acc, 23) * C_P2 + C_P3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        acc ^= *p * C_P5;
+        acc = c_rotl(acc, 11) * C_P1;
+    }
+
+    acc ^= acc >> 33;
+    acc *= C_P2;
+    acc ^= acc >> 29;
+    acc *= C_P3;
+    acc ^= acc >> 32;
+    return acc;
+}
+
+uint64_t url_xxh64(const void *data, size_t len, uint64_t seed) {
+    c_xxh64_t h;
+    c_xxh64_init(&h, seed);
+    c_xxh64_update(&h, data, len);
+    return c_xxh64_digest(&h);
+}
+
+/*
+ * Sinks and escape normalization
+ */
+typedef struct {
+    char *out;       // the next byte of the canonical form, without hash
+    c_xxh64_t *hash; // fingerprinting
+} c_sink_t;
+
+static inline void c_put(c_sink_t *s, const char *p, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    if (s->hash) {
+        c_xxh64_update(s->hash, p, n);
+    } else {
+        memcpy(s->out, p, n);
+        s->out += n;
+    }
+}
+
+static void c_put_lower(c_sink_t *s, const char *p, size_t n) {
+    char buf[C_LOWER_CHUNK];
+    while (n) {
+        size_t m = n < sizeof(buf) ? n : sizeof(buf);
+        for (size_t i = 0; i < m; ++i) {
+            buf[i] = c_lower(p[i]);
+        }
+        c_put(s, buf, m);
+        p += m;
+        n -= m;
+    }
+}
+
+// p[0] is '%': the escaped byte when two hex digits follow, -1 otherwise
+static inline int c_escape_at(const char *p, const char *end) {
+    uint8_t hi, lo;
+    if (end - p >= 3 && (hi = c_HEX_DIGIT[(unsigned char)p[1]]) &&
+        (lo = c_HEX_DIGIT[(unsigned char)p[2]])) {
+        return (hi - 1) << 4 | (lo - 1);
+    }
+    return -1;
+}
+
+// Whether escape c is decoded, out bytes after the last literal '%' (one
+// that starts no escape): a hex digit there would make an escape of it
+static inline bool c_decodes(int c, size_t out) {
+    return c_unreserved((unsigned char)c) &&
+           (out >= 2 || !c_HEX_DIGIT[(unsigned char)c]);
+}
+
+// Copy a component with its escapes normalized, lowercased when lower
+// (the hex digits of the escapes that remain excepted); decode: unreserved
+// escapes are decoded, as c_decodes allows
+static void c_put_escaped(c_sink_t *s, const char *p, size_t n, bool lower,
+                          bool decode) {
+    if (n == 0) {
+        return; // p may be NULL
+    }
+    const char *end = p + n;
+    size_t out = 2; // bytes since a literal '%'
+    while (p < end) {
+        const char *pct = memchr(p, '%', (size_t)(end - p));
+        const char *run_end = pct ? pct : end;
+        if (lower) {
+            c_put_lower(s, p, (size_t)(run_end - p));
+        } else {
+            c_put(s, p, (size_t)(run_end - p));
+        }
+        if (!pct) {
+            return;
+        }
+        out += (size_t)(run_end - p);
+        int c = c_escape_at(pct, end);
+        if (c < 0) {
+            c_put(s, "%", 1);
+            p = pct + 1;
+            out = 0;
+        } else if (decode && c_decodes(c, out)) {
+            char ch = lower ? c_lower((char)c) : (char)c;
+            c_put(s, &ch, 1);
+            p = pct + 3;
+            out++;
+        } else {
+            char esc[3] = {'%', c_UPPER_HEX[c >> 4], c_UPPER_HEX[c & 0xF]};
+            c_put(s, esc, sizeof(esc));
+            p = pct + 3;
+            out += 3;
+        }
+    }
+}
+
+// The normalized bytes of a span one at a time, for sorting
+typedef struct {
+    const char *p, *end;
+    char held[2]; // hex digits of an escape whose '%' was returned
+    int nheld;
+    size_t out; // bytes since a literal '%', as in c_put_escaped
+} c_cursor_t;
+
+static inline int c_cursor_next(c_cursor_t *c) {
+    if (c->nheld) {
+        c->out++;
+        return (unsigned char)c->held[2 - c->nheld--];
+    }
+    if (c->p == c->end) {
+        return -1;
+    }
+    c->out++;
+    if (*c->p != '%') {
+        return (unsigned char)*c->p++;
+    }
+    int e = c_escape_at(c->p, c->end);
+    if (e < 0) {
+        c->p++;
+        c->out = 0;
+        return '%';
+    }
+    c->p += 3;
+    if (c_decodes(e, c->out - 1)) {
+        return e;
+    }
+    c->held[0] = c_UPPER_HEX[e >> 4];
+    c->held[1] = c_UPPER_HEX[e & 0xF];
+    c->nheld = 2;
+    return '%';
+}
+
+static int c_field_cmp(const void *a, const void *b) {
+    const url_component_t *x = a, *y = b;
+    c_cursor_t cx = {.p = x->start, .end = x->start + x->length, .out = 2};
+    c_cursor_t cy = {.p = y->start, .end = y->start + y->length, .out = 2};
+    for (;;) {
+        int u = c_cursor_next(&cx), v = c_cursor_next(&cy);
+        if (u != v) {
+            return u < v ? -1 : 1;
+        }
+        if (u < 0) {
+            return 0;
+        }
+    }
+}
+
+/*
+ * Components
+ */
+typedef struct {
+    url_component_t local[C_LOCAL_SPANS];
+    url_component_t *items;
+    size_t cap;
+    size_t count;
+} c_spans_t;
+
+static void c_spans_init(c_spans_t *sp) {
+    sp->items = sp->local;
+    sp->cap = C_LOCAL_SPANS;
+    sp->count = 0;
+}
+
+static bool c_spans_reserve(c_spans_t *sp, size_t n) {
+    sp->count = 0;
+    if (n <= sp->cap) {
+        return true;
+    }
+    url_component_t *items = malloc(n * sizeof(*items));
+    if (!items) {
+        return false;
+    }
+    if (sp->items != sp->local) {
+        free(sp->items);
+    }
+    sp->items = items;
+    sp->cap = n;
+    return true;
+}
+
+static void c_spans_free(c_spans_t *sp) {
+    if (sp->items != sp->local) {
+        free(sp->items);
+    }
+}
+
+static inline void c_spans_push(c_spans_t *sp, const char *p, size_t n) {
+    sp->items[sp->count++] = (url_component_t){.start = p, .length = n};
+}
+
+static size_t c_count(const char *p, size_t n, char c) {
+    size_t count = 0;
+    for (const char *end = p + n; (p = memchr(p, c, (size_t)(end - p)));
+         ++p) {
+        count++;
+    }
+    return count;
+}
+
+static bool c_default_port(url_component_t scheme, const char *port,
+                           size_t n) {
+    static const struct {
+        const char *scheme, *port;
+    } defaults[] = {{"http", "80"},
+                    {"https", "443"},
+                    {"ws", "80"},
+                    {"wss", "443"},
+                    {"ftp", "21"}};
+    if (n == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(defaults) / sizeof(*defaults); ++i) {
+        if (strlen(defaults[i].scheme) == scheme.length &&
+            strncasecmp(defaults[i].scheme, scheme.start, scheme.length) ==
+                0 &&
+            strlen(defaults[i].port) == n &&
+            memcmp(defaults[i].port, port, n) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// [userinfo@]host[:port], url_split having checked the brackets
+static void c_put_netloc(c_sink_t *s, url_component_t netloc,
+                         url_component_t scheme) {
+    const char *p = netloc.start, *end = p + netloc.length;
+    const char *at = memrchr(p, '@', netloc.length);
+    if (at) {
+        c_put_escaped(s, p, (size_t)(at - p), false, true);
+        c_put(s, "@", 1);
+        p = at + 1;
+    }
+    const char *colon;
+    bool bare = false; // the host has a ':' too: dropping a port exposes it
+    if (p < end && *p == '[') {
+        const char *close = memchr(p, ']', (size_t)(end - p));
+        colon = close && close + 1 < end && close[1] == ':' ? close + 1 : NULL;
+    } else {
+        colon = memrchr(p, ':', (size_t)(end - p));
+        bare = colon && memchr(p, ':', (size_t)(colon - p));
+    }
+    c_put_escaped(s, p, (size_t)((colon ? colon : end) - p), true, true);
+    if (colon &&
+        (bare ||
+         !c_default_port(scheme, colon + 1, (size_t)(end - colon - 1)))) {
+        c_put(s, colon, (size_t)(end - colon));
+    }
+}
+
+// 1 for ".", 2 for "..", either possibly escaped; 0 for any other segment
+static int c_dots(const char *p, size_t n) {
+    int dots = 0;
+    for (size_t i = 0; i < n && dots <= 2; ++dots) {
+        if (p[i] == '.') {
+            i++;
+        } else if (n - i >= 3 && p[i] == '%' && p[i + 1] == '2' &&
+                   (p[i + 2] | 0x20) == 'e') {
+            i += 3;
+        } else {
+            return 0;
+        }
+    }
+    return dots <= 2 ? dots : 0;
+}
+
+// RFC 3986 remove_dot_segments on an absolute path, other paths as they are.
+// The escapes of the first keep bytes stay encoded; without a netloc, a
+// path left starting with "//" gets a "/." prefix, as WHATWG URLs do, so it
+// is not read as one next time.
+static bool c_put_path(c_sink_t *s, c_spans_t *sp, const char *p, size_t n,
+                       size_t keep, bool netloc) {
+    if (n == 0 || p[0] != '/') {
+        if (keep) {
+            c_put_escaped(s, p, keep, false, false);
+            p += keep;
+            n -= keep;
+        }
+        c_put_escaped(s, p, n, false, true);
+        return true;
+    }
+    const char *end = p + n;
+    if (!c_spans_reserve(sp, c_count(p, n, '/'))) {
+        return false;
+    }
+    for (const char *seg = p + 1;;) {
+        const char *slash = memchr(seg, '/', (size_t)(end - seg));
+        const char *seg_end = slash ? slash : end;
+        int dots = c_dots(seg, (size_t)(seg_end - seg));
+        if (dots == 2 && sp->count) {
+            sp->count--;
+        }
+        if (!dots) {
+            c_spans_push(sp, seg, (size_t)(seg_end - seg));
+        } else if (!slash) {
+            c_spans_push(sp, end, 0); // "/a/.." is "/a/", not "/a"
+        }
+        if (!slash) {
+            break;
+        }
+        seg = slash + 1;
+    }
+    if (!netloc && sp->count > 1 && !sp->items[0].length) {
+        c_put(s, "/.", 2);
+    }
+    for (size_t i = 0; i < sp->count; ++i) {
+        c_put(s, "/", 1);
+        c_put_escaped(s, sp->items[i].start, sp->items[i].length, false,
+                      true);
+    }
+    return true;
+}
+
+// Without a scheme or netloc, the bytes before a ':' in the first segment
+// of the path: decoded, they could read as a scheme
+static size_t c_scheme_like(const url_split_result_t *r) {
+    if (r->scheme.length || r->netloc.start || !r->path.length) {
+        return 0;
+    }
+    const char *p = r->path.start, *end = p + r->path.length;
+    for (const char *q = p; q < end && *q != '/'; ++q) {
+        if (*q == ':') {
+            return (size_t)(q - p);
+        }
+    }
+    return 0;
+}
+
+static bool c_put_query(c_sink_t *s, c_spans_t *sp, const char *p, size_t n,
+                        bool sort) {
+    if (n == 0) {
+        return true; // p may be NULL
+    }
+    if (!sort) {
+        c_put(s, "?", 1);
+        c_put_escaped(s, p, n, false, true);
+        return true;
+    }
+    if (!c_spans_reserve(sp, c_count(p, n, '&') + 1)) {
+        return false;
+    }
+    const char *end = p + n;
+    while (p < end) {
+        const char *amp = memchr(p, '&', (size_t)(end - p));
+        const char *field_end = amp ? amp : end;
+        if (field_end > p) {
+            c_spans_push(sp, p, (size_t)(field_end - p));
+        }
+        p = field_end + 1;
+    }
+    qsort(sp->items, sp->count, sizeof(*sp->items), c_field_cmp);
+    for (size_t i = 0; i < sp->count; ++i) {
+        c_put(s, i ? "&" : "?", 1);
+        c_put_escaped(s, sp->items[i].start, sp->items[i].length, false,
+                      true);
+    }
+    return true;
+}
+
+static url_parse_error_t c_canon(const char *url, size_t url_len,
+                                 unsigned flags, url_scratch_t *scratch,
+                                 c_sink_t *s) {
+    url_split_result_t r;
+    url_parse_error_t err = url_split(url, url_len, NULL, true, scratch, &r);
+    if (err != URL_PARSE_OK) {
+        return err;
+    }
+    if (r.scheme.length) {
+        c_put_lower(s, r.scheme.start, r.scheme.length);
+        c_put(s, ":", 1);
+    }
+    if (r.netloc.start) { // "//" was there, even if nothing followed
+        c_put(s, "//", 2);
+        c_put_netloc(s, r.netloc, r.scheme);
+    }
+    c_spans_t sp;
+    c_spans_init(&sp);
+    if (r.netloc.length && r.path.length == 0) {
+        c_put(s, "/", 1);
+    } else if (!c_put_path(s, &sp, r.path.start, r.path.length,
+                           c_scheme_like(&r), r.netloc.start != NULL)) {
+        err = URL_PARSE_ERROR_OUT_OF_MEMORY;
+    }
+    if (err == URL_PARSE_OK &&
+        !c_put_query(s, &sp, r.query.start, r.query.length,
+                     flags & URL_CANON_SORT_QUERY)) {
+        err = URL_PARSE_ERROR_OUT_OF_MEMORY;
+    }
+    c_spans_free(&sp);
+    if (r.fragment.length && !(flags & URL_CANON_DROP_FRAGMENT)) {
+        c_put(s, "#", 1);
+        c_put_escaped(s, r.fragment.start, r.fragment.length, false, true);
+    }
+    return err;
+}
+
+url_parse_error_t url_canonicalize(const char *url, size_t url_len,
+                                   unsigned flags, url_scratch_t *scratch,
+                                   char *out, size_t *out_len) {
+    c_sink_t sink = {.out = out};
+    url_parse_error_t err = c_canon(url, url_len, flags, scratch, &sink);
+    if (err == URL_PARSE_OK) {
+        *out_len = (size_t)(sink.out - out);
+    }
+    return err;
+}
+
+url_parse_error_t url_fingerprint(const char *url, size_t url_len,
+                                  unsigned flags, uint64_t seed,
+                                  url_scratch_t *scratch, uint64_t *out) {
+    c_xxh64_t hash;
+    c_xxh64_init(&hash, seed);
+    c_sink_t sink = {.hash = &hash};
+    url_parse_error_t err = c_canon(url, url_len, flags, scratch, &sink);
+    *out = err == URL_PARSE_OK ? c_xxh64_digest(&hash) : 0;
+    return err;
+}
+
+typedef struct {
+    const char *const *urls;
+    const size_t *url_lens;
+    unsigned flags;
+    uint64_t seed;
+    uint64_t *out;
+    url_parse_error_t *errors;
+} c_batch_t;
+
+static void c_batch_task(void *ctx, size_t begin, size_t end) {
+    c_batch_t *batch = ctx;
+    url_scratch_t scratch = {NULL};
+    for (size_t i = begin; i < end; ++i) {
+        url_parse_error_t err =
+            url_fingerprint(batch->urls[i], batch->url_lens[i], batch->flags,
+                            batch->seed, &scratch, &batch->out[i]);
+        if (batch->errors) {
+            batch->errors[i] = err;
+        }
+        url_scratch_reset(&scratch);
+    }
+    url_scratch_free(&scratch);
+}
+
+void url_fingerprint_many(const char *const *urls, const size_t *url_lens,
+                          size_t count, unsigned flags, uint64_t seed,
+                          uint64_t *out, url_parse_error_t *errors) {
+    c_batch_t batch = {.urls = urls,
+                       .url_lens = url_lens,
+                       .flags = flags,
+                       .seed = seed,
+                       .out = out,
+                       .errors = errors};
+    if (count < C_BATCH_PARALLEL_MIN) {
+        c_batch_task(&batch, 0, count);
+    } else {
+        url_pool_run(count, C_BATCH_CHUNK, c_batch_task, &batch);
+    }
+}
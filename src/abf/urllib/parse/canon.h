@@ -0,0 +1,66 @@
+#ifndef CANON_H
+#define CANON_H
+
+#include "parse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Canonical form of a url for deduplication, on top of url_split:
+ *
+ * - scheme and host lowercased, the host's escapes excepted
+ * - %XX escapes of unreserved characters (ALPHA DIGIT - . _ ~) decoded, the
+ *   hex digits of the others uppercased, in every component but the scheme
+ * - an empty port and the default port of http, https, ws, wss and ftp
+ *   dropped, unless the host has a ':' too
+ * - dot segments of an absolute path removed, "." and ".." written as
+ *   escapes included; an empty path after a netloc becomes "/", and a path
+ *   left starting with "//" without one gets a "/." prefix
+ * - an empty query or fragment dropped
+ *
+ * Escapes stay encoded where the decoded byte would change how the result
+ * parses: before the ':' of a url with no scheme or netloc, and for a hex
+ * digit right after a '%' that starts no escape. So canonicalizing the
+ * canonical form gives it back.
+ *
+ * A url that url_split rejects has no canonical form. The fingerprint is
+ * XXH64 of the canonical form, hashed while it is produced: the string itself
+ * is never built.
+ */
+enum {
+    URL_CANON_SORT_QUERY = 1 << 0,    /* sort the '&' fields, drop empty ones */
+    URL_CANON_DROP_FRAGMENT = 1 << 1, /* drop the fragment altogether */
+};
+
+/* Room the canonical form of a url_len byte url may need */
+static inline size_t url_canon_bound(size_t url_len) {
+    return url_len + 1; // the '/' of an empty path after a netloc
+}
+
+/* Write the canonical form into out (url_canon_bound bytes), its length into
+ * *out_len. scratch is used as by url_split. */
+url_parse_error_t url_canonicalize(const char *url, size_t url_len,
+                                   unsigned flags, url_scratch_t *scratch,
+                                   char *out, size_t *out_len);
+
+url_parse_error_t url_fingerprint(const char *url, size_t url_len,
+                                  unsigned flags, uint64_t seed,
+                                  url_scratch_t *scratch, uint64_t *out);
+
+/* Fingerprints of urls[i] (url_lens[i] bytes) into out[i], errors[i] (errors
+ * may be NULL; out[i] is 0 for a rejected url). Large batches run on the
+ * worker pool, see pool.h. */
+void url_fingerprint_many(const char *const *urls, const size_t *url_lens,
+                          size_t count, unsigned flags, uint64_t seed,
+                          uint64_t *out, url_parse_error_t *errors);
+
+/* XXH64 of a buffer, the hash url_fingerprint uses */
+uint64_t url_xxh64(const void *data, size_t len, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
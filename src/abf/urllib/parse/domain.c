@@ -0,0 +1,270 @@
+#include "domain.h"
+#include "pool.h"
+#include <stdlib.h>
+
+enum {
+    D_MIN_SLOTS = 8,
+    D_BATCH_PARALLEL_MIN = 16384,
+    D_BATCH_CHUNK = 512
+};
+
+#define D_NONE UINT32_MAX // no rule; as a name, an empty slot
+
+#define D_FNV_OFFSET 0xCBF29CE484222325ULL
+#define D_FNV_PRIME 0x100000001B3ULL
+
+/* A label suffix of one or more rules. Interior suffixes have no rule of
+ * their own: they only say that a longer rule ends with them. */
+typedef struct {
+    uint32_t name;      // offset of the suffix in names
+    uint32_t len;
+    uint32_t self_rule; // the rule matching the suffix itself
+    uint32_t sub_rule;  // the rule matching the hosts under it
+} d_slot_t;
+
+struct url_domain_matcher {
+    d_slot_t *slots;
+    size_t mask; // slot count - 1
+    int shift;   // 64 - log2(slot count)
+    char *names; // the rules lowercased, "*." and trailing '.' removed
+};
+
+static inline char d_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c | 0x20) : c;
+}
+
+// FNV-1a, fed right to left so that every suffix's hash is on the way
+static inline uint64_t d_hash_byte(uint64_t h, char c) {
+    return (h ^ (unsigned char)d_lower(c)) * D_FNV_PRIME;
+}
+
+// Fibonacci hashing: the high bits of the product
+static inline size_t d_index(const url_domain_matcher_t *m, uint64_t h) {
+    return (size_t)((h * 0x9E3779B97F4A7C15ULL) >> m->shift);
+}
+
+// The slot of the suffix s[0, n) (hash h, upper if it has A-Z), NULL when
+// no rule ends with it
+static const d_slot_t *d_find(const url_domain_matcher_t *m, const char *s,
+                              size_t n, uint64_t h, bool upper) {
+    for (size_t i = d_index(m, h);; i = (i + 1) & m->mask) {
+        const d_slot_t *slot = &m->slots[i];
+        if (slot->name == D_NONE) {
+            return NULL;
+        }
+        if (slot->len != n) {
+            continue;
+        }
+        const char *name = m->names + slot->name;
+        if (!upper) {
+            if (memcmp(s, name, n) == 0) {
+                return slot;
+            }
+            continue;
+        }
+        size_t j = 0;
+        while (j < n && d_lower(s[j]) == name[j]) {
+            j++;
+        }
+        if (j == n) {
+            return slot;
+        }
+    }
+}
+
+// The slot of the suffix at names[name, name + len), added if missing
+static d_slot_t *d_insert(url_domain_matcher_t *m, uint32_t name,
+                          uint32_t len, uint64_t h) {
+    for (size_t i = d_index(m, h);; i = (i + 1) & m->mask) {
+        d_slot_t *slot = &m->slots[i];
+        if (slot->name == D_NONE) {
+            slot->name = name;
+            slot->len = len;
+            return slot;
+        }
+        if (slot->len == len &&
+            memcmp(m->names + slot->name, m->names + name, len) == 0) {
+            return slot;
+        }
+    }
+}
+
+// A rule without its trailing '.' and "*." prefix; false for a rule that
+// is empty, has an empty label or a NUL byte
+static bool d_rule(const char *rule, size_t n, const char **name,
+                   size_t *len, bool *sub) {
+    if (n && rule[n - 1] == '.') {
+        n--;
+    }
+    *sub = n >= 2 && rule[0] == '*' && rule[1] == '.';
+    if (*sub) {
+        rule += 2;
+        n -= 2;
+    }
+    *name = rule;
+    *len = n;
+    if (n == 0 || rule[0] == '.' || rule[n - 1] == '.' ||
+        memchr(rule, '\0', n)) {
+        return false;
+    }
+    for (const char *dot = rule; (dot = memchr(dot, '.', n - (dot - rule)));
+         ++dot) {
+        if (dot[1] == '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+url_parse_error_t url_domain_matcher_new(const char *const *rules,
+                                         const size_t *rule_lens, size_t count,
+                                         url_domain_matcher_t **out,
+                                         size_t *bad_rule) {
+    *out = NULL;
+    // Room for the names, and a slot per label at most half full
+    size_t names_len = 0, labels = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const char *name;
+        size_t len;
+        bool sub;
+        if (!d_rule(rules[i], rule_lens[i], &name, &len, &sub)) {
+            if (bad_rule) {
+                *bad_rule = i;
+            }
+            return URL_PARSE_ERROR_INVALID_NETLOC;
+        }
+        names_len += len + 1;
+        labels++;
+        for (size_t j = 0; j < len; ++j) {
+            labels += name[j] == '.';
+        }
+    }
+    if (count >= D_NONE || names_len >= D_NONE) {
+        return URL_PARSE_ERROR_OUT_OF_MEMORY;
+    }
+    size_t slots = D_MIN_SLOTS;
+    while (slots < 2 * labels) {
+        slots *= 2;
+    }
+
+    url_domain_matcher_t *m = calloc(1, sizeof(*m));
+    if (!m || !(m->slots = malloc(slots * sizeof(*m->slots))) ||
+        !(m->names = malloc(names_len ? names_len : 1))) {
+        url_domain_matcher_free(m);
+        return URL_PARSE_ERROR_OUT_OF_MEMORY;
+    }
+    memset(m->slots, 0xFF, slots * sizeof(*m->slots)); // all D_NONE
+    m->mask = slots - 1;
+    m->shift = 64 - __builtin_ctzll(slots);
+
+    uint32_t pos = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const char *name;
+        size_t len;
+        bool sub;
+        d_rule(rules[i], rule_lens[i], &name, &len, &sub);
+        char *lowered = m->names + pos;
+        for (size_t j = 0; j < len; ++j) {
+            lowered[j] = d_lower(name[j]);
+        }
+        lowered[len] = '\0';
+
+        // Every label suffix, the rule itself last
+        uint64_t h = D_FNV_OFFSET;
+        for (size_t j = len; j > 0; --j) {
+            if (lowered[j - 1] == '.') {
+                d_insert(m, pos + (uint32_t)j, (uint32_t)(len - j), h);
+            }
+            h = d_hash_byte(h, lowered[j - 1]);
+        }
+        d_slot_t *slot = d_insert(m, pos, (uint32_t)len, h);
+        if (!sub && slot->self_rule == D_NONE) {
+            slot->self_rule = (uint32_t)i;
+        }
+        if (slot->sub_rule == D_NONE) {
+            slot->sub_rule = (uint32_t)i;
+        }
+        pos += (uint32_t)len + 1;
+    }
+    *out = m;
+    return URL_PARSE_OK;
+}
+
+void url_domain_matcher_free(url_domain_matcher_t *m) {
+    if (m) {
+        free(m->slots);
+        free(m->names);
+        free(m);
+    }
+}
+
+size_t url_domain_match_host(const url_domain_matcher_t *m, const char *host,
+                             size_t host_len) {
+    if (host_len && host[host_len - 1] == '.') {
+        host_len--;
+    }
+    uint32_t best = D_NONE;
+    uint64_t h = D_FNV_OFFSET;
+    bool upper = false;
+    for (size_t i = host_len; i > 0; --i) {
+        const char c = host[i - 1];
+        if (c == '.') {
+            // Shortest suffix first: a longer match overrides
+            const d_slot_t *slot =
+                d_find(m, host + i, host_len - i, h, upper);
+            if (!slot) {
+                return best == D_NONE ? URL_DOMAIN_NO_MATCH : best;
+            }
+            if (slot->sub_rule != D_NONE) {
+                best = slot->sub_rule;
+            }
+        }
+        h = d_hash_byte(h, c);
+        upper |= c >= 'A' && c <= 'Z';
+    }
+    const d_slot_t *slot = d_find(m, host, host_len, h, upper);
+    if (slot && slot->self_rule != D_NONE) {
+        best = slot->self_rule;
+    }
+    return best == D_NONE ? URL_DOMAIN_NO_MATCH : best;
+}
+
+size_t url_domain_match(const url_domain_matcher_t *m, const char *url,
+                        size_t url_len, url_scratch_t *scratch) {
+    url_split_result_t r;
+    if (url_split(url, url_len, NULL, true, scratch, &r) != URL_PARSE_OK ||
+        !r.netloc_parts.hostname.start) {
+        return URL_DOMAIN_NO_MATCH;
+    }
+    return url_domain_match_host(m, r.netloc_parts.hostname.start,
+                                 r.netloc_parts.hostname.length);
+}
+
+typedef struct {
+    const url_domain_matcher_t *m;
+    const char *const *urls;
+    const size_t *url_lens;
+    size_t *out;
+} d_batch_t;
+
+static void d_batch_task(void *ctx, size_t begin, size_t end) {
+    d_batch_t *batch = ctx;
+    url_scratch_t scratch = {NULL};
+    for (size_t i = begin; i < end; ++i) {
+        batch->out[i] = url_domain_match(batch->m, batch->urls[i],
+                                         batch->url_lens[i], &scratch);
+        url_scratch_reset(&scratch);
+    }
+    url_scratch_free(&scratch);
+}
+
+void url_domain_match_many(const url_domain_matcher_t *m,
+                           const char *const *urls, const size_t *url_lens,
+                           size_t count, size_t *out) {
+    d_batch_t batch = {.m = m, .urls = urls, .url_lens = url_lens, .out = out};
+    if (count < D_BATCH_PARALLEL_MIN) {
+        d_batch_task(&batch, 0, count);
+    } else {
+        url_pool_run(count, D_BATCH_CHUNK, d_batch_task, &batch);
+    }
+}
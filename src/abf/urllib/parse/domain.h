@@ -0,0 +1,56 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include "parse.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Host suffix matching against a rule list compiled once. A rule
+ * "example.com" matches that host and every host under it, "*.example.com"
+ * only the hosts under it. Labels compare ASCII case-insensitively, one
+ * trailing '.' of a rule or host is ignored, and the most specific (longest)
+ * matching rule wins, the first of two equal rules.
+ *
+ * The rules live in an open-addressing table of all their label suffixes
+ * ("a.example.com", "example.com", "com"), so a host is hashed right to left
+ * once and looked up one label at a time, stopping at the first suffix no
+ * rule ends with. Hosts are never copied or lowercased.
+ */
+typedef struct url_domain_matcher url_domain_matcher_t;
+
+#define URL_DOMAIN_NO_MATCH SIZE_MAX
+
+/* Compile rules[i] (rule_lens[i] bytes) into *out. A rule that is empty, has
+ * an empty label or a NUL byte gives INVALID_NETLOC with its index in
+ * *bad_rule (may be NULL). */
+url_parse_error_t url_domain_matcher_new(const char *const *rules,
+                                         const size_t *rule_lens, size_t count,
+                                         url_domain_matcher_t **out,
+                                         size_t *bad_rule);
+
+void url_domain_matcher_free(url_domain_matcher_t *m);
+
+/* Index of the rule matching host, URL_DOMAIN_NO_MATCH if none does */
+size_t url_domain_match_host(const url_domain_matcher_t *m, const char *host,
+                             size_t host_len);
+
+/* url_domain_match_host of the hostname url_split finds: userinfo, port and
+ * IPv6 brackets skipped. No match for a url without a host or that url_split
+ * rejects; scratch is used as by url_split. */
+size_t url_domain_match(const url_domain_matcher_t *m, const char *url,
+                        size_t url_len, url_scratch_t *scratch);
+
+/* url_domain_match of urls[i] (url_lens[i] bytes) into out[i]. Large
+ * batches run on the worker pool, see pool.h. */
+void url_domain_match_many(const url_domain_matcher_t *m,
+                           const char *const *urls, const size_t *url_lens,
+                           size_t count, size_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
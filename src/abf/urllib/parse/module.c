@@ -1,40 +1,150 @@
 #define PY_SSIZE_T_CLEAN
+#include "canon.h"
+#include "domain.h"
 #include "parse.h"
+#include "stats.h"
+#include "whatwg.h"
 #include <Python.h>
+#include <structmember.h>
 
-// Helper: convert url_component_t to Python str
+/*
+ * Module state (multi-phase init): every interpreter that imports the module
+ * gets its own types, urllib.parse references and caches, so the module
+ * supports per-interpreter GILs and runs without the GIL in free-threaded
+ * builds. Functions reach it through their module, methods through the
+ * (heap) type of self.
+ */
+struct cache_entry;
+
+typedef struct {
+    // urllib.parse result namedtuples
+    PyObject *split_result_type;
+    PyObject *split_result_bytes_type;
+    PyObject *parse_result_type;
+    PyObject *parse_result_bytes_type;
+    PyObject *uses_netloc;   // urllib.parse.uses_netloc
+    PyObject *uses_relative; // urllib.parse.uses_relative
+    PyObject *quote_via_quote[2]; // ours and urllib.parse's quote
+    PyObject *quote_via_plus[2];  // ours and urllib.parse's quote_plus
+    PyTypeObject *LazySplitResultType;
+    PyTypeObject *LazyParseResultType;
+    PyTypeObject *UrlColumnsType;
+    PyTypeObject *UrlStreamType;
+    PyTypeObject *QuoterType;
+    PyTypeObject *JoinerType;
+    PyTypeObject *DomainMatcherType;
+    PyTypeObject *WhatwgURLType;
+    PyTypeObject *CacheInfoType;
+    PyObject *ValidationError;
+    PyObject *quoter_cache;        // safe -> Quoter
+    PyObject *quoter_plus_cache;   // safe -> Quoter(plus=True)
+    PyObject *default_quoter;      // safe='/'
+    PyObject *default_plus_quoter; // safe='', plus=True
+    // urllib.parse behaviour that differs between Python versions, probed
+    // once in module_exec
+    bool qs_raw_bytes; // parse_qsl unquotes a bytes query to raw bytes
+    unsigned unsplit_flags; // url_unsplit flags matching urlunsplit
+    // Parse cache, see cache_get
+    struct cache_entry *cache_slots;
+    size_t cache_size; // power of two
+    Py_ssize_t cache_used;
+    Py_ssize_t cache_hits, cache_misses;
+#ifdef Py_GIL_DISABLED
+    PyMutex cache_lock;
+#endif
+} module_state_t;
+
+static inline module_state_t *module_state(PyObject *module) {
+    return (module_state_t *)PyModule_GetState(module);
+}
+
+// State of the module that defined type (none of its types can be
+// subclassed, so this is always one of ours)
+static inline module_state_t *type_state(PyTypeObject *type) {
+    return (module_state_t *)PyType_GetModuleState(type);
+}
+
+// 3.9 has no such flag: add_type clears the inherited tp_new instead
+#ifndef Py_TPFLAGS_DISALLOW_INSTANTIATION
+#define Py_TPFLAGS_DISALLOW_INSTANTIATION 0
+#endif
+
+// Before 3.13 the GIL serializes everything these guard
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#endif
+
+// Helper: convert url_component_t to Python str (empty ones are the shared
+// empty str singleton, as PyUnicode_New(0, 0) returns it)
 static inline PyObject *component_to_pystr(const url_component_t *comp) {
-    if (!comp) {
-        return PyUnicode_FromString("");
+    if (!comp || !comp->length) {
+        return PyUnicode_New(0, 0);
     }
     return PyUnicode_FromStringAndSize(comp->start, (Py_ssize_t)comp->length);
 }
 
+// Helper: str from bytes known to be ASCII, one memcpy and no UTF-8 decoding
+static inline PyObject *component_to_pyascii(const url_component_t *comp) {
+    if (!comp || !comp->length) {
+        return PyUnicode_New(0, 0);
+    }
+    PyObject *str = PyUnicode_New((Py_ssize_t)comp->length, 127);
+    if (str) {
+        memcpy(PyUnicode_1BYTE_DATA(str), comp->start, comp->length);
+    }
+    return str;
+}
+
 // Helper: convert url_component_t to Python bytes
 static inline PyObject *component_to_pybytes(const url_component_t *comp) {
-    if (!comp) {
-        return PyBytes_FromString("");
+    if (!comp || !comp->length) {
+        return PyBytes_FromStringAndSize(NULL, 0); // the empty singleton
     }
     return PyBytes_FromStringAndSize(comp->start, (Py_ssize_t)comp->length);
 }
 
-// Global references to urllib.parse.ParseResult and ParseResultBytes types
-static PyObject *parse_result_type = NULL;
-static PyObject *parse_result_bytes_type = NULL;
-static PyObject *split_result_type = NULL;
-static PyObject *split_result_bytes_type = NULL;
+// Helper: urllib.parse lowercases a scheme taken from the url itself (but not
+// the default scheme argument). Such a scheme passed p_is_valid_scheme, so it
+// is ASCII and lowercased while it is copied.
+static inline PyObject *scheme_to_pyobj(const url_component_t *comp,
+                                        const char *url, Py_ssize_t url_len,
+                                        int is_bytes) {
+    if (!comp->length || comp->start < url || comp->start >= url + url_len) {
+        return is_bytes ? component_to_pybytes(comp)
+                        : component_to_pystr(comp);
+    }
+    Py_ssize_t len = (Py_ssize_t)comp->length;
+    PyObject *obj = is_bytes ? PyBytes_FromStringAndSize(NULL, len)
+                             : PyUnicode_New(len, 127);
+    if (!obj) {
+        return NULL;
+    }
+    char *out = is_bytes ? PyBytes_AS_STRING(obj)
+                         : (char *)PyUnicode_1BYTE_DATA(obj);
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        char c = comp->start[i];
+        out[i] = c >= 'A' && c <= 'Z' ? (char)(c + ('a' - 'A')) : c;
+    }
+    return obj;
+}
 
 // Helper: extract char* and length from str or bytes Python object
-static inline int get_buffer_from_pyobject(PyObject *obj, char **buf,
+static inline int get_buffer_from_pyobject(PyObject *obj, const char **buf,
                                            Py_ssize_t *len, const char *what) {
     if (PyBytes_Check(obj)) {
+        URL_STAT_INC(URL_STAT_BYTES_INPUT);
         *buf = PyBytes_AS_STRING(obj);
         *len = PyBytes_GET_SIZE(obj);
         return 1; // is_bytes
     } else if (PyUnicode_Check(obj)) {
-        *buf = (char *)PyUnicode_AsUTF8AndSize(obj, len);
+        URL_STAT_INC(URL_STAT_STR_INPUT);
+        *buf = PyUnicode_AsUTF8AndSize(obj, len);
         if (!*buf)
             return -1;
+        if (!PyUnicode_IS_ASCII(obj)) {
+            URL_STAT_INC(URL_STAT_STR_NON_ASCII);
+        }
         return 0; // is_str
     } else {
         PyErr_Format(PyExc_TypeError, "%s must be str or bytes", what);
@@ -42,223 +152,5289 @@ static inline int get_buffer_from_pyobject(PyObject *obj, char **buf,
     }
 }
 
-// abf_url_parse(url: str, scheme: str = '', allow_fragments: bool = True) ->
-// ParseResult
-static PyObject *abf_url_parse(PyObject *self, PyObject *args,
-                               PyObject *kwargs) {
-    PyObject *url_obj = NULL, *scheme_obj = NULL;
-    char *url = NULL, *scheme = NULL;
-    Py_ssize_t url_len = 0, scheme_len = 0;
-    bool allow_fragments = true;
-    static char *kwlist[] = {"url", "scheme", "allow_fragments", NULL};
+// Helper: a url argument, str, bytes or any other contiguous buffer
+// (bytearray, memoryview, mmap, ...). Buffers are read where they are:
+// *view holds the export, which keeps them from being resized, until
+// PyBuffer_Release(view); view->obj stays NULL for str and bytes.
+static inline int get_url_buffer(PyObject *obj, Py_buffer *view,
+                                 const char **buf, Py_ssize_t *len,
+                                 const char *what) {
+    view->obj = NULL;
+    if (PyBytes_Check(obj) || PyUnicode_Check(obj)) {
+        return get_buffer_from_pyobject(obj, buf, len, what);
+    }
+    if (!PyObject_CheckBuffer(obj)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s must be str or a bytes-like object", what);
+        return -1;
+    }
+    if (PyObject_GetBuffer(obj, view, PyBUF_SIMPLE) < 0) {
+        return -1;
+    }
+    URL_STAT_INC(URL_STAT_BYTES_INPUT);
+    *buf = view->buf;
+    *len = view->len;
+    return 1; // is_bytes
+}
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Op", kwlist, &url_obj,
-                                     &scheme_obj, &allow_fragments)) {
-        return NULL;
+// Helper: an ASCII str (its UTF-8 data is its characters)
+static inline bool is_ascii_str(PyObject *obj) {
+    return PyUnicode_Check(obj) && PyUnicode_IS_ASCII(obj);
+}
+
+static bool bytes_are_ascii(const char *buf, Py_ssize_t len) {
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        if ((unsigned char)buf[i] >= 0x80) {
+            return false;
+        }
     }
+    return true;
+}
 
-    int is_bytes = get_buffer_from_pyobject(url_obj, &url, &url_len, "url");
-    if (is_bytes < 0) {
+// Helper: call urllib.parse.<name>(*args, **kwargs), for the rare inputs
+// the native code leaves to the stdlib
+static PyObject *stdlib_call(const char *name, PyObject *args,
+                             PyObject *kwargs) {
+    URL_STAT_INC(URL_STAT_STDLIB_FALLBACK);
+    PyObject *urllib_parse = PyImport_ImportModule("urllib.parse");
+    if (!urllib_parse) {
+        return NULL;
+    }
+    PyObject *func = PyObject_GetAttrString(urllib_parse, name);
+    Py_DECREF(urllib_parse);
+    if (!func) {
         return NULL;
     }
+    PyObject *res = PyObject_Call(func, args, kwargs);
+    Py_DECREF(func);
+    return res;
+}
 
-    if (scheme_obj && scheme_obj != Py_None) {
-        int scheme_is_bytes = get_buffer_from_pyobject(scheme_obj, &scheme,
-                                                       &scheme_len, "scheme");
-        if (scheme_is_bytes < 0) {
-            return NULL;
-        }
+// Helper: ValueError for a failed parse; netloc errors read as urllib.parse's
+static void set_parse_error(url_parse_error_t err, const char *where) {
+    if (err == URL_PARSE_ERROR_OUT_OF_MEMORY) {
+        PyErr_NoMemory();
+    } else if (err == URL_PARSE_ERROR_INVALID_IPV6 ||
+               err == URL_PARSE_ERROR_INVALID_NETLOC) {
+        PyErr_SetString(PyExc_ValueError, url_parse_strerror(err));
     } else {
-        scheme = NULL;
-        scheme_len = 0;
+        PyErr_Format(PyExc_ValueError, "%s: parse error", where);
     }
+}
 
-    // Parse the URL
-    // clang-format off
-    url_parse_result_t result;
-    int err;
-    
-    Py_BEGIN_ALLOW_THREADS 
-    err = url_parse(url, (size_t)url_len, scheme,
-                  allow_fragments, &result);
-    Py_END_ALLOW_THREADS
+// Helper: urllib.parse also rejects a non-ASCII netloc whose NFKC form holds
+// a delimiter; that rare check is left to the stdlib
+static int check_netloc(const url_component_t *netloc, int is_bytes) {
+    if (is_bytes ||
+        bytes_are_ascii(netloc->start, (Py_ssize_t)netloc->length)) {
+        return 0;
+    }
+    PyObject *args = Py_BuildValue("(N)", component_to_pystr(netloc));
+    if (!args) {
+        return -1;
+    }
+    PyObject *res = stdlib_call("_checknetloc", args, NULL);
+    Py_DECREF(args);
+    Py_XDECREF(res);
+    return res ? 0 : -1;
+}
 
-    if (err != URL_PARSE_OK) {
-        PyErr_SetString(PyExc_ValueError, "abf_url_parse: parse error");
-        return NULL;
+// Helper: optional scheme argument, NULL when missing or None
+static inline int get_scheme_from_pyobject(PyObject *scheme_obj,
+                                           const char **scheme) {
+    Py_ssize_t scheme_len = 0;
+    *scheme = NULL;
+    if (!scheme_obj || scheme_obj == Py_None) {
+        return 0;
     }
-    // clang-format on
+    return get_buffer_from_pyobject(scheme_obj, scheme, &scheme_len, "scheme") <
+                   0
+               ? -1
+               : 0;
+}
+
+/*
+ * METH_FASTCALL | METH_KEYWORDS argument parsing for the per-call entry
+ * points: no argument tuple or keyword dict is built. Specs are constant,
+ * so they are shared by interpreters and threads; keyword names are
+ * matched by a length check and a memcmp of their ASCII data.
+ */
+enum { FAST_ARGS_MAX = 5 };
+
+typedef struct {
+    const char *fname;
+    const char *names[FAST_ARGS_MAX + 1]; // NULL-terminated
+    Py_ssize_t required;                  // leading arguments that must be set
+    Py_ssize_t max_positional;            // the rest are keyword-only
+} fast_args_t;
+
+static inline bool fast_arg_name_is(PyObject *key, const char *name) {
+    if (PyUnicode_IS_COMPACT_ASCII(key)) {
+        size_t len = strlen(name);
+        return (size_t)PyUnicode_GET_LENGTH(key) == len &&
+               memcmp(PyUnicode_DATA(key), name, len) == 0;
+    }
+    return PyUnicode_CompareWithASCIIString(key, name) == 0;
+}
+
+// out[i] gets argument i (borrowed), NULL when it was not passed
+static int fast_args_parse(const fast_args_t *spec, PyObject *const *args,
+                           Py_ssize_t nargs, PyObject *kwnames,
+                           PyObject **out) {
+    Py_ssize_t n = 0;
+    while (spec->names[n]) {
+        n++;
+    }
+    if (nargs > spec->max_positional) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() takes at most %zd positional arguments (%zd "
+                     "given)",
+                     spec->fname, spec->max_positional, nargs);
+        return -1;
+    }
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        out[i] = i < nargs ? args[i] : NULL;
+    }
+    Py_ssize_t nkw = kwnames ? PyTuple_GET_SIZE(kwnames) : 0;
+    for (Py_ssize_t k = 0; k < nkw; ++k) {
+        PyObject *key = PyTuple_GET_ITEM(kwnames, k);
+        Py_ssize_t i = 0;
+        while (i < n && !fast_arg_name_is(key, spec->names[i])) {
+            i++;
+        }
+        if (i == n) {
+            PyErr_Format(PyExc_TypeError,
+                         "%s() got an unexpected keyword argument '%U'",
+                         spec->fname, key);
+            return -1;
+        }
+        if (out[i]) {
+            PyErr_Format(PyExc_TypeError,
+                         "argument for %s() given by name ('%s') and "
+                         "position (%zd)",
+                         spec->fname, spec->names[i], i + 1);
+            return -1;
+        }
+        out[i] = args[nargs + k];
+    }
+    for (Py_ssize_t i = 0; i < spec->required; ++i) {
+        if (!out[i]) {
+            PyErr_Format(PyExc_TypeError,
+                         "%s() missing required argument '%s' (pos %zd)",
+                         spec->fname, spec->names[i], i + 1);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Helper: truth of an optional flag argument, dflt when missing
+static inline int fast_arg_flag(PyObject *obj, int dflt) {
+    return obj ? PyObject_IsTrue(obj) : dflt;
+}
 
-    PyObject *args_tuple = PyTuple_New(6);
-    if (!args_tuple) {
+// Helper: build a urllib.parse result from its components, scheme first.
+// ascii: the url was an ASCII str, so its components are copied, not decoded.
+// The result types are namedtuples, whose __new__ is tuple.__new__(cls,
+// items): the tuple subclass is allocated and filled directly.
+static PyObject *components_to_result(PyObject *result_type,
+                                      const url_component_t *const *comps,
+                                      Py_ssize_t n, const char *url,
+                                      Py_ssize_t url_len, int is_bytes,
+                                      bool ascii) {
+    PyTypeObject *type = (PyTypeObject *)result_type;
+    PyObject *res = type->tp_alloc(type, n);
+    if (!res) {
         return NULL;
     }
 
     PyObject *(*component_to_pyobj)(const url_component_t *);
     if (is_bytes) {
         component_to_pyobj = component_to_pybytes;
+    } else if (ascii) {
+        component_to_pyobj = component_to_pyascii;
     } else {
         component_to_pyobj = component_to_pystr;
     }
-    PyTuple_SET_ITEM(args_tuple, 0, component_to_pyobj(&result.scheme));
-    PyTuple_SET_ITEM(args_tuple, 1, component_to_pyobj(&result.netloc));
-    PyTuple_SET_ITEM(args_tuple, 2, component_to_pyobj(&result.path));
-    PyTuple_SET_ITEM(args_tuple, 3, component_to_pyobj(&result.params));
-    PyTuple_SET_ITEM(args_tuple, 4, component_to_pyobj(&result.query));
-    PyTuple_SET_ITEM(args_tuple, 5, component_to_pyobj(&result.fragment));
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        PyObject *item = i == 0 ? scheme_to_pyobj(comps[0], url, url_len,
+                                                  is_bytes)
+                                : component_to_pyobj(comps[i]);
+        if (!item) {
+            Py_DECREF(res);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(res, i, item);
+    }
+    return res;
+}
+
+static PyObject *split_result_to_pyobj(module_state_t *st,
+                                       const url_split_result_t *result,
+                                       int is_bytes, bool ascii) {
+    const url_component_t *comps[] = {&result->scheme, &result->netloc,
+                                      &result->path, &result->query,
+                                      &result->fragment};
+    return components_to_result(
+        is_bytes ? st->split_result_bytes_type : st->split_result_type, comps,
+        5,
+        result->source.start, (Py_ssize_t)result->source.length, is_bytes,
+        ascii);
+}
+
+static PyObject *parse_result_to_pyobj(module_state_t *st,
+                                       const url_parse_result_t *result,
+                                       int is_bytes, bool ascii) {
+    const url_component_t *comps[] = {&result->scheme, &result->netloc,
+                                      &result->path,   &result->params,
+                                      &result->query,  &result->fragment};
+    return components_to_result(
+        is_bytes ? st->parse_result_bytes_type : st->parse_result_type, comps,
+        6,
+        result->source.start, (Py_ssize_t)result->source.length, is_bytes,
+        ascii);
+}
+
+/*
+ * Lazy results: keep a reference to the parsed object plus the component
+ * spans and build each component only on first access. The netloc
+ * properties (username, password, hostname, port) are read from the spans
+ * url_split found; anything else a urllib.parse result offers (_replace,
+ * geturl, ...) is served by the equivalent namedtuple, built on demand.
+ *
+ * With views=True (bytes-like urls only) components are memoryview slices
+ * of the source instead of bytes copies. The scheme and hostname, which
+ * urllib.parse lowercases, stay bytes. Unpacking, hashing, pickling and the
+ * namedtuple methods see bytes copies, as urllib.parse code expects.
+ */
+enum { LAZY_MAX_FIELDS = 6 };
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *source;  // str, bytes or buffer the spans point into
+    const char *base;  // its UTF-8 or bytes data
+    Py_ssize_t base_len;
+    Py_buffer view; // export of a buffer source (view.obj NULL otherwise)
+    PyObject *mview; // views: byte memoryview of source, made on first use
+    bool views;
+    int is_bytes;
+    Py_ssize_t nfields; // 5 for split results, 6 for parse results
+    url_component_t comps[LAZY_MAX_FIELDS];
+    PyObject *items[LAZY_MAX_FIELDS]; // NULL until first access
+    url_netloc_t netloc_parts;        // username, password, hostname, port
+} LazyResultObject;
+
+// Point a span into [from, from + len) at the same offset in to instead
+static inline void move_component(url_component_t *comp, const char *from,
+                                  size_t len, const char *to) {
+    if (comp->start && comp->start >= from && comp->start <= from + len) {
+        comp->start = to + (comp->start - from);
+    }
+}
 
-    if (!args_tuple) {
+// parsed is the result's source span: base itself, or the cleaned copy of a
+// url with tabs or newlines, which then becomes the lazy result's source
+static PyObject *lazy_result_new(PyTypeObject *type, PyObject *source,
+                                 const char *base, Py_ssize_t base_len,
+                                 int is_bytes, bool views,
+                                 const url_component_t *parsed,
+                                 const url_component_t *const *comps,
+                                 Py_ssize_t nfields,
+                                 const url_netloc_t *netloc_parts) {
+    LazyResultObject *self = (LazyResultObject *)type->tp_alloc(type, 0);
+    if (!self) {
         return NULL;
     }
+    self->is_bytes = is_bytes;
+    self->views = views;
+    self->nfields = nfields;
+    for (Py_ssize_t i = 0; i < nfields; ++i) {
+        self->comps[i] = *comps[i];
+    }
+    self->netloc_parts = *netloc_parts;
+    if (parsed->start < base || parsed->start > base + base_len) {
+        Py_ssize_t len = (Py_ssize_t)parsed->length;
+        source = is_bytes ? PyBytes_FromStringAndSize(parsed->start, len)
+                          : PyUnicode_DecodeUTF8(parsed->start, len, NULL);
+        const char *copy = !source ? NULL
+                           : is_bytes ? PyBytes_AS_STRING(source)
+                                      : PyUnicode_AsUTF8(source);
+        if (!copy) {
+            Py_XDECREF(source);
+            Py_DECREF(self);
+            return NULL;
+        }
+        url_component_t *moved[] = {
+            &self->netloc_parts.username, &self->netloc_parts.password,
+            &self->netloc_parts.hostname, &self->netloc_parts.port};
+        for (Py_ssize_t i = 0; i < nfields; ++i) {
+            move_component(&self->comps[i], parsed->start, parsed->length,
+                           copy);
+        }
+        for (size_t i = 0; i < sizeof(moved) / sizeof(*moved); ++i) {
+            move_component(moved[i], parsed->start, parsed->length, copy);
+        }
+        base = copy;
+        base_len = len;
+    } else {
+        // A buffer's own export keeps the spans valid while self lives
+        if (!PyBytes_Check(source) && !PyUnicode_Check(source) &&
+            PyObject_GetBuffer(source, &self->view, PyBUF_SIMPLE) < 0) {
+            Py_DECREF(self);
+            return NULL;
+        }
+        Py_INCREF(source);
+    }
+    self->source = source;
+    self->base = base;
+    self->base_len = base_len;
+    // A default scheme argument does not live in source: build it now
+    const url_component_t *scheme = &self->comps[0];
+    if (scheme->start &&
+        (scheme->start < base || scheme->start > base + base_len)) {
+        self->items[0] = scheme_to_pyobj(scheme, base, base_len, is_bytes);
+        if (!self->items[0]) {
+            Py_DECREF(self);
+            return NULL;
+        }
+    }
+    return (PyObject *)self;
+}
 
-    // Call ParseResult or ParseResultBytes constructor
-    PyObject *result_type = parse_result_type;
-    if (is_bytes) {
-        result_type = parse_result_bytes_type;
+static PyObject *lazy_split_result(module_state_t *st,
+                                   const url_split_result_t *result,
+                                   PyObject *source, const char *url,
+                                   Py_ssize_t url_len, int is_bytes,
+                                   bool views) {
+    const url_component_t *comps[] = {&result->scheme, &result->netloc,
+                                      &result->path, &result->query,
+                                      &result->fragment};
+    return lazy_result_new(st->LazySplitResultType, source, url, url_len,
+                           is_bytes, views, &result->source, comps, 5,
+                           &result->netloc_parts);
+}
+
+static PyObject *lazy_parse_result(module_state_t *st,
+                                   const url_parse_result_t *result,
+                                   PyObject *source, const char *url,
+                                   Py_ssize_t url_len, int is_bytes,
+                                   bool views) {
+    const url_component_t *comps[] = {&result->scheme, &result->netloc,
+                                      &result->path,   &result->params,
+                                      &result->query,  &result->fragment};
+    return lazy_result_new(st->LazyParseResultType, source, url, url_len,
+                           is_bytes, views, &result->source, comps, 6,
+                           &result->netloc_parts);
+}
+
+// Helper: a memoryview slice of the source for a span into it
+static PyObject *lazy_result_view(LazyResultObject *self,
+                                  const url_component_t *comp) {
+    if (!self->mview) {
+        PyObject *mview = PyMemoryView_FromObject(self->source);
+        if (mview && (PyMemoryView_GET_BUFFER(mview)->ndim != 1 ||
+                      PyMemoryView_GET_BUFFER(mview)->itemsize != 1)) {
+            // Slices must count bytes
+            Py_SETREF(mview, PyObject_CallMethod(mview, "cast", "s", "B"));
+        }
+        if (!mview) {
+            return NULL;
+        }
+        self->mview = mview;
+    }
+    Py_ssize_t start = comp->start ? comp->start - self->base : 0;
+    return PySequence_GetSlice(self->mview, start,
+                               start + (Py_ssize_t)comp->length);
+}
+
+static PyObject *lazy_result_item_locked(LazyResultObject *self,
+                                         Py_ssize_t i) {
+    if (!self->items[i]) {
+        const url_component_t *comp = &self->comps[i];
+        PyObject *item;
+        if (i == 0) {
+            item = scheme_to_pyobj(comp, self->base, self->base_len,
+                                   self->is_bytes);
+        } else if (self->views) {
+            item = lazy_result_view(self, comp);
+        } else if (self->is_bytes) {
+            item = component_to_pybytes(comp);
+        } else if (PyUnicode_IS_ASCII(self->source)) {
+            // Offsets into the UTF-8 data are code point offsets
+            Py_ssize_t start = comp->start ? comp->start - self->base : 0;
+            item = PyUnicode_Substring(self->source, start,
+                                       start + (Py_ssize_t)comp->length);
+        } else {
+            item = component_to_pystr(comp);
+        }
+        if (!item) {
+            return NULL;
+        }
+        self->items[i] = item;
+    }
+    Py_INCREF(self->items[i]);
+    return self->items[i];
+}
+
+// New reference to component i, built and cached on first access (by one
+// thread only in free-threaded builds)
+static PyObject *lazy_result_item(LazyResultObject *self, Py_ssize_t i) {
+    PyObject *item;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    item = lazy_result_item_locked(self, i);
+    Py_END_CRITICAL_SECTION();
+    return item;
+}
+
+// The components as a tuple; copy: views become bytes, for whatever needs a
+// urllib.parse-like result (unpacking, hashing, pickling, namedtuple methods)
+static PyObject *lazy_result_astuple(LazyResultObject *self, bool copy) {
+    PyObject *tuple = PyTuple_New(self->nfields);
+    if (!tuple) {
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < self->nfields; ++i) {
+        PyObject *item = copy && self->views && i
+                             ? component_to_pybytes(&self->comps[i])
+                             : lazy_result_item(self, i);
+        if (!item) {
+            Py_DECREF(tuple);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(tuple, i, item);
+    }
+    return tuple;
+}
+
+// The urllib.parse namedtuple with the same contents
+static PyObject *lazy_result_asnamedtuple(LazyResultObject *self, bool copy) {
+    module_state_t *st = type_state(Py_TYPE(self));
+    PyObject *result_type;
+    if (self->nfields == 5) {
+        result_type = self->is_bytes ? st->split_result_bytes_type
+                                     : st->split_result_type;
+    } else {
+        result_type = self->is_bytes ? st->parse_result_bytes_type
+                                     : st->parse_result_type;
+    }
+    PyObject *tuple = lazy_result_astuple(self, copy);
+    if (!tuple) {
+        return NULL;
     }
-    PyObject *res = PyObject_CallObject(result_type, args_tuple);
-    Py_DECREF(args_tuple);
+    PyObject *res = PyObject_CallObject(result_type, tuple);
+    Py_DECREF(tuple);
     return res;
 }
 
-// abf_urlsplit(url: str, scheme: str = '', allow_fragments: bool = True) ->
-// ParseResult
-static PyObject *abf_urlsplit(PyObject *self, PyObject *args,
-                              PyObject *kwargs) {
-    PyObject *url_obj = NULL, *scheme_obj = NULL;
-    char *url = NULL, *scheme = NULL;
-    Py_ssize_t url_len = 0, scheme_len = 0;
-    bool allow_fragments = true;
-    static char *kwlist[] = {"url", "scheme", "allow_fragments", NULL};
+static void lazy_result_dealloc(PyObject *op) {
+    LazyResultObject *self = (LazyResultObject *)op;
+    PyTypeObject *type = Py_TYPE(op);
+    for (Py_ssize_t i = 0; i < LAZY_MAX_FIELDS; ++i) {
+        Py_XDECREF(self->items[i]);
+    }
+    Py_XDECREF(self->mview);
+    PyBuffer_Release(&self->view);
+    Py_XDECREF(self->source);
+    type->tp_free(op);
+    Py_DECREF(type);
+}
+
+static Py_ssize_t lazy_result_length(PyObject *op) {
+    return ((LazyResultObject *)op)->nfields;
+}
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Op", kwlist, &url_obj,
-                                     &scheme_obj, &allow_fragments)) {
+static PyObject *lazy_result_sq_item(PyObject *op, Py_ssize_t i) {
+    LazyResultObject *self = (LazyResultObject *)op;
+    if (i < 0 || i >= self->nfields) {
+        PyErr_SetString(PyExc_IndexError, "tuple index out of range");
         return NULL;
     }
+    return lazy_result_item(self, i);
+}
 
-    int is_bytes = get_buffer_from_pyobject(url_obj, &url, &url_len, "url");
-    if (is_bytes < 0) {
+static PyObject *lazy_result_subscript(PyObject *op, PyObject *key) {
+    LazyResultObject *self = (LazyResultObject *)op;
+    if (PyIndex_Check(key)) {
+        Py_ssize_t i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+        if (i == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (i < 0) {
+            i += self->nfields;
+        }
+        return lazy_result_sq_item(op, i);
+    }
+    PyObject *tuple = lazy_result_astuple(self, false);
+    if (!tuple) {
+        return NULL;
+    }
+    PyObject *res = PyObject_GetItem(tuple, key);
+    Py_DECREF(tuple);
+    return res;
+}
+
+static PyObject *lazy_result_iter(PyObject *op) {
+    PyObject *tuple = lazy_result_astuple((LazyResultObject *)op, true);
+    if (!tuple) {
         return NULL;
     }
+    PyObject *it = PyObject_GetIter(tuple);
+    Py_DECREF(tuple);
+    return it;
+}
 
-    if (scheme_obj && scheme_obj != Py_None) {
-        int scheme_is_bytes = get_buffer_from_pyobject(scheme_obj, &scheme,
-                                                       &scheme_len, "scheme");
-        if (scheme_is_bytes < 0) {
+// Compares like the namedtuple would: as a plain tuple
+static PyObject *lazy_result_richcompare(PyObject *op, PyObject *other,
+                                         int cmp) {
+    module_state_t *st = type_state(Py_TYPE(op));
+    PyObject *other_tuple;
+    if (PyTuple_Check(other)) {
+        Py_INCREF(other);
+        other_tuple = other;
+    } else if (Py_TYPE(other) == st->LazySplitResultType ||
+               Py_TYPE(other) == st->LazyParseResultType) {
+        other_tuple = lazy_result_astuple((LazyResultObject *)other, true);
+        if (!other_tuple) {
             return NULL;
         }
     } else {
-        scheme = NULL;
-        scheme_len = 0;
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+    PyObject *tuple = lazy_result_astuple((LazyResultObject *)op, true);
+    if (!tuple) {
+        Py_DECREF(other_tuple);
+        return NULL;
+    }
+    PyObject *res = PyObject_RichCompare(tuple, other_tuple, cmp);
+    Py_DECREF(tuple);
+    Py_DECREF(other_tuple);
+    return res;
+}
+
+static Py_hash_t lazy_result_hash(PyObject *op) {
+    PyObject *tuple = lazy_result_astuple((LazyResultObject *)op, true);
+    if (!tuple) {
+        return -1;
     }
+    Py_hash_t hash = PyObject_Hash(tuple);
+    Py_DECREF(tuple);
+    return hash;
+}
 
-    url_split_result_t result;
-    int err;
-    Py_BEGIN_ALLOW_THREADS err =
-        url_split(url, (size_t)url_len, scheme, allow_fragments, &result);
-    Py_END_ALLOW_THREADS if (err != URL_PARSE_OK) {
-        PyErr_SetString(PyExc_ValueError, "abf_urlsplit: parse error");
+static PyObject *lazy_result_repr(PyObject *op) {
+    PyObject *nt = lazy_result_asnamedtuple((LazyResultObject *)op, false);
+    if (!nt) {
         return NULL;
     }
+    PyObject *res = PyObject_Repr(nt);
+    Py_DECREF(nt);
+    return res;
+}
 
-    PyObject *args_tuple = PyTuple_New(5);
-    if (!args_tuple) {
+// Attributes the lazy type does not implement come from the namedtuple
+static PyObject *lazy_result_getattro(PyObject *op, PyObject *name) {
+    PyObject *res = PyObject_GenericGetAttr(op, name);
+    if (res || !PyErr_ExceptionMatches(PyExc_AttributeError)) {
+        return res;
+    }
+    PyErr_Clear();
+    PyObject *nt = lazy_result_asnamedtuple((LazyResultObject *)op, true);
+    if (!nt) {
         return NULL;
     }
+    res = PyObject_GetAttr(nt, name);
+    Py_DECREF(nt);
+    return res;
+}
 
-    PyObject *(*component_to_pyobj)(const url_component_t *);
-    if (is_bytes) {
-        component_to_pyobj = component_to_pybytes;
-    } else {
-        component_to_pyobj = component_to_pystr;
+static PyObject *lazy_result_get_field(PyObject *op, void *closure) {
+    return lazy_result_item((LazyResultObject *)op, (Py_ssize_t)closure);
+}
+
+// Helper: a netloc sub-component, None when missing; view: a memoryview
+// slice in views mode
+static PyObject *lazy_result_subcomponent(LazyResultObject *self,
+                                          const url_component_t *comp,
+                                          bool view) {
+    if (!comp->start) {
+        Py_RETURN_NONE;
+    }
+    if (view && self->views) {
+        return lazy_result_view(self, comp);
     }
-    PyTuple_SET_ITEM(args_tuple, 0, component_to_pyobj(&result.scheme));
-    PyTuple_SET_ITEM(args_tuple, 1, component_to_pyobj(&result.netloc));
-    PyTuple_SET_ITEM(args_tuple, 2, component_to_pyobj(&result.path));
-    PyTuple_SET_ITEM(args_tuple, 3, component_to_pyobj(&result.query));
-    PyTuple_SET_ITEM(args_tuple, 4, component_to_pyobj(&result.fragment));
+    return self->is_bytes ? component_to_pybytes(comp)
+                          : component_to_pystr(comp);
+}
 
-    PyObject *result_type = split_result_type;
-    if (is_bytes) {
-        result_type = split_result_bytes_type;
+static PyObject *lazy_result_get_username(PyObject *op, void *closure) {
+    (void)closure;
+    LazyResultObject *self = (LazyResultObject *)op;
+    PyObject *res;
+    Py_BEGIN_CRITICAL_SECTION(op);
+    res = lazy_result_subcomponent(self, &self->netloc_parts.username, true);
+    Py_END_CRITICAL_SECTION();
+    return res;
+}
+
+static PyObject *lazy_result_get_password(PyObject *op, void *closure) {
+    (void)closure;
+    LazyResultObject *self = (LazyResultObject *)op;
+    PyObject *res;
+    Py_BEGIN_CRITICAL_SECTION(op);
+    res = lazy_result_subcomponent(self, &self->netloc_parts.password, true);
+    Py_END_CRITICAL_SECTION();
+    return res;
+}
+
+// Lowercased up to the zone of a scoped IPv6 address, None when empty
+static PyObject *lazy_result_get_hostname(PyObject *op, void *closure) {
+    (void)closure;
+    LazyResultObject *self = (LazyResultObject *)op;
+    const url_component_t *host = &self->netloc_parts.hostname;
+    if (!host->length) {
+        Py_RETURN_NONE;
+    }
+    const char *zone = memchr(host->start, '%', host->length);
+    size_t fold = zone ? (size_t)(zone - host->start) : host->length;
+    if (!self->is_bytes && !bytes_are_ascii(host->start, (Py_ssize_t)fold)) {
+        // Full Unicode case mapping, as str.lower does
+        PyObject *head = PyUnicode_DecodeUTF8(host->start, (Py_ssize_t)fold,
+                                              NULL);
+        PyObject *lower = head ? PyObject_CallMethod(head, "lower", NULL)
+                               : NULL;
+        Py_XDECREF(head);
+        if (!lower || !zone) {
+            return lower;
+        }
+        PyObject *tail = PyUnicode_DecodeUTF8(
+            zone, (Py_ssize_t)(host->length - fold), NULL);
+        PyObject *res = tail ? PyUnicode_Concat(lower, tail) : NULL;
+        Py_DECREF(lower);
+        Py_XDECREF(tail);
+        return res;
+    }
+    if (!self->netloc_parts.host_upper) {
+        return lazy_result_subcomponent(self, host, false);
+    }
+    char *buf = PyMem_Malloc(host->length);
+    if (!buf) {
+        return PyErr_NoMemory();
     }
-    PyObject *res = PyObject_CallObject(result_type, args_tuple);
-    Py_DECREF(args_tuple);
+    memcpy(buf, host->start, host->length);
+    for (size_t i = 0; i < fold; ++i) {
+        if (buf[i] >= 'A' && buf[i] <= 'Z') {
+            buf[i] = (char)(buf[i] | 0x20);
+        }
+    }
+    url_component_t lowered = {buf, host->length};
+    PyObject *res = lazy_result_subcomponent(self, &lowered, false);
+    PyMem_Free(buf);
     return res;
 }
 
-// abf_url_quote(s: str, safe: str = '/') -> str
-static PyObject *abf_url_quote(PyObject *self, PyObject *args,
-                               PyObject *kwargs) {
-    // Parse arguments
-    char *s = NULL;
-    const char *safe = "/";
-    Py_ssize_t s_len = 0, safe_len = 1;
-    static char *kwlist[] = {"s", "safe", NULL};
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s#|s#", kwlist, &s, &s_len,
-                                     &safe, &safe_len))
+// ASCII digits in 0-65535, None when missing; ValueError otherwise
+static PyObject *lazy_result_get_port(PyObject *op, void *closure) {
+    (void)closure;
+    LazyResultObject *self = (LazyResultObject *)op;
+    const url_component_t *port = &self->netloc_parts.port;
+    if (!port->start) {
+        Py_RETURN_NONE;
+    }
+    long value = 0;
+    for (size_t i = 0; i < port->length; ++i) {
+        char c = port->start[i];
+        if (c < '0' || c > '9') {
+            PyObject *text = lazy_result_subcomponent(self, port, false);
+            if (text) {
+                PyErr_Format(PyExc_ValueError,
+                             "Port could not be cast to integer value as %R",
+                             text);
+                Py_DECREF(text);
+            }
+            return NULL;
+        }
+        if (value <= 65535) {
+            value = value * 10 + (c - '0');
+        }
+    }
+    if (value > 65535) {
+        PyErr_SetString(PyExc_ValueError, "Port out of range 0-65535");
         return NULL;
+    }
+    return PyLong_FromLong(value);
+}
 
-    // clang-format off
-    int err;
-    size_t bufsize = s_len * 3 + 1;
-    char buf[bufsize];
-    memcpy(buf, s, s_len);
-    
-    Py_BEGIN_ALLOW_THREADS
-    err = url_quote(buf, s_len, safe, (size_t)safe_len);
-    Py_END_ALLOW_THREADS
-
-    if (err != URL_PARSE_OK) {
-        PyErr_SetString(PyExc_ValueError, "abf_url_quote: quote error");
+// Pickles (and copies) as the urllib.parse namedtuple
+static PyObject *lazy_result_reduce(PyObject *op, PyObject *unused) {
+    (void)unused;
+    PyObject *nt = lazy_result_asnamedtuple((LazyResultObject *)op, true);
+    if (!nt) {
         return NULL;
     }
-    // clang-format on
-    PyObject *pyres = PyUnicode_FromString(buf);
-    return pyres;
+    PyObject *tuple = lazy_result_astuple((LazyResultObject *)op, true);
+    if (!tuple) {
+        Py_DECREF(nt);
+        return NULL;
+    }
+    PyObject *res = Py_BuildValue("(ON)", (PyObject *)Py_TYPE(nt), tuple);
+    Py_DECREF(nt);
+    return res;
 }
 
-static PyMethodDef AbfParseMethods[] = {
-    {"urlparse", (PyCFunction)abf_url_parse, METH_VARARGS | METH_KEYWORDS, ""},
-    {"urlsplit", (PyCFunction)abf_urlsplit, METH_VARARGS | METH_KEYWORDS, ""},
-    {"quote", (PyCFunction)abf_url_quote, METH_VARARGS | METH_KEYWORDS, ""},
+// Defined with urlunsplit / urlunparse below
+static PyObject *unsplit_components(module_state_t *st, PyObject *components,
+                                    Py_ssize_t nfields,
+                                    const char *stdlib_name);
+
+// Recombined from the spans, as urlunsplit(self) / urlunparse(self) does
+static PyObject *lazy_result_geturl(PyObject *op, PyObject *unused) {
+    (void)unused;
+    Py_ssize_t nfields = ((LazyResultObject *)op)->nfields;
+    return unsplit_components(type_state(Py_TYPE(op)), op, nfields,
+                              nfields == 5 ? "urlunsplit" : "urlunparse");
+}
+
+static PyObject *lazy_result_to_namedtuple(PyObject *op, PyObject *unused) {
+    (void)unused;
+    return lazy_result_asnamedtuple((LazyResultObject *)op, true);
+}
+
+static PyMethodDef lazy_result_methods[] = {
+    {"__reduce__", lazy_result_reduce, METH_NOARGS, NULL},
+    {"geturl", lazy_result_geturl, METH_NOARGS, NULL},
+    {"_asnamedtuple", lazy_result_to_namedtuple, METH_NOARGS,
+     "The equivalent urllib.parse result"},
     {NULL, NULL, 0, NULL}};
 
-static struct PyModuleDef module = {PyModuleDef_HEAD_INIT, "parse",
-                                    "A Bit Faster urllib.parse (C version)", -1,
-                                    AbfParseMethods};
+// clang-format off
+static PyGetSetDef lazy_split_result_getset[] = {
+    {"scheme", lazy_result_get_field, NULL, NULL, (void *)0},
+    {"netloc", lazy_result_get_field, NULL, NULL, (void *)1},
+    {"path", lazy_result_get_field, NULL, NULL, (void *)2},
+    {"query", lazy_result_get_field, NULL, NULL, (void *)3},
+    {"fragment", lazy_result_get_field, NULL, NULL, (void *)4},
+    {"username", lazy_result_get_username, NULL, NULL, NULL},
+    {"password", lazy_result_get_password, NULL, NULL, NULL},
+    {"hostname", lazy_result_get_hostname, NULL, NULL, NULL},
+    {"port", lazy_result_get_port, NULL, NULL, NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
 
-PyMODINIT_FUNC PyInit_parse(void) {
-    PyObject *m = PyModule_Create(&module);
+static PyGetSetDef lazy_parse_result_getset[] = {
+    {"scheme", lazy_result_get_field, NULL, NULL, (void *)0},
+    {"netloc", lazy_result_get_field, NULL, NULL, (void *)1},
+    {"path", lazy_result_get_field, NULL, NULL, (void *)2},
+    {"params", lazy_result_get_field, NULL, NULL, (void *)3},
+    {"query", lazy_result_get_field, NULL, NULL, (void *)4},
+    {"fragment", lazy_result_get_field, NULL, NULL, (void *)5},
+    {"username", lazy_result_get_username, NULL, NULL, NULL},
+    {"password", lazy_result_get_password, NULL, NULL, NULL},
+    {"hostname", lazy_result_get_hostname, NULL, NULL, NULL},
+    {"port", lazy_result_get_port, NULL, NULL, NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
+// clang-format on
 
-    if (!m) {
-        return NULL;
+// Not instantiable from Python: made by urlsplit / urlparse only
+#define LAZY_RESULT_SLOTS                                                      \
+    {Py_tp_dealloc, lazy_result_dealloc}, {Py_tp_repr, lazy_result_repr},      \
+        {Py_sq_length, lazy_result_length},                                    \
+        {Py_sq_item, lazy_result_sq_item},                                     \
+        {Py_mp_length, lazy_result_length},                                    \
+        {Py_mp_subscript, lazy_result_subscript},                              \
+        {Py_tp_hash, lazy_result_hash},                                        \
+        {Py_tp_getattro, lazy_result_getattro},                                \
+        {Py_tp_richcompare, lazy_result_richcompare},                          \
+        {Py_tp_iter, lazy_result_iter}, {Py_tp_methods, lazy_result_methods}
+
+static PyType_Slot lazy_split_result_slots[] = {
+    LAZY_RESULT_SLOTS,
+    {Py_tp_doc, "SplitResult that builds its components on first access"},
+    {Py_tp_getset, lazy_split_result_getset},
+    {0, NULL}};
+
+static PyType_Slot lazy_parse_result_slots[] = {
+    LAZY_RESULT_SLOTS,
+    {Py_tp_doc, "ParseResult that builds its components on first access"},
+    {Py_tp_getset, lazy_parse_result_getset},
+    {0, NULL}};
+
+static PyType_Spec lazy_split_result_spec = {
+    .name = "abf.urllib.parse.LazySplitResult",
+    .basicsize = sizeof(LazyResultObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    .slots = lazy_split_result_slots,
+};
+
+static PyType_Spec lazy_parse_result_spec = {
+    .name = "abf.urllib.parse.LazyParseResult",
+    .basicsize = sizeof(LazyResultObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    .slots = lazy_parse_result_slots,
+};
+
+/*
+ * Parse cache, off until set_cache_size(): urlsplit / urlparse results keyed
+ * on the url object, the scheme argument and the call's flags, like the
+ * stdlib's lru_cache(typed=True). The table is set-associative: a key can
+ * only live in the CACHE_WAYS slots after its hash's bucket, so a lookup is a
+ * few compares and evicting needs no tombstones. A slot hit since it was last
+ * looked at is spared once (clock), so hot urls stay in. Free-threaded
+ * builds serialize it with a mutex; the GIL does otherwise.
+ */
+enum { CACHE_WAYS = 8, CACHE_SPLIT = 1, CACHE_FRAGMENTS = 2 };
+
+#ifdef Py_GIL_DISABLED
+#define CACHE_LOCK(st) PyMutex_Lock(&(st)->cache_lock)
+#define CACHE_UNLOCK(st) PyMutex_Unlock(&(st)->cache_lock)
+#else
+#define CACHE_LOCK(st) ((void)(st))
+#define CACHE_UNLOCK(st) ((void)(st))
+#endif
+
+typedef struct cache_entry {
+    PyObject *url;    // exact str or bytes, NULL for a free slot
+    PyObject *scheme; // exact str or bytes, or NULL
+    PyObject *value;
+    Py_hash_t hash;
+    int flags;
+    bool referenced;
+} cache_entry_t;
+
+static inline bool cache_key_ok(PyObject *obj) {
+    return PyUnicode_CheckExact(obj) || PyBytes_CheckExact(obj);
+}
+
+static bool cache_same(PyObject *a, PyObject *b) {
+    if (a == b) {
+        return true;
+    }
+    if (!a || !b || Py_TYPE(a) != Py_TYPE(b)) {
+        return false;
+    }
+    if (PyBytes_CheckExact(a)) {
+        return PyBytes_GET_SIZE(a) == PyBytes_GET_SIZE(b) &&
+               memcmp(PyBytes_AS_STRING(a), PyBytes_AS_STRING(b),
+                      (size_t)PyBytes_GET_SIZE(a)) == 0;
+    }
+    return PyUnicode_Compare(a, b) == 0;
+}
+
+static inline size_t cache_ways(const module_state_t *st) {
+    return st->cache_size < CACHE_WAYS ? st->cache_size : CACHE_WAYS;
+}
+
+static inline cache_entry_t *cache_slot(module_state_t *st, Py_hash_t hash,
+                                        size_t way) {
+    return &st->cache_slots[((size_t)hash + way) & (st->cache_size - 1)];
+}
+
+// Empties e; the references it held go to *garbage (3 slots), released by
+// the caller once the cache is unlocked
+static void cache_entry_clear(module_state_t *st, cache_entry_t *e,
+                              PyObject **garbage) {
+    garbage[0] = e->url;
+    garbage[1] = e->scheme;
+    garbage[2] = e->value;
+    if (e->url) {
+        memset(e, 0, sizeof(*e));
+        --st->cache_used;
     }
+}
 
-    // Import urllib.parse.ParseResult and ParseResultBytes
-    PyObject *urllib_parse = PyImport_ImportModule("urllib.parse");
-    if (!urllib_parse) {
-        return NULL;
+static void cache_garbage_release(PyObject **garbage, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        Py_XDECREF(garbage[i]);
     }
-    split_result_type = PyObject_GetAttrString(urllib_parse, "SplitResult");
-    split_result_bytes_type =
-        PyObject_GetAttrString(urllib_parse, "SplitResultBytes");
-    parse_result_type = PyObject_GetAttrString(urllib_parse, "ParseResult");
-    parse_result_bytes_type =
-        PyObject_GetAttrString(urllib_parse, "ParseResultBytes");
+}
 
-    // Ensure both types are loaded
-    if (!parse_result_type || !parse_result_bytes_type ||
-        !split_result_bytes_type || !split_result_type) {
-        PyErr_SetString(PyExc_RuntimeError,
-                        "ParseResult or ParseResultBytes type not loaded");
-        Py_XDECREF(parse_result_type);
-        Py_XDECREF(parse_result_bytes_type);
-        Py_DECREF(urllib_parse);
-        Py_DECREF(m);
+// Cached result (new reference) or NULL; *hash is -1 when the call cannot
+// be cached at all
+static PyObject *cache_get(module_state_t *st, PyObject *url,
+                           PyObject *scheme, int flags, Py_hash_t *hash) {
+    *hash = -1;
+    if (!st->cache_slots || !cache_key_ok(url) ||
+        (scheme && !cache_key_ok(scheme))) {
         return NULL;
     }
+    // str and bytes keep their hash, so this is a field read after the
+    // first call. An ASCII str hashes like its bytes, and the same url is
+    // often cached with several flags: both are spread over the table so
+    // such keys do not crowd one bucket's ways.
+    Py_uhash_t kind = (Py_uhash_t)flags | (PyBytes_CheckExact(url) ? 4 : 0);
+    Py_uhash_t h = (Py_uhash_t)PyObject_Hash(url) ^ kind * 0x9E3779B9U;
+    if (scheme) {
+        h ^= (Py_uhash_t)PyObject_Hash(scheme) * 1000003U;
+    }
+    *hash = (Py_hash_t)h == -1 ? -2 : (Py_hash_t)h;
+    PyObject *value = NULL;
+    CACHE_LOCK(st);
+    for (size_t w = 0; st->cache_slots && w < cache_ways(st); ++w) {
+        cache_entry_t *e = cache_slot(st, *hash, w);
+        if (e->url && e->hash == *hash && e->flags == flags &&
+            cache_same(e->url, url) && cache_same(e->scheme, scheme)) {
+            e->referenced = true;
+            value = e->value;
+            Py_INCREF(value);
+            break;
+        }
+    }
+    if (value) {
+        ++st->cache_hits;
+    } else {
+        ++st->cache_misses;
+    }
+    CACHE_UNLOCK(st);
+    return value;
+}
 
-    Py_DECREF(urllib_parse);
-    return m;
+static void cache_put(module_state_t *st, PyObject *url, PyObject *scheme,
+                      int flags, Py_hash_t hash, PyObject *value) {
+    if (hash == -1) {
+        return;
+    }
+    PyObject *garbage[3] = {NULL, NULL, NULL};
+    CACHE_LOCK(st);
+    // Building the result may have let another thread resize the cache
+    if (st->cache_slots) {
+        cache_entry_t *victim = NULL;
+        for (size_t w = 0; w < cache_ways(st) && !victim; ++w) {
+            if (!cache_slot(st, hash, w)->url) {
+                victim = cache_slot(st, hash, w);
+            }
+        }
+        for (size_t w = 0; w < cache_ways(st) && !victim; ++w) {
+            cache_entry_t *e = cache_slot(st, hash, w);
+            if (!e->referenced) {
+                victim = e;
+            }
+            e->referenced = false;
+        }
+        if (!victim) {
+            victim = cache_slot(st, hash, 0);
+        }
+        cache_entry_clear(st, victim, garbage);
+        Py_INCREF(url);
+        Py_XINCREF(scheme);
+        Py_INCREF(value);
+        *victim = (cache_entry_t){.url = url,
+                                  .scheme = scheme,
+                                  .value = value,
+                                  .hash = hash,
+                                  .flags = flags};
+        ++st->cache_used;
+    }
+    CACHE_UNLOCK(st);
+    cache_garbage_release(garbage, 3);
+}
+
+// Detaches the table (and zeroes the statistics); the caller releases it
+// with cache_table_free once the cache is unlocked
+static cache_entry_t *cache_detach(module_state_t *st, size_t *size) {
+    cache_entry_t *slots = st->cache_slots;
+    *size = st->cache_size;
+    st->cache_slots = NULL;
+    st->cache_size = 0;
+    st->cache_used = 0;
+    st->cache_hits = st->cache_misses = 0;
+    return slots;
+}
+
+static void cache_table_free(cache_entry_t *slots, size_t size) {
+    for (size_t i = 0; slots && i < size; ++i) {
+        Py_XDECREF(slots[i].url);
+        Py_XDECREF(slots[i].scheme);
+        Py_XDECREF(slots[i].value);
+    }
+    PyMem_Free(slots);
 }
+
+// Empties the cache, keeping its size
+static int cache_reset(module_state_t *st) {
+    CACHE_LOCK(st);
+    size_t size;
+    cache_entry_t *old = cache_detach(st, &size);
+    cache_entry_t *slots = size ? PyMem_Calloc(size, sizeof(*slots)) : NULL;
+    if (slots) {
+        st->cache_slots = slots;
+        st->cache_size = size;
+    }
+    CACHE_UNLOCK(st);
+    cache_table_free(old, size);
+    if (size && !slots) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+// set_cache_size(maxsize: int) -> None; 0 turns the cache off
+static PyObject *abf_set_cache_size(PyObject *self, PyObject *args,
+                                    PyObject *kwargs) {
+    Py_ssize_t maxsize;
+    static char *kwlist[] = {"maxsize", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n", kwlist, &maxsize)) {
+        return NULL;
+    }
+    if (maxsize < 0) {
+        PyErr_SetString(PyExc_ValueError, "maxsize must be >= 0");
+        return NULL;
+    }
+    size_t size = maxsize ? 1 : 0;
+    while (size && size < (size_t)maxsize) {
+        size <<= 1;
+    }
+    cache_entry_t *slots = size ? PyMem_Calloc(size, sizeof(*slots)) : NULL;
+    if (size && !slots) {
+        return PyErr_NoMemory();
+    }
+    module_state_t *st = module_state(self);
+    size_t old_size;
+    CACHE_LOCK(st);
+    cache_entry_t *old = cache_detach(st, &old_size);
+    st->cache_slots = slots;
+    st->cache_size = size;
+    CACHE_UNLOCK(st);
+    cache_table_free(old, old_size);
+    Py_RETURN_NONE;
+}
+
+// cache_clear() -> None: drop every entry and zero the statistics
+static PyObject *abf_cache_clear(PyObject *self, PyObject *unused) {
+    (void)unused;
+    if (cache_reset(module_state(self)) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+// cache_info() -> CacheInfo(hits, misses, maxsize, currsize)
+static PyObject *abf_cache_info(PyObject *self, PyObject *unused) {
+    (void)unused;
+    module_state_t *st = module_state(self);
+    PyObject *info = PyStructSequence_New(st->CacheInfoType);
+    if (!info) {
+        return NULL;
+    }
+    CACHE_LOCK(st);
+    Py_ssize_t values[] = {st->cache_hits, st->cache_misses,
+                           (Py_ssize_t)st->cache_size, st->cache_used};
+    CACHE_UNLOCK(st);
+    for (Py_ssize_t i = 0; i < 4; ++i) {
+        PyObject *v = PyLong_FromSsize_t(values[i]);
+        if (!v) {
+            Py_DECREF(info);
+            return NULL;
+        }
+        PyStructSequence_SET_ITEM(info, i, v);
+    }
+    return info;
+}
+
+static PyStructSequence_Field cache_info_fields[] = {
+    {"hits", NULL},
+    {"misses", NULL},
+    {"maxsize", "slot count: maxsize rounded up to a power of two"},
+    {"currsize", NULL},
+    {NULL, NULL}};
+
+static PyStructSequence_Desc cache_info_desc = {
+    "abf.urllib.parse.CacheInfo", "Parse cache statistics", cache_info_fields,
+    4};
+
+// stats() -> dict: the hot-path counters of an ABF_STATS build summed over
+// every thread, with "length_log2" the url length histogram (bucket i: urls
+// of bit length i); just {"enabled": False} in other builds
+static PyObject *abf_stats(PyObject *self, PyObject *unused) {
+    (void)self;
+    (void)unused;
+    PyObject *dict = PyDict_New();
+    if (!dict) {
+        return NULL;
+    }
+#ifdef ABF_STATS
+    url_stats_t stats;
+    url_stats_read(&stats);
+    if (PyDict_SetItemString(dict, "enabled", Py_True) < 0) {
+        goto error;
+    }
+    for (int i = 0; i < URL_STAT_COUNT; ++i) {
+        PyObject *v = PyLong_FromUnsignedLongLong(stats.counters[i]);
+        if (!v || PyDict_SetItemString(dict, url_stat_name(i), v) < 0) {
+            Py_XDECREF(v);
+            goto error;
+        }
+        Py_DECREF(v);
+    }
+    PyObject *hist = PyList_New(URL_STATS_LEN_BUCKETS);
+    if (!hist) {
+        goto error;
+    }
+    for (Py_ssize_t i = 0; i < URL_STATS_LEN_BUCKETS; ++i) {
+        PyObject *v = PyLong_FromUnsignedLongLong(stats.length_log2[i]);
+        if (!v) {
+            Py_DECREF(hist);
+            goto error;
+        }
+        PyList_SET_ITEM(hist, i, v);
+    }
+    int rc = PyDict_SetItemString(dict, "length_log2", hist);
+    Py_DECREF(hist);
+    if (rc < 0) {
+        goto error;
+    }
+    return dict;
+error:
+    Py_DECREF(dict);
+    return NULL;
+#else
+    if (PyDict_SetItemString(dict, "enabled", Py_False) < 0) {
+        Py_DECREF(dict);
+        return NULL;
+    }
+    return dict;
+#endif
+}
+
+// reset_stats() -> None
+static PyObject *abf_reset_stats(PyObject *self, PyObject *unused) {
+    (void)self;
+    (void)unused;
+#ifdef ABF_STATS
+    url_stats_reset();
+#endif
+    Py_RETURN_NONE;
+}
+
+// simd_level() -> the kernel level in use: "scalar", "sse4.2", "avx2" or
+// "avx512bw" (capped by ABF_URLLIB_SIMD at import)
+static PyObject *abf_simd_level(PyObject *self, PyObject *unused) {
+    (void)self;
+    (void)unused;
+    return PyUnicode_FromString(url_simd_name(url_simd_level()));
+}
+
+// Helper: views=True slices the url's buffer, so a str url is a TypeError
+static int check_views(int views, int is_bytes) {
+    if (views && !is_bytes) {
+        PyErr_SetString(PyExc_TypeError,
+                        "views=True needs a bytes-like url, not str");
+        return -1;
+    }
+    return 0;
+}
+
+// Single urls shorter than this are parsed without releasing the GIL: the
+// release and reacquire would cost more than the parse
+enum { PARSE_RELEASE_GIL_MIN_LEN = 4096 };
+
+// abf_url_parse(url: str | Buffer, scheme: str = '', allow_fragments: bool =
+// True, *, lazy: bool = False, views: bool = False) -> ParseResult |
+// LazyParseResult
+static PyObject *abf_url_parse(PyObject *self, PyObject *const *args,
+                               Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "urlparse",
+        .names = {"url", "scheme", "allow_fragments", "lazy", "views", NULL},
+        .required = 1,
+        .max_positional = 3};
+    PyObject *argv[5];
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0) {
+        return NULL;
+    }
+    PyObject *url_obj = argv[0], *scheme_obj = argv[1];
+    const char *url = NULL, *scheme = NULL;
+    Py_ssize_t url_len = 0;
+    int allow_fragments = fast_arg_flag(argv[2], 1);
+    int lazy = fast_arg_flag(argv[3], 0);
+    int views = fast_arg_flag(argv[4], 0);
+    if (allow_fragments < 0 || lazy < 0 || views < 0) {
+        return NULL;
+    }
+    lazy |= views; // views are lazy results
+    module_state_t *st = module_state(self);
+    PyObject *cache_scheme = scheme_obj == Py_None ? NULL : scheme_obj;
+    int cache_flags = allow_fragments ? CACHE_FRAGMENTS : 0;
+    Py_hash_t hash = -1;
+    if (!lazy) {
+        PyObject *cached =
+            cache_get(st, url_obj, cache_scheme, cache_flags, &hash);
+        if (cached) {
+            return cached;
+        }
+    }
+
+    Py_buffer view;
+    int is_bytes = get_url_buffer(url_obj, &view, &url, &url_len, "url");
+    if (is_bytes < 0) {
+        return NULL;
+    }
+    if (get_scheme_from_pyobject(scheme_obj, &scheme) < 0 ||
+        check_views(views, is_bytes) < 0) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    // Parse the URL
+    // clang-format off
+    url_parse_result_t result;
+    url_scratch_t scratch = {NULL};
+    int err;
+    if (url_len >= PARSE_RELEASE_GIL_MIN_LEN) {
+        Py_BEGIN_ALLOW_THREADS
+        err = url_parse(url, (size_t)url_len, scheme, allow_fragments,
+                        &scratch, &result);
+        Py_END_ALLOW_THREADS
+    } else {
+        err = url_parse(url, (size_t)url_len, scheme, allow_fragments,
+                        &scratch, &result);
+    }
+    // clang-format on
+    PyObject *res = NULL;
+    if (err != URL_PARSE_OK) {
+        set_parse_error(err, "abf_url_parse");
+    } else if (check_netloc(&result.netloc, is_bytes) < 0) {
+        res = NULL;
+    } else if (lazy) {
+        res = lazy_parse_result(st, &result, url_obj, url, url_len,
+                                is_bytes, views);
+    } else if ((res = parse_result_to_pyobj(st, &result, is_bytes,
+                                            is_ascii_str(url_obj)))) {
+        cache_put(st, url_obj, cache_scheme, cache_flags, hash, res);
+    }
+    url_scratch_free(&scratch);
+    PyBuffer_Release(&view);
+    return res;
+}
+
+// abf_urlsplit(url: str | Buffer, scheme: str = '', allow_fragments: bool =
+// True, *, lazy: bool = False, views: bool = False) -> SplitResult |
+// LazySplitResult
+static PyObject *abf_urlsplit(PyObject *self, PyObject *const *args,
+                              Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "urlsplit",
+        .names = {"url", "scheme", "allow_fragments", "lazy", "views", NULL},
+        .required = 1,
+        .max_positional = 3};
+    PyObject *argv[5];
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0) {
+        return NULL;
+    }
+    PyObject *url_obj = argv[0], *scheme_obj = argv[1];
+    const char *url = NULL, *scheme = NULL;
+    Py_ssize_t url_len = 0;
+    int allow_fragments = fast_arg_flag(argv[2], 1);
+    int lazy = fast_arg_flag(argv[3], 0);
+    int views = fast_arg_flag(argv[4], 0);
+    if (allow_fragments < 0 || lazy < 0 || views < 0) {
+        return NULL;
+    }
+    lazy |= views; // views are lazy results
+    module_state_t *st = module_state(self);
+    PyObject *cache_scheme = scheme_obj == Py_None ? NULL : scheme_obj;
+    int cache_flags =
+        CACHE_SPLIT | (allow_fragments ? CACHE_FRAGMENTS : 0);
+    Py_hash_t hash = -1;
+    if (!lazy) {
+        PyObject *cached =
+            cache_get(st, url_obj, cache_scheme, cache_flags, &hash);
+        if (cached) {
+            return cached;
+        }
+    }
+
+    Py_buffer view;
+    int is_bytes = get_url_buffer(url_obj, &view, &url, &url_len, "url");
+    if (is_bytes < 0) {
+        return NULL;
+    }
+    if (get_scheme_from_pyobject(scheme_obj, &scheme) < 0 ||
+        check_views(views, is_bytes) < 0) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    // clang-format off
+    url_split_result_t result;
+    url_scratch_t scratch = {NULL};
+    int err;
+    if (url_len >= PARSE_RELEASE_GIL_MIN_LEN) {
+        Py_BEGIN_ALLOW_THREADS
+        err = url_split(url, (size_t)url_len, scheme, allow_fragments,
+                        &scratch, &result);
+        Py_END_ALLOW_THREADS
+    } else {
+        err = url_split(url, (size_t)url_len, scheme, allow_fragments,
+                        &scratch, &result);
+    }
+    // clang-format on
+
+    PyObject *res = NULL;
+    if (err != URL_PARSE_OK) {
+        set_parse_error(err, "abf_urlsplit");
+    } else if (check_netloc(&result.netloc, is_bytes) < 0) {
+        res = NULL;
+    } else if (lazy) {
+        res = lazy_split_result(st, &result, url_obj, url, url_len,
+                                is_bytes, views);
+    } else if ((res = split_result_to_pyobj(st, &result, is_bytes,
+                                            is_ascii_str(url_obj)))) {
+        cache_put(st, url_obj, cache_scheme, cache_flags, hash, res);
+    }
+    url_scratch_free(&scratch);
+    PyBuffer_Release(&view);
+    return res;
+}
+
+// Batches are parsed in blocks of this many urls: one GIL release per block
+// keeps the scratch arrays small while the pool still gets enough work
+enum { BATCH_BLOCK = 65536 };
+
+// What a batch entry point does with each block of its urls, the block
+// starting at index start of the batch. kernel runs without the GIL.
+// convert runs with it while the block's buffer urls are still exported,
+// kinds[i] being get_url_buffer's is_bytes; -1 with an exception set stops
+// the batch.
+typedef struct {
+    void (*kernel)(void *ctx, const char **bufs, const size_t *lens,
+                   size_t n, Py_ssize_t start);
+    int (*convert)(void *ctx, PyObject *urls, Py_ssize_t start,
+                   const char **bufs, const size_t *lens, const char *kinds,
+                   size_t n);
+} batch_ops_t;
+
+// Urls in each block of a batch of n, at least 1 to size its arrays with
+static size_t batch_block(Py_ssize_t n) {
+    return n < 1 ? 1 : n < BATCH_BLOCK ? (size_t)n : BATCH_BLOCK;
+}
+
+// Runs ops over urls block by block. urls is the caller's own list: its
+// items must stay alive while the GIL is released. 0, or -1 with an
+// exception set
+static int batch_run(PyObject *urls, const batch_ops_t *ops, void *ctx) {
+    Py_ssize_t n = PyList_GET_SIZE(urls);
+    size_t block = batch_block(n);
+    const char **bufs = PyMem_Malloc(sizeof(*bufs) * block);
+    size_t *lens = PyMem_Malloc(sizeof(*lens) * block);
+    char *kinds = PyMem_Malloc(block);
+    // Exports of the block's buffer urls, allocated on the first one
+    Py_buffer *held = NULL;
+    size_t nheld = 0;
+    int rc = -1;
+    if (!bufs || !lens || !kinds) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    for (Py_ssize_t start = 0; start < n; start += (Py_ssize_t)block) {
+        size_t m = (size_t)(n - start) < block ? (size_t)(n - start) : block;
+        for (size_t i = 0; i < m; ++i) {
+            Py_ssize_t len;
+            Py_buffer view;
+            int is_bytes = get_url_buffer(
+                PyList_GET_ITEM(urls, start + (Py_ssize_t)i), &view, &bufs[i],
+                &len, "url");
+            if (is_bytes < 0) {
+                goto done;
+            }
+            if (view.obj) {
+                if (!held && !(held = PyMem_Calloc(block, sizeof(*held)))) {
+                    PyBuffer_Release(&view);
+                    PyErr_NoMemory();
+                    goto done;
+                }
+                held[nheld++] = view;
+            }
+            lens[i] = (size_t)len;
+            kinds[i] = (char)is_bytes;
+        }
+
+        // clang-format off
+        Py_BEGIN_ALLOW_THREADS
+        ops->kernel(ctx, bufs, lens, m, start);
+        Py_END_ALLOW_THREADS
+        // clang-format on
+
+        int err = ops->convert(ctx, urls, start, bufs, lens, kinds, m);
+        for (; nheld; --nheld) {
+            PyBuffer_Release(&held[nheld - 1]);
+        }
+        if (err < 0) {
+            goto done;
+        }
+    }
+    rc = 0;
+
+done:
+    for (; nheld; --nheld) {
+        PyBuffer_Release(&held[nheld - 1]);
+    }
+    PyMem_Free(held);
+    PyMem_Free(bufs);
+    PyMem_Free(lens);
+    PyMem_Free(kinds);
+    return rc;
+}
+
+// A batch's result array as a memoryview of format fmt
+static PyObject *batch_memoryview(PyObject *arr, const char *fmt) {
+    PyObject *view = PyMemoryView_FromObject(arr);
+    if (!view) {
+        return NULL;
+    }
+    PyObject *res = PyObject_CallMethod(view, "cast", "s", fmt);
+    Py_DECREF(view);
+    return res;
+}
+
+// urlsplit_many / urlparse_many: per-block results, converted into list
+typedef struct {
+    module_state_t *st;
+    const char *scheme;
+    bool allow_fragments, split, lazy, views;
+    url_scratch_t scratch;
+    url_parse_error_t *errors;
+    void *results;
+    PyObject *list;
+} parse_many_t;
+
+static void parse_many_kernel(void *ctx, const char **bufs,
+                              const size_t *lens, size_t n,
+                              Py_ssize_t start) {
+    (void)start;
+    parse_many_t *pm = ctx;
+    url_scratch_reset(&pm->scratch);
+    if (pm->split) {
+        url_split_many(bufs, lens, n, pm->scheme, pm->allow_fragments,
+                       &pm->scratch, pm->results, pm->errors);
+    } else {
+        url_parse_many(bufs, lens, n, pm->scheme, pm->allow_fragments,
+                       &pm->scratch, pm->results, pm->errors);
+    }
+}
+
+static int parse_many_convert(void *ctx, PyObject *urls, Py_ssize_t start,
+                              const char **bufs, const size_t *lens,
+                              const char *kinds, size_t n) {
+    parse_many_t *pm = ctx;
+    module_state_t *st = pm->st;
+    for (size_t i = 0; i < n; ++i) {
+        if (check_views(pm->views, kinds[i]) < 0) {
+            return -1;
+        }
+        if (pm->errors[i] != URL_PARSE_OK) {
+            set_parse_error(pm->errors[i],
+                            pm->split ? "urlsplit_many" : "urlparse_many");
+            return -1;
+        }
+        PyObject *source = PyList_GET_ITEM(urls, start + (Py_ssize_t)i);
+        Py_ssize_t len = (Py_ssize_t)lens[i];
+        PyObject *res;
+        if (pm->split) {
+            url_split_result_t *r = (url_split_result_t *)pm->results + i;
+            if (check_netloc(&r->netloc, kinds[i]) < 0) {
+                return -1;
+            }
+            res = pm->lazy ? lazy_split_result(st, r, source, bufs[i], len,
+                                               kinds[i], pm->views)
+                           : split_result_to_pyobj(st, r, kinds[i],
+                                                   is_ascii_str(source));
+        } else {
+            url_parse_result_t *r = (url_parse_result_t *)pm->results + i;
+            if (check_netloc(&r->netloc, kinds[i]) < 0) {
+                return -1;
+            }
+            res = pm->lazy ? lazy_parse_result(st, r, source, bufs[i], len,
+                                               kinds[i], pm->views)
+                           : parse_result_to_pyobj(st, r, kinds[i],
+                                                   is_ascii_str(source));
+        }
+        if (!res) {
+            return -1;
+        }
+        PyList_SET_ITEM(pm->list, start + (Py_ssize_t)i, res);
+    }
+    return 0;
+}
+
+// Shared body of urlsplit_many / urlparse_many
+static PyObject *parse_many(module_state_t *st, PyObject *args,
+                            PyObject *kwargs, bool split) {
+    PyObject *urls_obj = NULL, *scheme_obj = NULL;
+    const char *scheme = NULL;
+    int allow_fragments = 1, lazy = 0, views = 0; // "p" stores an int
+    static char *kwlist[] = {"urls", "scheme", "allow_fragments", "lazy",
+                             "views", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Op$pp", kwlist,
+                                     &urls_obj, &scheme_obj, &allow_fragments,
+                                     &lazy, &views) ||
+        get_scheme_from_pyobject(scheme_obj, &scheme) < 0) {
+        return NULL;
+    }
+
+    // Own copy: the items must stay alive while the GIL is released
+    PyObject *urls = PySequence_List(urls_obj);
+    if (!urls) {
+        return NULL;
+    }
+    Py_ssize_t n = PyList_GET_SIZE(urls);
+    size_t block = batch_block(n);
+    parse_many_t pm = {
+        .st = st,
+        .scheme = scheme,
+        .allow_fragments = allow_fragments,
+        .split = split,
+        .lazy = lazy || views, // views are lazy results
+        .views = views,
+        .scratch = {NULL},
+        .errors = PyMem_Malloc(sizeof(*pm.errors) * block),
+        .results = PyMem_Malloc((split ? sizeof(url_split_result_t)
+                                       : sizeof(url_parse_result_t)) *
+                                block),
+        .list = PyList_New(n)};
+    if (pm.list && (!pm.errors || !pm.results)) {
+        PyErr_NoMemory();
+        Py_CLEAR(pm.list);
+    }
+    static const batch_ops_t ops = {parse_many_kernel, parse_many_convert};
+    if (pm.list && batch_run(urls, &ops, &pm) < 0) {
+        Py_CLEAR(pm.list);
+    }
+    url_scratch_free(&pm.scratch);
+    PyMem_Free(pm.errors);
+    PyMem_Free(pm.results);
+    Py_DECREF(urls);
+    return pm.list;
+}
+
+// abf_urlsplit_many(urls: Iterable[str | Buffer], scheme='',
+// allow_fragments=True, *, lazy=False, views=False) -> list[SplitResult]
+static PyObject *abf_urlsplit_many(PyObject *self, PyObject *args,
+                                   PyObject *kwargs) {
+    return parse_many(module_state(self), args, kwargs, true);
+}
+
+// abf_urlparse_many(urls: Iterable[str | Buffer], scheme='',
+// allow_fragments=True, *, lazy=False, views=False) -> list[ParseResult]
+static PyObject *abf_urlparse_many(PyObject *self, PyObject *args,
+                                   PyObject *kwargs) {
+    return parse_many(module_state(self), args, kwargs, false);
+}
+
+/*
+ * Columnar output. Every url is laid out in one shared data buffer; each
+ * component is a pair of int32/int64 arrays (start into data, length), and
+ * arrow() repacks one component into the Arrow string layout (offsets[n + 1]
+ * plus values).
+ */
+enum { COLUMNS_MAX_FIELDS = 6 };
+
+static const char *const split_field_names[] = {"scheme", "netloc", "path",
+                                                "query", "fragment"};
+static const char *const parse_field_names[] = {
+    "scheme", "netloc", "path", "params", "query", "fragment"};
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *data; // bytes
+    Py_ssize_t count;
+    int width; // 4 or 8 bytes per index
+    Py_ssize_t nfields;
+    const char *const *names;
+    PyObject *starts[COLUMNS_MAX_FIELDS];  // bytes holding the index arrays
+    PyObject *lengths[COLUMNS_MAX_FIELDS]; // bytes holding the index arrays
+} UrlColumnsObject;
+
+static inline void columns_store(char *arr, int width, size_t i, size_t v) {
+    if (width == 4) {
+        ((int32_t *)arr)[i] = (int32_t)v;
+    } else {
+        ((int64_t *)arr)[i] = (int64_t)v;
+    }
+}
+
+static inline size_t columns_load(const char *arr, int width, size_t i) {
+    return width == 4 ? (size_t)((const int32_t *)arr)[i]
+                      : (size_t)((const int64_t *)arr)[i];
+}
+
+// Field index from a name or a position
+static Py_ssize_t columns_field(UrlColumnsObject *self, PyObject *field) {
+    if (PyUnicode_Check(field)) {
+        for (Py_ssize_t i = 0; i < self->nfields; ++i) {
+            if (PyUnicode_CompareWithASCIIString(field, self->names[i]) == 0) {
+                return i;
+            }
+        }
+        PyErr_Format(PyExc_KeyError, "no url component %R", field);
+        return -1;
+    }
+    Py_ssize_t i = PyNumber_AsSsize_t(field, PyExc_IndexError);
+    if (i == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (i < 0 || i >= self->nfields) {
+        PyErr_SetString(PyExc_IndexError, "component index out of range");
+        return -1;
+    }
+    return i;
+}
+
+// Read-only memoryview of an index array, cast to int32/int64
+static PyObject *columns_view(UrlColumnsObject *self, PyObject *arr) {
+    PyObject *view = PyMemoryView_FromObject(arr);
+    if (!view) {
+        return NULL;
+    }
+    PyObject *res =
+        PyObject_CallMethod(view, "cast", "s", self->width == 4 ? "i" : "q");
+    Py_DECREF(view);
+    return res;
+}
+
+static PyObject *columns_starts(PyObject *op, PyObject *field) {
+    UrlColumnsObject *self = (UrlColumnsObject *)op;
+    Py_ssize_t i = columns_field(self, field);
+    return i < 0 ? NULL : columns_view(self, self->starts[i]);
+}
+
+static PyObject *columns_lengths(PyObject *op, PyObject *field) {
+    UrlColumnsObject *self = (UrlColumnsObject *)op;
+    Py_ssize_t i = columns_field(self, field);
+    return i < 0 ? NULL : columns_view(self, self->lengths[i]);
+}
+
+// arrow(field) -> (offsets, values): Arrow utf8 (int32 index) or large_utf8
+// (int64 index) layout of one component
+static PyObject *columns_arrow(PyObject *op, PyObject *field) {
+    UrlColumnsObject *self = (UrlColumnsObject *)op;
+    Py_ssize_t f = columns_field(self, field);
+    if (f < 0) {
+        return NULL;
+    }
+    const char *starts = PyBytes_AS_STRING(self->starts[f]);
+    const char *lengths = PyBytes_AS_STRING(self->lengths[f]);
+    size_t count = (size_t)self->count;
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += columns_load(lengths, self->width, i);
+    }
+    if (self->width == 4 && total > INT32_MAX) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "component data does not fit int32 offsets, use "
+                        "index_type='int64'");
+        return NULL;
+    }
+
+    PyObject *offsets = PyBytes_FromStringAndSize(
+        NULL, (Py_ssize_t)((count + 1) * (size_t)self->width));
+    PyObject *values = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)total);
+    if (!offsets || !values) {
+        Py_XDECREF(offsets);
+        Py_XDECREF(values);
+        return NULL;
+    }
+    char *off = PyBytes_AS_STRING(offsets);
+    char *out = PyBytes_AS_STRING(values);
+    const char *data = PyBytes_AS_STRING(self->data);
+    int width = self->width;
+
+    // clang-format off
+    Py_BEGIN_ALLOW_THREADS
+    size_t pos = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = columns_load(lengths, width, i);
+        columns_store(off, width, i, pos);
+        memcpy(out + pos, data + columns_load(starts, width, i), len);
+        pos += len;
+    }
+    columns_store(off, width, count, pos);
+    Py_END_ALLOW_THREADS
+    // clang-format on
+
+    PyObject *view = columns_view(self, offsets);
+    Py_DECREF(offsets);
+    if (!view) {
+        Py_DECREF(values);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", view, values);
+}
+
+static PyObject *columns_get_data(PyObject *op, void *closure) {
+    (void)closure;
+    PyObject *data = ((UrlColumnsObject *)op)->data;
+    Py_INCREF(data);
+    return data;
+}
+
+static PyObject *columns_get_fields(PyObject *op, void *closure) {
+    (void)closure;
+    UrlColumnsObject *self = (UrlColumnsObject *)op;
+    PyObject *fields = PyTuple_New(self->nfields);
+    for (Py_ssize_t i = 0; fields && i < self->nfields; ++i) {
+        PyObject *name = PyUnicode_FromString(self->names[i]);
+        if (!name) {
+            Py_CLEAR(fields);
+            break;
+        }
+        PyTuple_SET_ITEM(fields, i, name);
+    }
+    return fields;
+}
+
+static PyObject *columns_get_index_type(PyObject *op, void *closure) {
+    (void)closure;
+    return PyUnicode_FromString(((UrlColumnsObject *)op)->width == 4
+                                    ? "int32"
+                                    : "int64");
+}
+
+static Py_ssize_t columns_length(PyObject *op) {
+    return ((UrlColumnsObject *)op)->count;
+}
+
+static void columns_dealloc(PyObject *op) {
+    UrlColumnsObject *self = (UrlColumnsObject *)op;
+    PyTypeObject *type = Py_TYPE(op);
+    for (Py_ssize_t i = 0; i < COLUMNS_MAX_FIELDS; ++i) {
+        Py_XDECREF(self->starts[i]);
+        Py_XDECREF(self->lengths[i]);
+    }
+    Py_XDECREF(self->data);
+    type->tp_free(op);
+    Py_DECREF(type);
+}
+
+static PyMethodDef columns_methods[] = {
+    {"starts", columns_starts, METH_O,
+     "starts(field) -> memoryview of each row's component start in data"},
+    {"lengths", columns_lengths, METH_O,
+     "lengths(field) -> memoryview of each row's component length"},
+    {"arrow", columns_arrow, METH_O,
+     "arrow(field) -> (offsets, values) in the Arrow string layout"},
+    {NULL, NULL, 0, NULL}};
+
+static PyGetSetDef columns_getset[] = {
+    {"data", columns_get_data, NULL, "Shared data buffer", NULL},
+    {"fields", columns_get_fields, NULL, "Component names", NULL},
+    {"index_type", columns_get_index_type, NULL, "'int32' or 'int64'", NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
+
+static PyType_Slot columns_slots[] = {
+    {Py_tp_doc, "Columnar url components over one shared data buffer"},
+    {Py_tp_dealloc, columns_dealloc},
+    {Py_sq_length, columns_length},
+    {Py_tp_methods, columns_methods},
+    {Py_tp_getset, columns_getset},
+    {0, NULL}};
+
+static PyType_Spec columns_spec = {
+    .name = "abf.urllib.parse.UrlColumns",
+    .basicsize = sizeof(UrlColumnsObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    .slots = columns_slots,
+};
+
+// Lay the input out in one bytes object: a buffer is copied as is (one url
+// per line), a sequence is concatenated. Row i is data[line_starts[i]] for
+// line_lens[i] bytes. extra bytes are reserved at the end of data.
+static PyObject *columns_gather(PyObject *urls_obj, size_t extra,
+                                size_t **line_starts, size_t **line_lens,
+                                size_t *count) {
+    PyObject *data = NULL;
+    *line_starts = *line_lens = NULL;
+
+    if (PyObject_CheckBuffer(urls_obj)) {
+        Py_buffer view;
+        if (PyObject_GetBuffer(urls_obj, &view, PyBUF_SIMPLE) < 0) {
+            return NULL;
+        }
+        const char *buf = view.buf;
+        size_t len = (size_t)view.len;
+        size_t n = 0;
+        for (const char *p = buf, *end = buf + len; p < end;) {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            n++;
+            p = nl ? nl + 1 : end;
+        }
+        data = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)(len + extra));
+        *line_starts = PyMem_Malloc(sizeof(size_t) * (n ? n : 1));
+        *line_lens = PyMem_Malloc(sizeof(size_t) * (n ? n : 1));
+        if (!data || !*line_starts || !*line_lens) {
+            if (data) {
+                PyErr_NoMemory();
+            }
+            PyBuffer_Release(&view);
+            goto error;
+        }
+        memcpy(PyBytes_AS_STRING(data), buf, len);
+        PyBuffer_Release(&view);
+        const char *base = PyBytes_AS_STRING(data);
+        size_t i = 0;
+        for (const char *p = base, *end = base + len; p < end; ++i) {
+            const char *nl = memchr(p, '\n', (size_t)(end - p));
+            (*line_starts)[i] = (size_t)(p - base);
+            (*line_lens)[i] = (size_t)((nl ? nl : end) - p);
+            p = nl ? nl + 1 : end;
+        }
+        *count = n;
+        return data;
+    }
+
+    PyObject *urls = PySequence_List(urls_obj);
+    if (!urls) {
+        return NULL;
+    }
+    size_t n = (size_t)PyList_GET_SIZE(urls);
+    size_t total = 0;
+    *line_starts = PyMem_Malloc(sizeof(size_t) * (n ? n : 1));
+    *line_lens = PyMem_Malloc(sizeof(size_t) * (n ? n : 1));
+    if (!*line_starts || !*line_lens) {
+        PyErr_NoMemory();
+        Py_DECREF(urls);
+        goto error;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const char *buf;
+        Py_ssize_t len;
+        if (get_buffer_from_pyobject(PyList_GET_ITEM(urls, (Py_ssize_t)i),
+                                     &buf, &len, "url") < 0) {
+            Py_DECREF(urls);
+            goto error;
+        }
+        (*line_starts)[i] = total;
+        (*line_lens)[i] = (size_t)len;
+        total += (size_t)len;
+    }
+    data = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)(total + extra));
+    if (!data) {
+        Py_DECREF(urls);
+        goto error;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const char *buf = NULL;
+        Py_ssize_t len = 0;
+        // Cannot fail: every item was converted above
+        get_buffer_from_pyobject(PyList_GET_ITEM(urls, (Py_ssize_t)i), &buf,
+                                 &len, "url");
+        memcpy(PyBytes_AS_STRING(data) + (*line_starts)[i], buf, (size_t)len);
+    }
+    Py_DECREF(urls);
+    *count = n;
+    return data;
+
+error:
+    PyMem_Free(*line_starts);
+    PyMem_Free(*line_lens);
+    *line_starts = *line_lens = NULL;
+    Py_XDECREF(data);
+    return NULL;
+}
+
+// Store one component of row i. Components outside data can only be the
+// default scheme, which was appended to data at scheme_off.
+static inline void columns_put(UrlColumnsObject *cols, Py_ssize_t f,
+                               size_t i, const url_component_t *comp,
+                               char *data, size_t data_len,
+                               size_t scheme_off) {
+    size_t start = 0;
+    if (comp->start) {
+        if (comp->start >= data && comp->start < data + data_len) {
+            start = (size_t)(comp->start - data);
+        } else {
+            start = scheme_off;
+        }
+    }
+    columns_store(PyBytes_AS_STRING(cols->starts[f]), cols->width, i, start);
+    columns_store(PyBytes_AS_STRING(cols->lengths[f]), cols->width, i,
+                  comp->length);
+}
+
+// Shared body of urlsplit_columns / urlparse_columns
+static PyObject *parse_columns(module_state_t *st, PyObject *args,
+                               PyObject *kwargs, bool split) {
+    PyObject *urls_obj = NULL, *scheme_obj = NULL;
+    const char *scheme = NULL;
+    const char *index_type = "int64";
+    int allow_fragments = 1; // "p" stores an int
+    static char *kwlist[] = {"urls", "scheme", "allow_fragments", "index_type",
+                             NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Op$s", kwlist,
+                                     &urls_obj, &scheme_obj, &allow_fragments,
+                                     &index_type) ||
+        get_scheme_from_pyobject(scheme_obj, &scheme) < 0) {
+        return NULL;
+    }
+    int width;
+    if (strcmp(index_type, "int64") == 0) {
+        width = 8;
+    } else if (strcmp(index_type, "int32") == 0) {
+        width = 4;
+    } else {
+        PyErr_SetString(PyExc_ValueError,
+                        "index_type must be 'int32' or 'int64'");
+        return NULL;
+    }
+    if (PyUnicode_Check(urls_obj)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "urls must be a sequence of urls or a bytes-like "
+                        "buffer of newline separated urls");
+        return NULL;
+    }
+
+    size_t scheme_len = scheme ? strlen(scheme) : 0;
+    size_t *line_starts, *line_lens, count;
+    PyObject *data = columns_gather(urls_obj, scheme_len, &line_starts,
+                                    &line_lens, &count);
+    if (!data) {
+        return NULL;
+    }
+    char *base = PyBytes_AS_STRING(data);
+    size_t data_len = (size_t)PyBytes_GET_SIZE(data);
+    size_t scheme_off = data_len - scheme_len;
+    memcpy(base + scheme_off, scheme ? scheme : "", scheme_len);
+    if (width == 4 && data_len > INT32_MAX) {
+        PyErr_SetString(PyExc_OverflowError,
+                        "data does not fit int32 indices, use "
+                        "index_type='int64'");
+        goto error;
+    }
+
+    PyTypeObject *type = st->UrlColumnsType;
+    UrlColumnsObject *cols = (UrlColumnsObject *)type->tp_alloc(type, 0);
+    if (!cols) {
+        goto error;
+    }
+    cols->data = data;
+    cols->count = (Py_ssize_t)count;
+    cols->width = width;
+    cols->nfields = split ? 5 : 6;
+    cols->names = split ? split_field_names : parse_field_names;
+    for (Py_ssize_t f = 0; f < cols->nfields; ++f) {
+        Py_ssize_t size = (Py_ssize_t)(count * (size_t)width);
+        cols->starts[f] = PyBytes_FromStringAndSize(NULL, size);
+        cols->lengths[f] = PyBytes_FromStringAndSize(NULL, size);
+        if (!cols->starts[f] || !cols->lengths[f]) {
+            goto error_cols;
+        }
+    }
+
+    size_t block = count < BATCH_BLOCK ? count : BATCH_BLOCK;
+    const char **bufs = PyMem_Malloc(sizeof(*bufs) * (block ? block : 1));
+    url_parse_error_t *errors =
+        PyMem_Malloc(sizeof(*errors) * (block ? block : 1));
+    void *results = PyMem_Malloc(
+        (split ? sizeof(url_split_result_t) : sizeof(url_parse_result_t)) *
+        (block ? block : 1));
+    if (!bufs || !errors || !results) {
+        PyMem_Free(bufs);
+        PyMem_Free(errors);
+        PyMem_Free(results);
+        PyErr_NoMemory();
+        goto error_cols;
+    }
+
+    size_t failed = SIZE_MAX;
+    url_parse_error_t failed_err = URL_PARSE_OK;
+    url_scratch_t scratch = {NULL};
+    // Neither data nor the index arrays are visible to Python yet
+    // clang-format off
+    Py_BEGIN_ALLOW_THREADS
+    for (size_t start = 0; start < count && failed == SIZE_MAX;
+         start += block) {
+        size_t m = count - start < block ? count - start : block;
+        for (size_t i = 0; i < m; ++i) {
+            bufs[i] = base + line_starts[start + i];
+        }
+        url_scratch_reset(&scratch);
+        if (split) {
+            url_split_many(bufs, line_lens + start, m, scheme,
+                           allow_fragments, &scratch, results, errors);
+        } else {
+            url_parse_many(bufs, line_lens + start, m, scheme,
+                           allow_fragments, &scratch, results, errors);
+        }
+        for (size_t i = 0; i < m; ++i) {
+            if (errors[i] != URL_PARSE_OK) {
+                failed = start + i;
+                failed_err = errors[i];
+                break;
+            }
+            url_component_t *comps[COLUMNS_MAX_FIELDS];
+            url_component_t parsed;
+            if (split) {
+                url_split_result_t *r = (url_split_result_t *)results + i;
+                url_component_t *c[] = {&r->scheme, &r->netloc, &r->path,
+                                        &r->query, &r->fragment};
+                memcpy(comps, c, sizeof(c));
+                parsed = r->source;
+            } else {
+                url_parse_result_t *r = (url_parse_result_t *)results + i;
+                url_component_t *c[] = {&r->scheme, &r->netloc, &r->path,
+                                        &r->params, &r->query, &r->fragment};
+                memcpy(comps, c, sizeof(c));
+                parsed = r->source;
+            }
+            // A row with tabs or newlines was parsed from a cleaned copy in
+            // scratch; it is no longer than the row, which is ours to reuse
+            char *row = base + line_starts[start + i];
+            if (parsed.start < row ||
+                parsed.start > row + line_lens[start + i]) {
+                memcpy(row, parsed.start, parsed.length);
+                for (Py_ssize_t f = 0; f < cols->nfields; ++f) {
+                    move_component(comps[f], parsed.start, parsed.length, row);
+                }
+            }
+            // urllib.parse lowercases a scheme taken from the url; data is
+            // our own copy, so fold it in place
+            const url_component_t *sc = comps[0];
+            if (sc->start >= base && sc->start < base + scheme_off) {
+                for (size_t k = 0; k < sc->length; ++k) {
+                    char ch = sc->start[k];
+                    if (ch >= 'A' && ch <= 'Z') {
+                        base[sc->start - base + (ptrdiff_t)k] =
+                            (char)(ch - 'A' + 'a');
+                    }
+                }
+            }
+            for (Py_ssize_t f = 0; f < cols->nfields; ++f) {
+                columns_put(cols, f, start + i, comps[f], base, scheme_off,
+                            scheme_off);
+            }
+        }
+    }
+    Py_END_ALLOW_THREADS
+    // clang-format on
+
+    url_scratch_free(&scratch);
+    PyMem_Free(bufs);
+    PyMem_Free(errors);
+    PyMem_Free(results);
+    PyMem_Free(line_starts);
+    PyMem_Free(line_lens);
+    if (failed != SIZE_MAX) {
+        PyErr_Format(PyExc_ValueError, "%s: %s in row %zu",
+                     split ? "urlsplit_columns" : "urlparse_columns",
+                     url_parse_strerror(failed_err), failed);
+        Py_DECREF(cols);
+        return NULL;
+    }
+    return (PyObject *)cols;
+
+error_cols:
+    PyMem_Free(line_starts);
+    PyMem_Free(line_lens);
+    Py_DECREF(cols); // owns data
+    return NULL;
+
+error:
+    PyMem_Free(line_starts);
+    PyMem_Free(line_lens);
+    Py_DECREF(data);
+    return NULL;
+}
+
+// abf_urlsplit_columns(urls: Iterable[str | bytes] | Buffer, scheme='',
+// allow_fragments=True, *, index_type='int64') -> UrlColumns
+static PyObject *abf_urlsplit_columns(PyObject *self, PyObject *args,
+                                      PyObject *kwargs) {
+    return parse_columns(module_state(self), args, kwargs, true);
+}
+
+// abf_urlparse_columns(urls: Iterable[str | bytes] | Buffer, scheme='',
+// allow_fragments=True, *, index_type='int64') -> UrlColumns
+static PyObject *abf_urlparse_columns(PyObject *self, PyObject *args,
+                                      PyObject *kwargs) {
+    return parse_columns(module_state(self), args, kwargs, false);
+}
+
+/*
+ * UrlStream: iterator over the urls of a file-like object (readinto or read)
+ * or an iterable of chunks, one url per line. Chunks are parsed by
+ * url_stream_t; each chunk's results are queued and handed out one by one.
+ */
+enum { STREAM_DEFAULT_CHUNK = 65536 };
+
+typedef struct {
+    PyObject_HEAD
+    url_stream_t stream;
+    PyObject *source;
+    PyObject *readinto; // bound method, or NULL
+    PyObject *read;     // bound method, or NULL
+    PyObject *iter;     // iterator over chunks, or NULL
+    PyObject *buffer;   // bytearray readinto() fills
+    PyObject *scheme;   // keeps the stream's scheme buffer alive
+    PyObject *pending;  // results of the current chunk
+    Py_ssize_t pending_pos;
+    Py_ssize_t chunk_size;
+    int is_bytes; // -1 until the first chunk decides the result type
+    bool eof;
+} UrlStreamObject;
+
+static int stream_on_url(void *ctx, const char *line, size_t line_len,
+                         const url_parse_result_t *result,
+                         url_parse_error_t err) {
+    UrlStreamObject *self = ctx;
+    (void)line;
+    (void)line_len;
+    if (err != URL_PARSE_OK) {
+        set_parse_error(err, "UrlStream");
+        return 1;
+    }
+    if (check_netloc(&result->netloc, self->is_bytes) < 0) {
+        return 1;
+    }
+    module_state_t *st = type_state(Py_TYPE(self));
+    PyObject *res;
+    if (self->stream.params) {
+        res = parse_result_to_pyobj(st, result, self->is_bytes, false);
+    } else {
+        url_split_result_t split = {
+            result->scheme,   result->netloc,       result->path,
+            result->query,    result->fragment,     result->netloc_parts,
+            result->source};
+        res = split_result_to_pyobj(st, &split, self->is_bytes, false);
+    }
+    if (!res) {
+        return 1;
+    }
+    int rc = PyList_Append(self->pending, res);
+    Py_DECREF(res);
+    return rc < 0;
+}
+
+static int stream_check_error(url_parse_error_t err) {
+    if (err == URL_PARSE_OK) {
+        return 0;
+    }
+    if (err == URL_PARSE_ERROR_OUT_OF_MEMORY) {
+        PyErr_NoMemory();
+    } else if (!PyErr_Occurred()) {
+        PyErr_SetString(PyExc_ValueError, "UrlStream: parse error");
+    }
+    return -1;
+}
+
+// Parse a str or bytes-like chunk where it is; str chunks give str results
+static Py_ssize_t stream_feed_chunk(UrlStreamObject *self, PyObject *chunk) {
+    const char *buf;
+    Py_ssize_t len;
+    Py_buffer view;
+    int is_bytes = get_url_buffer(chunk, &view, &buf, &len, "chunk");
+    if (is_bytes < 0) {
+        return -1;
+    }
+    if (self->is_bytes < 0) {
+        self->is_bytes = is_bytes;
+    } else if (self->is_bytes != is_bytes) {
+        PyErr_SetString(PyExc_TypeError, "Cannot mix str and bytes chunks");
+        len = -1;
+    }
+    if (len > 0 && stream_check_error(url_stream_feed(&self->stream, buf,
+                                                      (size_t)len)) < 0) {
+        len = -1;
+    }
+    PyBuffer_Release(&view);
+    return len;
+}
+
+// Helper: a non-blocking source had nothing to read. The stream is left as
+// it is, so next() can be called again once the source is readable.
+static int stream_would_block(void) {
+    PyErr_SetString(PyExc_BlockingIOError,
+                    "the url source would block; call next() again once it "
+                    "is readable");
+    return -1;
+}
+
+// Read and parse the next chunk, finishing the stream at EOF: an empty
+// read, or the end of a chunk iterator (whose empty chunks are skipped)
+static int stream_fill(UrlStreamObject *self) {
+    Py_ssize_t len;
+    bool eof;
+    if (self->readinto) {
+        PyObject *n =
+            PyObject_CallFunctionObjArgs(self->readinto, self->buffer, NULL);
+        if (!n) {
+            return -1;
+        }
+        if (n == Py_None) {
+            Py_DECREF(n);
+            return stream_would_block();
+        }
+        len = PyLong_AsSsize_t(n);
+        Py_DECREF(n);
+        if (len < 0) {
+            return -1;
+        }
+        self->is_bytes = 1;
+        if (len && stream_check_error(url_stream_feed(
+                       &self->stream, PyByteArray_AS_STRING(self->buffer),
+                       (size_t)len)) < 0) {
+            return -1;
+        }
+        eof = len == 0;
+    } else {
+        PyObject *chunk =
+            self->read ? PyObject_CallFunction(self->read, "n",
+                                               self->chunk_size)
+                       : PyIter_Next(self->iter);
+        if (!chunk) {
+            if (PyErr_Occurred()) {
+                return -1;
+            }
+            eof = true;
+        } else if (chunk == Py_None && self->read) {
+            Py_DECREF(chunk);
+            return stream_would_block();
+        } else {
+            len = stream_feed_chunk(self, chunk);
+            Py_DECREF(chunk);
+            if (len < 0) {
+                return -1;
+            }
+            eof = len == 0 && self->read;
+        }
+    }
+
+    if (eof) {
+        self->eof = true;
+        return stream_check_error(url_stream_finish(&self->stream));
+    }
+    return 0;
+}
+
+static PyObject *stream_next_locked(UrlStreamObject *self) {
+    while (self->pending_pos >= PyList_GET_SIZE(self->pending)) {
+        if (self->eof) {
+            return NULL;
+        }
+        if (PyList_SetSlice(self->pending, 0, PY_SSIZE_T_MAX, NULL) < 0) {
+            return NULL;
+        }
+        self->pending_pos = 0;
+        if (stream_fill(self) < 0) {
+            return NULL;
+        }
+    }
+    PyObject *res = PyList_GET_ITEM(self->pending, self->pending_pos);
+    self->pending_pos++;
+    Py_INCREF(res);
+    return res;
+}
+
+// Threads sharing a stream take turns: the parser state is not reentrant
+static PyObject *stream_iternext(PyObject *op) {
+    PyObject *res;
+    Py_BEGIN_CRITICAL_SECTION(op);
+    res = stream_next_locked((UrlStreamObject *)op);
+    Py_END_CRITICAL_SECTION();
+    return res;
+}
+
+static int stream_traverse(PyObject *op, visitproc visit, void *arg) {
+    UrlStreamObject *self = (UrlStreamObject *)op;
+    Py_VISIT(Py_TYPE(op));
+    Py_VISIT(self->source);
+    Py_VISIT(self->readinto);
+    Py_VISIT(self->read);
+    Py_VISIT(self->iter);
+    Py_VISIT(self->pending);
+    return 0;
+}
+
+static int stream_clear(PyObject *op) {
+    UrlStreamObject *self = (UrlStreamObject *)op;
+    Py_CLEAR(self->source);
+    Py_CLEAR(self->readinto);
+    Py_CLEAR(self->read);
+    Py_CLEAR(self->iter);
+    Py_CLEAR(self->pending);
+    return 0;
+}
+
+static void stream_dealloc(PyObject *op) {
+    UrlStreamObject *self = (UrlStreamObject *)op;
+    PyObject_GC_UnTrack(op);
+    stream_clear(op);
+    Py_CLEAR(self->buffer);
+    Py_CLEAR(self->scheme);
+    url_stream_free(&self->stream);
+    PyTypeObject *type = Py_TYPE(op);
+    type->tp_free(op);
+    Py_DECREF(type);
+}
+
+static PyType_Slot stream_slots[] = {
+    {Py_tp_doc, "Iterator over the parsed urls of a stream, one url per line"},
+    {Py_tp_dealloc, stream_dealloc},
+    {Py_tp_traverse, stream_traverse},
+    {Py_tp_clear, stream_clear},
+    {Py_tp_iter, PyObject_SelfIter},
+    {Py_tp_iternext, stream_iternext},
+    {0, NULL}};
+
+static PyType_Spec stream_spec = {
+    .name = "abf.urllib.parse.UrlStream",
+    .basicsize = sizeof(UrlStreamObject),
+    .flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC |
+             Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    .slots = stream_slots,
+};
+
+// Look up an attribute that may be missing: 1 found, 0 missing, -1 error
+static int get_optional_attr(PyObject *obj, const char *name,
+                             PyObject **result) {
+    *result = PyObject_GetAttrString(obj, name);
+    if (*result) {
+        return 1;
+    }
+    if (!PyErr_ExceptionMatches(PyExc_AttributeError)) {
+        return -1;
+    }
+    PyErr_Clear();
+    return 0;
+}
+
+// Shared body of iter_urlsplit / iter_urlparse
+static PyObject *parse_stream(module_state_t *st, PyObject *args,
+                              PyObject *kwargs, bool params) {
+    PyObject *source = NULL, *scheme_obj = NULL;
+    const char *scheme = NULL;
+    int allow_fragments = 1; // "p" stores an int
+    Py_ssize_t chunk_size = STREAM_DEFAULT_CHUNK;
+    static char *kwlist[] = {"source", "scheme", "allow_fragments",
+                             "chunk_size", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Op$n", kwlist, &source,
+                                     &scheme_obj, &allow_fragments,
+                                     &chunk_size) ||
+        get_scheme_from_pyobject(scheme_obj, &scheme) < 0) {
+        return NULL;
+    }
+    if (chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunk_size must be positive");
+        return NULL;
+    }
+
+    UrlStreamObject *self =
+        PyObject_GC_New(UrlStreamObject, st->UrlStreamType);
+    if (!self) {
+        return NULL;
+    }
+    url_stream_init(&self->stream, scheme, allow_fragments, params,
+                    stream_on_url, self);
+    Py_INCREF(source);
+    self->source = source;
+    self->readinto = self->read = self->iter = NULL;
+    self->scheme = scheme_obj;
+    Py_XINCREF(scheme_obj);
+    self->pending = PyList_New(0);
+    self->pending_pos = 0;
+    self->chunk_size = chunk_size;
+    self->is_bytes = -1;
+    self->eof = false;
+    self->buffer = PyByteArray_FromStringAndSize(NULL, chunk_size);
+    PyObject_GC_Track(self);
+    if (!self->pending || !self->buffer) {
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    // readinto fills our buffer directly; read() and plain iterables are
+    // copied into it, since parsing compacts unsafe bytes in place
+    if (get_optional_attr(source, "readinto", &self->readinto) <
+            0 ||
+        (!self->readinto &&
+         get_optional_attr(source, "read", &self->read) < 0)) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    if (!self->readinto && !self->read) {
+        self->iter = PyObject_GetIter(source);
+        if (!self->iter) {
+            Py_DECREF(self);
+            return NULL;
+        }
+    }
+    return (PyObject *)self;
+}
+
+// abf_iter_urlsplit(source, scheme='', allow_fragments=True, *,
+// chunk_size=65536) -> Iterator[SplitResult]
+static PyObject *abf_iter_urlsplit(PyObject *self, PyObject *args,
+                                   PyObject *kwargs) {
+    return parse_stream(module_state(self), args, kwargs, false);
+}
+
+// abf_iter_urlparse(source, scheme='', allow_fragments=True, *,
+// chunk_size=65536) -> Iterator[ParseResult]
+static PyObject *abf_iter_urlparse(PyObject *self, PyObject *args,
+                                   PyObject *kwargs) {
+    return parse_stream(module_state(self), args, kwargs, true);
+}
+
+// Quoting releases the GIL only when the copy is long enough to pay for it
+enum {
+    QUOTE_RELEASE_GIL_MIN_LEN = 4096,
+    QUOTER_CACHE_MAX = 128 // Quoters per cache, as urllib.parse's lru_cache
+};
+
+// Quoter: a compiled "safe" set. quote() caches one per safe argument, like
+// urllib.parse's _byte_quoter_factory
+typedef struct {
+    PyObject_HEAD
+    PyObject *safe;
+    url_quote_table_t table;
+} QuoterObject;
+
+static PyObject *quoter_create(PyTypeObject *type, PyObject *safe,
+                               bool plus) {
+    const char *safe_buf = NULL;
+    Py_ssize_t safe_len = 0;
+    if (get_buffer_from_pyobject(safe, &safe_buf, &safe_len, "safe") < 0) {
+        return NULL;
+    }
+    QuoterObject *q = (QuoterObject *)type->tp_alloc(type, 0);
+    if (!q) {
+        return NULL;
+    }
+    Py_INCREF(safe);
+    q->safe = safe;
+    url_quote_table_init(&q->table, safe_buf, (size_t)safe_len, plus);
+    return (PyObject *)q;
+}
+
+// New reference to the cached Quoter for safe (a strong one: without the
+// GIL another thread may be filling the cache)
+static QuoterObject *quoter_get(module_state_t *st, PyObject *safe,
+                                bool plus) {
+    PyObject *q;
+    if (!safe) {
+        q = plus ? st->default_plus_quoter : st->default_quoter;
+        Py_INCREF(q);
+        return (QuoterObject *)q;
+    }
+    // urllib.parse turns any other safe (a bytearray, ...) into bytes before
+    // its lru_cache; it is the cache key here too, so it must be hashable
+    PyObject *copy = NULL;
+    if (!PyUnicode_Check(safe) && !PyBytes_Check(safe)) {
+        safe = copy = PyBytes_FromObject(safe);
+        if (!copy) {
+            return NULL;
+        }
+    }
+    PyObject *cache = plus ? st->quoter_plus_cache : st->quoter_cache;
+    q = PyDict_GetItemWithError(cache, safe);
+    if (q || PyErr_Occurred()) {
+        Py_XINCREF(q);
+        Py_XDECREF(copy);
+        return (QuoterObject *)q;
+    }
+    PyObject *created = quoter_create(st->QuoterType, safe, plus);
+    if (!created) {
+        Py_XDECREF(copy);
+        return NULL;
+    }
+    // Distinct safe values are unbounded: start over rather than grow
+    if (PyDict_GET_SIZE(cache) >= QUOTER_CACHE_MAX) {
+        PyDict_Clear(cache);
+    }
+    // The first of racing threads wins, the others use its Quoter
+    q = PyDict_SetDefault(cache, safe, created);
+    Py_XINCREF(q);
+    Py_DECREF(created);
+    Py_XDECREF(copy);
+    return (QuoterObject *)q;
+}
+
+// Quote str (encoded with encoding/errors, UTF-8 by default) or bytes into a
+// new ASCII str, written in place into the result object
+static PyObject *quoter_quote(QuoterObject *q, PyObject *string,
+                              PyObject *encoding, PyObject *errors) {
+    PyObject *encoded = NULL;
+    const char *buf = NULL;
+    Py_ssize_t len = 0;
+    bool has_encoding = encoding && encoding != Py_None;
+    bool has_errors = errors && errors != Py_None;
+
+    if (PyUnicode_Check(string) && (has_encoding || has_errors)) {
+        const char *enc = has_encoding ? PyUnicode_AsUTF8(encoding) : "utf-8";
+        const char *err = has_errors ? PyUnicode_AsUTF8(errors) : "strict";
+        if (!enc || !err) {
+            return NULL;
+        }
+        encoded = PyUnicode_AsEncodedString(string, enc, err);
+        if (!encoded) {
+            return NULL;
+        }
+        buf = PyBytes_AS_STRING(encoded);
+        len = PyBytes_GET_SIZE(encoded);
+    } else {
+        if (!PyUnicode_Check(string) && (has_encoding || has_errors)) {
+            PyErr_Format(PyExc_TypeError,
+                         "quote() doesn't support '%s' for bytes",
+                         has_encoding ? "encoding" : "errors");
+            return NULL;
+        }
+        if (PyByteArray_Check(string)) {
+            // A bytearray can change size while the GIL is released; quote
+            // a copy
+            string = encoded = PyBytes_FromObject(string);
+            if (!encoded) {
+                return NULL;
+            }
+        }
+        if (get_buffer_from_pyobject(string, &buf, &len, "string") < 0) {
+            Py_XDECREF(encoded);
+            return NULL;
+        }
+    }
+
+    size_t needed = url_quote_len(buf, (size_t)len, &q->table);
+    if (needed == (size_t)len && !encoded && PyUnicode_CheckExact(string) &&
+        PyUnicode_IS_ASCII(string) &&
+        !(q->table.space_plus && memchr(buf, ' ', (size_t)len))) {
+        // Nothing to quote (a space keeps the length as '+')
+        Py_INCREF(string);
+        return string;
+    }
+
+    PyObject *res = PyUnicode_New((Py_ssize_t)needed, 127);
+    if (res) {
+        char *out = (char *)PyUnicode_1BYTE_DATA(res);
+        // clang-format off
+        if (needed >= QUOTE_RELEASE_GIL_MIN_LEN) {
+            Py_BEGIN_ALLOW_THREADS
+            url_quote_write(buf, (size_t)len, &q->table, out);
+            Py_END_ALLOW_THREADS
+        } else {
+            url_quote_write(buf, (size_t)len, &q->table, out);
+        }
+        // clang-format on
+    }
+    Py_XDECREF(encoded);
+    return res;
+}
+
+// Quote with the cached Quoter for safe
+static PyObject *quoter_get_quote(PyObject *module, PyObject *safe,
+                                  bool plus, PyObject *string,
+                                  PyObject *encoding, PyObject *errors) {
+    QuoterObject *q = quoter_get(module_state(module), safe, plus);
+    if (!q) {
+        return NULL;
+    }
+    PyObject *res = quoter_quote(q, string, encoding, errors);
+    Py_DECREF(q);
+    return res;
+}
+
+static PyObject *quoter_new(PyTypeObject *type, PyObject *args,
+                            PyObject *kwargs) {
+    PyObject *safe = NULL;
+    int plus = 0; // "p" stores an int
+    static char *kwlist[] = {"safe", "plus", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O$p", kwlist, &safe,
+                                     &plus)) {
+        return NULL;
+    }
+    if (!safe) {
+        // Same defaults as quote() and quote_plus()
+        safe = PyUnicode_FromString(plus ? "" : "/");
+        if (!safe) {
+            return NULL;
+        }
+        PyObject *q = quoter_create(type, safe, plus);
+        Py_DECREF(safe);
+        return q;
+    }
+    return quoter_create(type, safe, plus);
+}
+
+static PyObject *quoter_get_plus(PyObject *self, void *closure) {
+    (void)closure;
+    return PyBool_FromLong(((QuoterObject *)self)->table.space_plus);
+}
+
+static PyGetSetDef quoter_getset[] = {
+    {"plus", quoter_get_plus, NULL, "Whether spaces are quoted as '+'", NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
+
+// Quoter.__call__(string, encoding=None, errors=None) -> str
+static PyObject *quoter_call(PyObject *self, PyObject *args,
+                             PyObject *kwargs) {
+    PyObject *string = NULL, *encoding = NULL, *errors = NULL;
+    static char *kwlist[] = {"string", "encoding", "errors", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OO", kwlist, &string,
+                                     &encoding, &errors)) {
+        return NULL;
+    }
+    return quoter_quote((QuoterObject *)self, string, encoding, errors);
+}
+
+static void quoter_dealloc(PyObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+    Py_XDECREF(((QuoterObject *)self)->safe);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+static PyMemberDef quoter_members[] = {
+    {"safe", T_OBJECT, offsetof(QuoterObject, safe), READONLY,
+     "Extra characters that are not quoted"},
+    {NULL, 0, 0, 0, NULL}};
+
+static PyType_Slot quoter_slots[] = {
+    {Py_tp_doc, "Quoter(safe='/', *, plus=False): callable that "
+                "percent-encodes str or bytes"},
+    {Py_tp_new, quoter_new},
+    {Py_tp_call, quoter_call},
+    {Py_tp_dealloc, quoter_dealloc},
+    {Py_tp_members, quoter_members},
+    {Py_tp_getset, quoter_getset},
+    {0, NULL}};
+
+static PyType_Spec quoter_spec = {
+    .name = "abf.urllib.parse.Quoter",
+    .basicsize = sizeof(QuoterObject),
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = quoter_slots,
+};
+
+// abf_url_quote(string: str | bytes, safe: str = '/', encoding=None,
+// errors=None) -> str
+static PyObject *abf_url_quote(PyObject *self, PyObject *const *args,
+                               Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "quote",
+        .names = {"string", "safe", "encoding", "errors", NULL},
+        .required = 1,
+        .max_positional = 4};
+    PyObject *argv[4];
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0) {
+        return NULL;
+    }
+
+    return quoter_get_quote(self, argv[1], false, argv[0], argv[2], argv[3]);
+}
+
+// abf_quote_plus(string: str | bytes, safe: str = '', encoding=None,
+// errors=None) -> str
+static PyObject *abf_quote_plus(PyObject *self, PyObject *const *args,
+                                Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "quote_plus",
+        .names = {"string", "safe", "encoding", "errors", NULL},
+        .required = 1,
+        .max_positional = 4};
+    PyObject *argv[4];
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0) {
+        return NULL;
+    }
+
+    return quoter_get_quote(self, argv[1], true, argv[0], argv[2], argv[3]);
+}
+
+// abf_quote_from_bytes(bs: bytes | bytearray, safe: str = '/') -> str
+static PyObject *abf_quote_from_bytes(PyObject *self, PyObject *const *args,
+                                      Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "quote_from_bytes",
+        .names = {"bs", "safe", NULL},
+        .required = 1,
+        .max_positional = 2};
+    PyObject *argv[2];
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0) {
+        return NULL;
+    }
+    PyObject *bs = argv[0], *safe = argv[1];
+    if (!PyBytes_Check(bs) && !PyByteArray_Check(bs)) {
+        PyErr_SetString(PyExc_TypeError, "quote_from_bytes() expected bytes");
+        return NULL;
+    }
+
+    return quoter_get_quote(self, safe, false, bs, NULL, NULL);
+}
+
+// Unquoting: the decoded bytes are never longer than the input, so one
+// scratch buffer of the input's size is enough
+static bool is_utf8_encoding(const char *encoding) {
+    char norm[8];
+    size_t n = 0;
+    for (; *encoding; ++encoding) {
+        if (*encoding == '-' || *encoding == '_') {
+            continue;
+        }
+        if (n == sizeof(norm) - 1) {
+            return false;
+        }
+        norm[n++] = (char)(*encoding | 0x20); // ASCII lowercase
+    }
+    norm[n] = '\0';
+    return strcmp(norm, "utf8") == 0;
+}
+
+// Decode buf into out, releasing the GIL for long inputs
+static size_t unquote_buffer(const char *buf, size_t len, bool plus,
+                             char *out) {
+    size_t out_len;
+    // clang-format off
+    if (len >= QUOTE_RELEASE_GIL_MIN_LEN) {
+        Py_BEGIN_ALLOW_THREADS
+        out_len = url_unquote(buf, len, plus, out);
+        Py_END_ALLOW_THREADS
+    } else {
+        out_len = url_unquote(buf, len, plus, out);
+    }
+    // clang-format on
+    return out_len;
+}
+
+static PyObject *unquote_impl(const fast_args_t *spec,
+                              PyObject *const *args, Py_ssize_t nargs,
+                              PyObject *kwnames, bool plus) {
+    PyObject *argv[3];
+    if (fast_args_parse(spec, args, nargs, kwnames, argv) < 0) {
+        return NULL;
+    }
+    PyObject *string = argv[0], *encoding_obj = argv[1], *errors_obj = argv[2];
+    const char *encoding = "utf-8", *errors = "replace";
+    if ((encoding_obj && encoding_obj != Py_None &&
+         !(encoding = PyUnicode_AsUTF8(encoding_obj))) ||
+        (errors_obj && errors_obj != Py_None &&
+         !(errors = PyUnicode_AsUTF8(errors_obj)))) {
+        return NULL;
+    }
+
+    const char *buf = NULL;
+    Py_ssize_t len = 0;
+    int is_bytes = get_buffer_from_pyobject(string, &buf, &len, "string");
+    if (is_bytes < 0) {
+        return NULL;
+    }
+    bool utf8 = is_utf8_encoding(encoding);
+    if (!is_bytes && url_unquote_find(buf, (size_t)len, plus) == (size_t)len) {
+        // Nothing to decode
+        Py_INCREF(string);
+        return string;
+    }
+    if (!is_bytes && !utf8 && !PyUnicode_IS_ASCII(string)) {
+        // urllib.parse decodes only the ASCII runs of the str, which its
+        // UTF-8 buffer cannot reproduce for other codecs
+        PyObject *call_args = Py_BuildValue("(Oss)", string, encoding, errors);
+        if (!call_args) {
+            return NULL;
+        }
+        PyObject *res =
+            stdlib_call(plus ? "unquote_plus" : "unquote", call_args, NULL);
+        Py_DECREF(call_args);
+        return res;
+    }
+
+    char *out = PyMem_Malloc(len ? (size_t)len : 1);
+    if (!out) {
+        return PyErr_NoMemory();
+    }
+    size_t out_len = unquote_buffer(buf, (size_t)len, plus, out);
+    PyObject *res =
+        utf8 ? PyUnicode_DecodeUTF8(out, (Py_ssize_t)out_len, errors)
+             : PyUnicode_Decode(out, (Py_ssize_t)out_len, encoding, errors);
+    PyMem_Free(out);
+    return res;
+}
+
+// abf_unquote(string: str | bytes, encoding='utf-8', errors='replace') -> str
+static PyObject *abf_unquote(PyObject *self, PyObject *const *args,
+                             Py_ssize_t nargs, PyObject *kwnames) {
+    (void)self;
+    static const fast_args_t spec = {
+        .fname = "unquote",
+        .names = {"string", "encoding", "errors", NULL},
+        .required = 1,
+        .max_positional = 3};
+    return unquote_impl(&spec, args, nargs, kwnames, false);
+}
+
+// abf_unquote_plus(string: str | bytes, encoding='utf-8', errors='replace')
+// -> str
+static PyObject *abf_unquote_plus(PyObject *self, PyObject *const *args,
+                                  Py_ssize_t nargs, PyObject *kwnames) {
+    (void)self;
+    static const fast_args_t spec = {
+        .fname = "unquote_plus",
+        .names = {"string", "encoding", "errors", NULL},
+        .required = 1,
+        .max_positional = 3};
+    return unquote_impl(&spec, args, nargs, kwnames, true);
+}
+
+// abf_unquote_to_bytes(string: str | bytes) -> bytes
+static PyObject *abf_unquote_to_bytes(PyObject *self, PyObject *const *args,
+                                      Py_ssize_t nargs, PyObject *kwnames) {
+    (void)self;
+    static const fast_args_t spec = {
+        .fname = "unquote_to_bytes",
+        .names = {"string", NULL},
+        .required = 1,
+        .max_positional = 1};
+    PyObject *string;
+    if (fast_args_parse(&spec, args, nargs, kwnames, &string) < 0) {
+        return NULL;
+    }
+    const char *buf = NULL;
+    Py_ssize_t len = 0;
+    int is_bytes = get_buffer_from_pyobject(string, &buf, &len, "string");
+    if (is_bytes < 0) {
+        return NULL;
+    }
+    size_t first = url_unquote_find(buf, (size_t)len, false);
+    if (first == (size_t)len) {
+        if (PyBytes_CheckExact(string)) {
+            Py_INCREF(string);
+            return string;
+        }
+        return PyBytes_FromStringAndSize(buf, len);
+    }
+
+    PyObject *res = PyBytes_FromStringAndSize(NULL, len);
+    if (!res) {
+        return NULL;
+    }
+    // The prefix before the first '%' is copied as is
+    char *out = PyBytes_AS_STRING(res);
+    memcpy(out, buf, first);
+    size_t out_len =
+        first + unquote_buffer(buf + first, (size_t)len - first, false,
+                               out + first);
+    if (_PyBytes_Resize(&res, (Py_ssize_t)out_len) < 0) {
+        return NULL;
+    }
+    return res;
+}
+
+// urlencode: the first pass turns every key and value into a piece (a
+// buffer plus its exact quoted length), the second writes all pieces into
+// one preallocated str
+typedef struct {
+    PyObject *owner; // keeps buf alive
+    const char *buf;
+    size_t len;
+    size_t quoted_len;
+} urlencode_piece_t;
+
+typedef struct {
+    urlencode_piece_t *pieces;
+    size_t count;
+    size_t cap;
+    const url_quote_table_t *table;
+    const char *encoding; // NULL for UTF-8 / strict
+    const char *errors;
+} urlencode_t;
+
+static int urlencode_push(urlencode_t *ue, PyObject *owner, const char *buf,
+                          Py_ssize_t len) {
+    if (ue->count == ue->cap) {
+        size_t cap = ue->cap ? ue->cap * 2 : 16;
+        urlencode_piece_t *pieces =
+            PyMem_Realloc(ue->pieces, cap * sizeof(*pieces));
+        if (!pieces) {
+            Py_DECREF(owner);
+            PyErr_NoMemory();
+            return -1;
+        }
+        ue->pieces = pieces;
+        ue->cap = cap;
+    }
+    urlencode_piece_t *piece = &ue->pieces[ue->count++];
+    piece->owner = owner; // steals the reference
+    piece->buf = buf;
+    piece->len = (size_t)len;
+    piece->quoted_len = url_quote_len(buf, (size_t)len, ue->table);
+    return 0;
+}
+
+// Add a key or value: bytes as is, anything else as str(obj) encoded
+static int urlencode_add(urlencode_t *ue, PyObject *obj) {
+    if (PyBytes_Check(obj)) {
+        Py_INCREF(obj);
+        return urlencode_push(ue, obj, PyBytes_AS_STRING(obj),
+                              PyBytes_GET_SIZE(obj));
+    }
+    PyObject *str = PyUnicode_Check(obj) ? (Py_INCREF(obj), obj)
+                                         : PyObject_Str(obj);
+    if (!str) {
+        return -1;
+    }
+    if (ue->encoding || ue->errors) {
+        PyObject *encoded = PyUnicode_AsEncodedString(
+            str, ue->encoding ? ue->encoding : "utf-8",
+            ue->errors ? ue->errors : "strict");
+        Py_DECREF(str);
+        if (!encoded) {
+            return -1;
+        }
+        return urlencode_push(ue, encoded, PyBytes_AS_STRING(encoded),
+                              PyBytes_GET_SIZE(encoded));
+    }
+    Py_ssize_t len;
+    const char *buf = PyUnicode_AsUTF8AndSize(str, &len);
+    if (!buf) {
+        Py_DECREF(str);
+        return -1;
+    }
+    return urlencode_push(ue, str, buf, len);
+}
+
+// Add the pairs of one key; with doseq a non-string sequence value gives one
+// pair per element, like urllib.parse.urlencode
+static int urlencode_add_pair(urlencode_t *ue, PyObject *k, PyObject *v,
+                              bool doseq) {
+    if (!doseq || PyBytes_Check(v) || PyUnicode_Check(v)) {
+        return urlencode_add(ue, k) < 0 || urlencode_add(ue, v) < 0 ? -1 : 0;
+    }
+    if (PyObject_Size(v) < 0) {
+        if (!PyErr_ExceptionMatches(PyExc_TypeError)) {
+            return -1;
+        }
+        PyErr_Clear(); // not a sequence
+        return urlencode_add(ue, k) < 0 || urlencode_add(ue, v) < 0 ? -1 : 0;
+    }
+    PyObject *it = PyObject_GetIter(v);
+    if (!it) {
+        return -1;
+    }
+    PyObject *elt;
+    while ((elt = PyIter_Next(it))) {
+        int rc = urlencode_add(ue, k) < 0 || urlencode_add(ue, elt) < 0;
+        Py_DECREF(elt);
+        if (rc) {
+            Py_DECREF(it);
+            return -1;
+        }
+    }
+    Py_DECREF(it);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+static int urlencode_add_item(urlencode_t *ue, PyObject *item, bool doseq) {
+    PyObject *pair = PySequence_Fast(item, "cannot unpack non-iterable object");
+    if (!pair) {
+        return -1;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(pair);
+    int rc = -1;
+    if (n != 2) {
+        PyErr_Format(PyExc_ValueError,
+                     n < 2 ? "not enough values to unpack (expected 2, got %zd)"
+                           : "too many values to unpack (expected 2)",
+                     n);
+    } else {
+        rc = urlencode_add_pair(ue, PySequence_Fast_GET_ITEM(pair, 0),
+                                PySequence_Fast_GET_ITEM(pair, 1), doseq);
+    }
+    Py_DECREF(pair);
+    return rc;
+}
+
+static int urlencode_collect(urlencode_t *ue, PyObject *query, bool doseq) {
+    if (PyDict_CheckExact(query)) {
+        Py_ssize_t pos = 0;
+        PyObject *k, *v;
+        while (PyDict_Next(query, &pos, &k, &v)) {
+            Py_INCREF(k);
+            Py_INCREF(v);
+            int rc = urlencode_add_pair(ue, k, v, doseq);
+            Py_DECREF(k);
+            Py_DECREF(v);
+            if (rc < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    PyObject *items;
+    int has_items = get_optional_attr(query, "items", &items);
+    if (has_items < 0) {
+        return -1;
+    }
+    if (has_items) {
+        PyObject *view = PyObject_CallNoArgs(items);
+        Py_DECREF(items);
+        if (!view) {
+            return -1;
+        }
+        items = view;
+    } else {
+        // Same check as urllib.parse: a sequence of tuples, not a string
+        Py_ssize_t n = PyObject_Size(query);
+        PyObject *first = n > 0 ? PySequence_GetItem(query, 0) : NULL;
+        bool valid = n == 0 || (first && PyTuple_Check(first));
+        Py_XDECREF(first);
+        if (!valid) {
+            if (PyErr_Occurred() &&
+                !PyErr_ExceptionMatches(PyExc_TypeError)) {
+                return -1;
+            }
+            PyErr_Clear();
+            PyErr_SetString(PyExc_TypeError,
+                            "not a valid non-string sequence or mapping "
+                            "object");
+            return -1;
+        }
+        Py_INCREF(query);
+        items = query;
+    }
+
+    PyObject *it = PyObject_GetIter(items);
+    Py_DECREF(items);
+    if (!it) {
+        return -1;
+    }
+    PyObject *item;
+    while ((item = PyIter_Next(it))) {
+        int rc = urlencode_add_item(ue, item, doseq);
+        Py_DECREF(item);
+        if (rc < 0) {
+            Py_DECREF(it);
+            return -1;
+        }
+    }
+    Py_DECREF(it);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+// Write key=value pairs joined by '&'; out holds exactly the needed bytes
+static void urlencode_write(const urlencode_t *ue, char *out) {
+    for (size_t i = 0; i < ue->count; ++i) {
+        const urlencode_piece_t *piece = &ue->pieces[i];
+        if (i) {
+            *out++ = i % 2 ? '=' : '&';
+        }
+        url_quote_write(piece->buf, piece->len, ue->table, out);
+        out += piece->quoted_len;
+    }
+}
+
+// Encoding and errors only matter when they differ from UTF-8 / strict
+static int urlencode_codec(PyObject *obj, bool is_encoding,
+                           const char **out) {
+    *out = NULL;
+    if (!obj || obj == Py_None) {
+        return 0;
+    }
+    const char *name = PyUnicode_AsUTF8(obj);
+    if (!name) {
+        return -1;
+    }
+    if (is_encoding ? !is_utf8_encoding(name) : strcmp(name, "strict") != 0) {
+        *out = name;
+    }
+    return 0;
+}
+
+// abf_urlencode(query, doseq=False, safe='', encoding=None, errors=None,
+// quote_via=quote_plus) -> str
+static PyObject *abf_urlencode(PyObject *self, PyObject *args,
+                               PyObject *kwargs) {
+    PyObject *query = NULL, *safe = NULL, *encoding = NULL, *errors = NULL;
+    PyObject *quote_via = NULL;
+    int doseq = 0; // "p" stores an int
+    static char *kwlist[] = {"query",  "doseq",     "safe", "encoding",
+                             "errors", "quote_via", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|pOOOO", kwlist, &query,
+                                     &doseq, &safe, &encoding, &errors,
+                                     &quote_via)) {
+        return NULL;
+    }
+
+    module_state_t *st = module_state(self);
+    bool plus = !quote_via || quote_via == st->quote_via_plus[0] ||
+                quote_via == st->quote_via_plus[1];
+    if (!plus) {
+        if (quote_via != st->quote_via_quote[0] &&
+            quote_via != st->quote_via_quote[1]) {
+            // A custom quote_via: leave it to urllib.parse
+            return stdlib_call("urlencode", args, kwargs);
+        }
+    }
+
+    urlencode_t ue = {0};
+    if (urlencode_codec(encoding, true, &ue.encoding) < 0 ||
+        urlencode_codec(errors, false, &ue.errors) < 0) {
+        return NULL;
+    }
+    PyObject *empty = NULL;
+    if (!safe) {
+        // urlencode's default safe is '' for quote as well as quote_plus
+        safe = empty = PyUnicode_FromStringAndSize(NULL, 0);
+        if (!empty) {
+            return NULL;
+        }
+    }
+    QuoterObject *q = quoter_get(st, safe, plus);
+    Py_XDECREF(empty);
+    if (!q) {
+        return NULL;
+    }
+    ue.table = &q->table;
+
+    PyObject *res = NULL;
+    if (urlencode_collect(&ue, query, doseq) == 0) {
+        size_t needed = ue.count ? ue.count - 1 : 0; // '=' and '&'
+        for (size_t i = 0; i < ue.count; ++i) {
+            needed += ue.pieces[i].quoted_len;
+        }
+        res = PyUnicode_New((Py_ssize_t)needed, 127);
+        if (res) {
+            char *out = (char *)PyUnicode_1BYTE_DATA(res);
+            // clang-format off
+            if (needed >= QUOTE_RELEASE_GIL_MIN_LEN) {
+                Py_BEGIN_ALLOW_THREADS
+                urlencode_write(&ue, out);
+                Py_END_ALLOW_THREADS
+            } else {
+                urlencode_write(&ue, out);
+            }
+            // clang-format on
+        }
+    }
+    for (size_t i = 0; i < ue.count; ++i) {
+        Py_DECREF(ue.pieces[i].owner);
+    }
+    PyMem_Free(ue.pieces);
+    Py_DECREF(q);
+    return res;
+}
+
+// parse_qsl / parse_qs: fields are located by url_query_next() directly in
+// the query buffer; only names and values with '%' or '+' are unquoted
+typedef struct {
+    bool keep_blank_values;
+    bool strict_parsing;
+    bool spans;
+    bool utf8;
+    bool raw_bytes; // see module_state_t.qs_raw_bytes
+    int is_bytes;
+    const char *encoding;
+    const char *errors;
+    const char *query;
+    char *scratch; // unquoting buffer, as long as the query
+    // spans of a non-ASCII str count code points, not UTF-8 bytes
+    bool count_chars;
+    size_t span_byte;
+    Py_ssize_t span_char;
+} qs_parser_t;
+
+// Code point offset of byte offset `byte` (offsets only ever increase)
+static Py_ssize_t qs_char_offset(qs_parser_t *qp, size_t byte) {
+    if (!qp->count_chars) {
+        return (Py_ssize_t)byte;
+    }
+    for (; qp->span_byte < byte; ++qp->span_byte) {
+        // UTF-8 continuation bytes do not start a code point
+        qp->span_char += ((unsigned char)qp->query[qp->span_byte] & 0xC0) !=
+                         0x80;
+    }
+    return qp->span_char;
+}
+
+static PyObject *qs_decode(qs_parser_t *qp, const url_component_t *part,
+                           uint8_t escapes) {
+    const char *buf = part->start;
+    Py_ssize_t len = (Py_ssize_t)part->length;
+    if (escapes) {
+        len = (Py_ssize_t)url_unquote(buf, part->length, true, qp->scratch);
+        buf = qp->scratch;
+    }
+    if (qp->is_bytes &&
+        (qp->raw_bytes || !(escapes & URL_QUERY_PERCENT))) {
+        // Raw bytes, or ASCII in and ASCII out
+        return PyBytes_FromStringAndSize(buf, len);
+    }
+    if (!(escapes & URL_QUERY_PERCENT)) {
+        return PyUnicode_DecodeUTF8(buf, len, NULL);
+    }
+    PyObject *str = qp->utf8 ? PyUnicode_DecodeUTF8(buf, len, qp->errors)
+                             : PyUnicode_Decode(buf, len, qp->encoding,
+                                                qp->errors);
+    if (!str || !qp->is_bytes) {
+        return str;
+    }
+    // Like urllib.parse, a bytes query gives ASCII-encoded results
+    PyObject *res = PyUnicode_AsASCIIString(str);
+    Py_DECREF(str);
+    return res;
+}
+
+// The (name, value) pair of a field, or its byte spans in spans mode
+static PyObject *qs_pair(qs_parser_t *qp, const url_query_field_t *field) {
+    if (qp->spans) {
+        size_t name_off = (size_t)(field->name.start - qp->query);
+        size_t value_off = (size_t)(field->value.start - qp->query);
+        Py_ssize_t name_start = qs_char_offset(qp, name_off);
+        Py_ssize_t name_end = qs_char_offset(qp, name_off + field->name.length);
+        Py_ssize_t value_start = qs_char_offset(qp, value_off);
+        Py_ssize_t value_end =
+            qs_char_offset(qp, value_off + field->value.length);
+        const Py_ssize_t span[4] = {name_start, name_end - name_start,
+                                    value_start, value_end - value_start};
+        PyObject *tuple = PyTuple_New(4);
+        for (Py_ssize_t i = 0; tuple && i < 4; ++i) {
+            PyObject *n = PyLong_FromSsize_t(span[i]);
+            if (!n) {
+                Py_CLEAR(tuple);
+                break;
+            }
+            PyTuple_SET_ITEM(tuple, i, n);
+        }
+        return tuple;
+    }
+    PyObject *name = qs_decode(qp, &field->name, field->name_escapes);
+    if (!name) {
+        return NULL;
+    }
+    PyObject *value = qs_decode(qp, &field->value, field->value_escapes);
+    if (!value) {
+        Py_DECREF(name);
+        return NULL;
+    }
+    PyObject *pair = PyTuple_Pack(2, name, value);
+    Py_DECREF(name);
+    Py_DECREF(value);
+    return pair;
+}
+
+// Same field rules as urllib.parse.parse_qsl; 1 keep, 0 skip, -1 error
+static int qs_keep_field(qs_parser_t *qp, const url_query_field_t *field) {
+    if (!field->has_value) {
+        if (!field->name.length && !qp->strict_parsing) {
+            return 0;
+        }
+        if (qp->strict_parsing) {
+            // urllib.parse reports the field as it splits it
+            PyObject *text =
+                qp->is_bytes && qp->raw_bytes
+                    ? PyBytes_FromStringAndSize(
+                          field->name.start, (Py_ssize_t)field->name.length)
+                    : PyUnicode_DecodeUTF8(field->name.start,
+                                           (Py_ssize_t)field->name.length,
+                                           NULL);
+            if (text) {
+                PyErr_Format(PyExc_ValueError, "bad query field: %R", text);
+                Py_DECREF(text);
+            }
+            return -1;
+        }
+    }
+    return field->value.length || qp->keep_blank_values;
+}
+
+// Run the parser over the query, passing each kept pair to add(); returns
+// 0, or -1 with an exception set
+static int qs_run(qs_parser_t *qp, Py_ssize_t len, char separator,
+                  Py_ssize_t max_num_fields,
+                  int (*add)(void *ctx, PyObject *pair), void *ctx) {
+    if (max_num_fields >= 0) {
+        // Checked up front, like urllib.parse, before any field is decoded
+        Py_ssize_t num_fields = 0;
+        if (len) {
+            const char *p = qp->query, *end = qp->query + len;
+            for (num_fields = 1;
+                 (p = memchr(p, separator, (size_t)(end - p))); ++p) {
+                num_fields++;
+            }
+        }
+        if (max_num_fields < num_fields) {
+            PyErr_SetString(PyExc_ValueError, "Max number of fields exceeded");
+            return -1;
+        }
+    }
+
+    url_query_iter_t it;
+    url_query_field_t field;
+    url_query_iter_init(&it, qp->query, (size_t)len, separator);
+    while (url_query_next(&it, &field)) {
+        int keep = qs_keep_field(qp, &field);
+        if (keep < 0) {
+            return -1;
+        }
+        if (!keep) {
+            continue;
+        }
+        PyObject *pair = qs_pair(qp, &field);
+        if (!pair) {
+            return -1;
+        }
+        int rc = add(ctx, pair);
+        Py_DECREF(pair);
+        if (rc < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int qs_add_to_list(void *ctx, PyObject *pair) {
+    return PyList_Append((PyObject *)ctx, pair);
+}
+
+static int qs_add_to_dict(void *ctx, PyObject *pair) {
+    PyObject *name = PyTuple_GET_ITEM(pair, 0);
+    PyObject *value = PyTuple_GET_ITEM(pair, 1);
+    PyObject *values = PyDict_GetItemWithError((PyObject *)ctx, name);
+    if (values) {
+        return PyList_Append(values, value);
+    }
+    if (PyErr_Occurred()) {
+        return -1;
+    }
+    values = PyList_New(1);
+    if (!values) {
+        return -1;
+    }
+    Py_INCREF(value);
+    PyList_SET_ITEM(values, 0, value);
+    int rc = PyDict_SetItem((PyObject *)ctx, name, values);
+    Py_DECREF(values);
+    return rc;
+}
+
+// Shared body of parse_qsl (as_dict false) and parse_qs
+static PyObject *parse_query(module_state_t *st, PyObject *args,
+                             PyObject *kwargs, bool as_dict) {
+    PyObject *qs = NULL, *encoding_obj = NULL, *errors_obj = NULL;
+    PyObject *max_obj = Py_None, *separator_obj = NULL;
+    int keep_blank_values = 0, strict_parsing = 0, spans = 0; // "p": int
+    static char *kwlist[] = {"qs",        "keep_blank_values",
+                             "strict_parsing", "encoding",
+                             "errors",    "max_num_fields",
+                             "separator", "spans",
+                             NULL};
+    // parse_qs has no spans keyword
+    static char *qs_kwlist[] = {"qs",        "keep_blank_values",
+                                "strict_parsing", "encoding",
+                                "errors",    "max_num_fields",
+                                "separator", NULL};
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwargs, as_dict ? "O|ppOOOO" : "O|ppOOOO$p",
+            as_dict ? qs_kwlist : kwlist, &qs, &keep_blank_values,
+            &strict_parsing, &encoding_obj, &errors_obj, &max_obj,
+            &separator_obj, &spans)) {
+        return NULL;
+    }
+
+    qs_parser_t qp = {.keep_blank_values = keep_blank_values,
+                      .strict_parsing = strict_parsing,
+                      .spans = spans,
+                      .raw_bytes = st->qs_raw_bytes,
+                      .encoding = "utf-8",
+                      .errors = "replace"};
+    if ((encoding_obj && encoding_obj != Py_None &&
+         !(qp.encoding = PyUnicode_AsUTF8(encoding_obj))) ||
+        (errors_obj && errors_obj != Py_None &&
+         !(qp.errors = PyUnicode_AsUTF8(errors_obj)))) {
+        return NULL;
+    }
+    qp.utf8 = is_utf8_encoding(qp.encoding);
+    Py_ssize_t max_num_fields = -1;
+    if (max_obj != Py_None &&
+        (max_num_fields = PyLong_AsSsize_t(max_obj)) == -1 &&
+        PyErr_Occurred()) {
+        return NULL;
+    }
+
+    const char *buf;
+    Py_ssize_t len;
+    if (!PyUnicode_Check(qs) && !PyBytes_Check(qs)) {
+        if (spans) {
+            PyErr_SetString(PyExc_TypeError, "qs must be str or bytes");
+            return NULL;
+        }
+        return stdlib_call(as_dict ? "parse_qs" : "parse_qsl", args, kwargs);
+    }
+    qp.is_bytes = get_buffer_from_pyobject(qs, &buf, &len, "qs");
+    if (qp.is_bytes < 0) {
+        return NULL;
+    }
+    qp.query = buf;
+    if (qp.is_bytes) {
+        // urllib.parse decodes a bytes query as ASCII first, unless it
+        // leaves it as bytes
+        for (Py_ssize_t i = 0; !qp.raw_bytes && i < len; ++i) {
+            if ((unsigned char)buf[i] >= 0x80) {
+                Py_XDECREF(PyUnicode_DecodeASCII(buf, len, "strict"));
+                return NULL;
+            }
+        }
+    } else if (!PyUnicode_IS_ASCII(qs)) {
+        if (!qp.utf8 && !spans) {
+            // See unquote_impl: the codec only sees the ASCII runs
+            return stdlib_call(as_dict ? "parse_qs" : "parse_qsl", args,
+                               kwargs);
+        }
+        qp.count_chars = true;
+    }
+
+    char separator = '&';
+    if (separator_obj) {
+        const char *sep_buf;
+        Py_ssize_t sep_len;
+        if (!(PyUnicode_Check(separator_obj) ||
+              PyBytes_Check(separator_obj)) ||
+            get_buffer_from_pyobject(separator_obj, &sep_buf, &sep_len,
+                                     "separator") < 0 ||
+            sep_len == 0) {
+            PyErr_Clear();
+            PyErr_SetString(PyExc_ValueError,
+                            "Separator must be of type string or bytes.");
+            return NULL;
+        }
+        if (sep_len != 1 || (unsigned char)sep_buf[0] >= 0x80) {
+            if (spans) {
+                PyErr_SetString(PyExc_ValueError,
+                                "spans=True needs a one character ASCII "
+                                "separator");
+                return NULL;
+            }
+            return stdlib_call(as_dict ? "parse_qs" : "parse_qsl", args,
+                               kwargs);
+        }
+        separator = sep_buf[0];
+    }
+
+    PyObject *res = as_dict ? PyDict_New() : PyList_New(0);
+    qp.scratch = PyMem_Malloc(len ? (size_t)len : 1);
+    if (!res || !qp.scratch) {
+        Py_XDECREF(res);
+        PyMem_Free(qp.scratch);
+        return PyErr_NoMemory();
+    }
+    if (qs_run(&qp, len, separator, max_num_fields,
+               as_dict ? qs_add_to_dict : qs_add_to_list, res) < 0) {
+        Py_CLEAR(res);
+    }
+    PyMem_Free(qp.scratch);
+    return res;
+}
+
+// abf_parse_qsl(qs, keep_blank_values=False, strict_parsing=False,
+// encoding='utf-8', errors='replace', max_num_fields=None, separator='&', *,
+// spans=False) -> list[tuple]
+static PyObject *abf_parse_qsl(PyObject *self, PyObject *args,
+                               PyObject *kwargs) {
+    return parse_query(module_state(self), args, kwargs, false);
+}
+
+// abf_parse_qs(qs, keep_blank_values=False, strict_parsing=False,
+// encoding='utf-8', errors='replace', max_num_fields=None, separator='&')
+// -> dict[str, list]
+static PyObject *abf_parse_qs(PyObject *self, PyObject *args,
+                              PyObject *kwargs) {
+    return parse_query(module_state(self), args, kwargs, true);
+}
+
+// urlunsplit / urlunparse: components are read in place (str UTF-8 data,
+// bytes, or the spans of a lazy result) and written once into a result
+// allocated at its final size
+
+typedef struct {
+    url_component_t *comps[LAZY_MAX_FIELDS];
+    Py_ssize_t nfields;
+    int is_bytes;
+    bool ascii;
+    PyObject *scheme; // str scheme for the uses_netloc lookup, or NULL
+} unsplit_input_t;
+
+// Fill one component from a str/bytes item; 1 means leave it to urllib.parse
+// (None, mixed types and other objects, with their odd corner cases)
+static int unsplit_item(unsplit_input_t *in, Py_ssize_t i, PyObject *item) {
+    if (in->is_bytes ? !PyBytes_Check(item) : !PyUnicode_Check(item)) {
+        return 1;
+    }
+    const char *buf;
+    Py_ssize_t len;
+    if (get_buffer_from_pyobject(item, &buf, &len, "component") < 0) {
+        return -1;
+    }
+    in->comps[i]->start = buf;
+    in->comps[i]->length = (size_t)len;
+    if (!in->is_bytes) {
+        in->ascii &= PyUnicode_IS_ASCII(item);
+        if (i == 0) {
+            in->scheme = item;
+        }
+    }
+    return 0;
+}
+
+// The recombined url as bytes, or as str (ASCII written in place, otherwise
+// decoded from UTF-8)
+static PyObject *unsplit_to_pyobj(const url_unsplit_t *parts, unsigned flags,
+                                  int is_bytes, bool ascii) {
+    size_t len = url_unsplit(parts, flags, NULL);
+    PyObject *res;
+    if (is_bytes) {
+        res = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)len);
+        if (res) {
+            url_unsplit(parts, flags, PyBytes_AS_STRING(res));
+        }
+    } else if (ascii) {
+        res = PyUnicode_New((Py_ssize_t)len, 127);
+        if (res) {
+            url_unsplit(parts, flags, (char *)PyUnicode_1BYTE_DATA(res));
+        }
+    } else {
+        char *buf = PyMem_Malloc(len ? len : 1);
+        if (!buf) {
+            return PyErr_NoMemory();
+        }
+        url_unsplit(parts, flags, buf);
+        res = PyUnicode_DecodeUTF8(buf, (Py_ssize_t)len, NULL);
+        PyMem_Free(buf);
+    }
+    return res;
+}
+
+static PyObject *unsplit_not_implemented(void) { Py_RETURN_NOTIMPLEMENTED; }
+
+// New reference to the recombined url, or Py_NotImplemented when the input
+// should go to urllib.parse
+static PyObject *unsplit_impl(module_state_t *st, PyObject *components,
+                              Py_ssize_t nfields) {
+    url_unsplit_t parts = {0};
+    url_component_t *split_comps[] = {&parts.scheme, &parts.netloc,
+                                      &parts.path, &parts.query,
+                                      &parts.fragment};
+    url_component_t *parse_comps[] = {&parts.scheme, &parts.netloc,
+                                      &parts.path,   &parts.params,
+                                      &parts.query,  &parts.fragment};
+    unsplit_input_t in = {.nfields = nfields, .ascii = true};
+    memcpy(in.comps, nfields == 5 ? split_comps : parse_comps,
+           (size_t)nfields * sizeof(*in.comps));
+    PyObject *keep = NULL; // owns whatever the component buffers live in
+
+    PyTypeObject *lazy_type =
+        nfields == 5 ? st->LazySplitResultType : st->LazyParseResultType;
+    if (Py_IS_TYPE(components, lazy_type)) {
+        LazyResultObject *lazy = (LazyResultObject *)components;
+        PyObject *scheme = lazy_result_item(lazy, 0);
+        if (!scheme) {
+            return NULL;
+        }
+        in.is_bytes = lazy->is_bytes;
+        in.ascii = lazy->is_bytes || PyUnicode_IS_ASCII(lazy->source);
+        for (Py_ssize_t i = 1; i < nfields; ++i) {
+            *in.comps[i] = lazy->comps[i];
+        }
+        // The scheme is read from its (lowercased) object
+        int rc = unsplit_item(&in, 0, scheme);
+        keep = scheme;
+        if (rc != 0) {
+            Py_DECREF(keep);
+            return rc < 0 ? NULL : unsplit_not_implemented();
+        }
+    } else {
+        keep = PySequence_Fast(components, "components must be a sequence");
+        if (!keep) {
+            return NULL;
+        }
+        Py_ssize_t n = PySequence_Fast_GET_SIZE(keep);
+        if (n != nfields) {
+            PyErr_Format(PyExc_ValueError,
+                         n < nfields ? "not enough values to unpack "
+                                       "(expected %zd, got %zd)"
+                                     : "too many values to unpack "
+                                       "(expected %zd)",
+                         nfields, n);
+            Py_DECREF(keep);
+            return NULL;
+        }
+        in.is_bytes = !PyUnicode_Check(PySequence_Fast_GET_ITEM(keep, 0));
+        for (Py_ssize_t i = 0; i < nfields; ++i) {
+            int rc = unsplit_item(&in, i, PySequence_Fast_GET_ITEM(keep, i));
+            if (rc != 0) {
+                Py_DECREF(keep);
+                return rc < 0 ? NULL : unsplit_not_implemented();
+            }
+        }
+    }
+
+    PyObject *res = NULL;
+    if (in.is_bytes) {
+        // urllib.parse decodes bytes components as ASCII
+        for (Py_ssize_t i = 0; i < nfields; ++i) {
+            const url_component_t *comp = in.comps[i];
+            for (size_t j = 0; j < comp->length; ++j) {
+                if ((unsigned char)comp->start[j] >= 0x80) {
+                    Py_XDECREF(PyUnicode_DecodeASCII(
+                        comp->start, (Py_ssize_t)comp->length, "strict"));
+                    goto done;
+                }
+            }
+        }
+    }
+    if (parts.scheme.length && !parts.netloc.length) {
+        PyObject *scheme =
+            in.scheme ? (Py_INCREF(in.scheme), in.scheme)
+                      : PyUnicode_DecodeASCII(parts.scheme.start,
+                                              (Py_ssize_t)parts.scheme.length,
+                                              "strict");
+        int found =
+            scheme ? PySequence_Contains(st->uses_netloc, scheme) : -1;
+        Py_XDECREF(scheme);
+        if (found < 0) {
+            goto done;
+        }
+        parts.scheme_uses_netloc = found;
+    }
+
+    res = unsplit_to_pyobj(&parts, st->unsplit_flags, in.is_bytes, in.ascii);
+done:
+    Py_DECREF(keep);
+    return res;
+}
+
+static PyObject *unsplit_components(module_state_t *st, PyObject *components,
+                                    Py_ssize_t nfields,
+                                    const char *stdlib_name) {
+    PyObject *res = unsplit_impl(st, components, nfields);
+    if (res != Py_NotImplemented) {
+        return res;
+    }
+    Py_DECREF(res);
+    PyObject *args = PyTuple_Pack(1, components);
+    if (!args) {
+        return NULL;
+    }
+    res = stdlib_call(stdlib_name, args, NULL);
+    Py_DECREF(args);
+    return res;
+}
+
+// abf_urlunsplit(components) -> str | bytes
+static PyObject *abf_urlunsplit(PyObject *self, PyObject *const *args,
+                                Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "urlunsplit",
+        .names = {"components", NULL},
+        .required = 1,
+        .max_positional = 1};
+    PyObject *components;
+    if (fast_args_parse(&spec, args, nargs, kwnames, &components) < 0) {
+        return NULL;
+    }
+    return unsplit_components(module_state(self), components, 5,
+                              "urlunsplit");
+}
+
+// abf_urlunparse(components) -> str | bytes
+static PyObject *abf_urlunparse(PyObject *self, PyObject *const *args,
+                                Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "urlunparse",
+        .names = {"components", NULL},
+        .required = 1,
+        .max_positional = 1};
+    PyObject *components;
+    if (fast_args_parse(&spec, args, nargs, kwnames, &components) < 0) {
+        return NULL;
+    }
+    return unsplit_components(module_state(self), components, 6,
+                              "urlunparse");
+}
+
+// urljoin: the base is parsed once and its scheme lowercased; Joiner keeps
+// that for any number of joins against the same base
+
+enum { JOIN_STACK_SCRATCH = 1024 };
+
+// Whether the lowercase scheme is in a urllib.parse scheme list
+static int scheme_in_list(PyObject *list, const char *scheme, size_t len) {
+    if (!PyList_CheckExact(list)) {
+        PyObject *str = PyUnicode_DecodeASCII(scheme, (Py_ssize_t)len, NULL);
+        if (!str) {
+            return -1;
+        }
+        int found = PySequence_Contains(list, str);
+        Py_DECREF(str);
+        return found;
+    }
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(list); ++i) {
+        PyObject *item = PyList_GET_ITEM(list, i);
+        if (PyUnicode_Check(item) && PyUnicode_IS_ASCII(item) &&
+            (size_t)PyUnicode_GET_LENGTH(item) == len &&
+            memcmp(PyUnicode_1BYTE_DATA(item), scheme, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    PyObject *obj; // the base as given, parsed where it is
+    char *scheme;  // its lowercased, NUL-terminated scheme
+    Py_ssize_t len;
+    url_scratch_t scratch; // copy of a base with tabs or newlines
+    url_parse_result_t parsed;
+    int is_bytes;
+    bool ascii;
+    bool allow_fragments;
+    bool relative; // scheme in uses_relative
+    bool netloc;   // scheme in uses_netloc
+    unsigned unsplit_flags;
+} join_base_t;
+
+static void join_base_free(join_base_t *jb) {
+    Py_CLEAR(jb->obj);
+    PyMem_Free(jb->scheme);
+    jb->scheme = NULL;
+    url_scratch_free(&jb->scratch);
+}
+
+static int join_base_init(module_state_t *st, join_base_t *jb,
+                          PyObject *base, bool allow_fragments) {
+    const char *buf;
+    Py_ssize_t len;
+    memset(jb, 0, sizeof(*jb));
+    jb->is_bytes = get_buffer_from_pyobject(base, &buf, &len, "base");
+    if (jb->is_bytes < 0) {
+        return -1;
+    }
+    Py_INCREF(base);
+    jb->obj = base;
+    jb->len = len;
+    jb->allow_fragments = allow_fragments;
+    jb->ascii = jb->is_bytes ? bytes_are_ascii(buf, len)
+                             : PyUnicode_IS_ASCII(base);
+
+    url_parse_error_t err = url_parse(buf, (size_t)len, "", allow_fragments,
+                                      &jb->scratch, &jb->parsed);
+    if (err != URL_PARSE_OK) {
+        set_parse_error(err, "urljoin");
+        return -1;
+    }
+    if (check_netloc(&jb->parsed.netloc, jb->is_bytes) < 0) {
+        return -1;
+    }
+    // urljoin compares and outputs the lowercased scheme
+    url_component_t *scheme = &jb->parsed.scheme;
+    char *lower = jb->scheme = PyMem_Malloc(scheme->length + 1);
+    if (!lower) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (size_t i = 0; i < scheme->length; ++i) {
+        char c = scheme->start[i];
+        lower[i] = c >= 'A' && c <= 'Z' ? (char)(c | 0x20) : c;
+    }
+    lower[scheme->length] = '\0';
+    scheme->start = lower;
+
+    int relative = scheme_in_list(st->uses_relative, lower, scheme->length);
+    int netloc = scheme_in_list(st->uses_netloc, lower, scheme->length);
+    if (relative < 0 || netloc < 0) {
+        return -1;
+    }
+    jb->relative = relative;
+    jb->netloc = netloc;
+    jb->unsplit_flags = st->unsplit_flags;
+    return 0;
+}
+
+static PyObject *join_base_join(const join_base_t *jb, PyObject *url) {
+    if (!jb->len) {
+        Py_INCREF(url);
+        return url;
+    }
+    const char *buf;
+    Py_ssize_t len;
+    int is_bytes = get_buffer_from_pyobject(url, &buf, &len, "url");
+    if (is_bytes < 0) {
+        return NULL;
+    }
+    if (!len) {
+        Py_INCREF(jb->obj);
+        return jb->obj;
+    }
+    if (is_bytes != jb->is_bytes) {
+        PyErr_SetString(PyExc_TypeError,
+                        "Cannot mix str and non-str arguments");
+        return NULL;
+    }
+    bool ascii = is_bytes ? bytes_are_ascii(buf, len) : PyUnicode_IS_ASCII(url);
+    if (is_bytes && (!jb->ascii || !ascii)) {
+        // urllib.parse decodes bytes arguments as ASCII
+        PyObject *bad = jb->ascii ? url : jb->obj;
+        Py_XDECREF(PyUnicode_DecodeASCII(PyBytes_AS_STRING(bad),
+                                         PyBytes_GET_SIZE(bad), "strict"));
+        return NULL;
+    }
+
+    // Room for the merged path
+    size_t need = (size_t)len + jb->parsed.path.length + 2;
+    char stack[JOIN_STACK_SCRATCH];
+    char *path_buf = need <= sizeof(stack) ? stack : PyMem_Malloc(need);
+    if (!path_buf) {
+        return PyErr_NoMemory();
+    }
+    url_scratch_t scratch = {NULL};
+    url_parse_result_t ref;
+    url_unsplit_t parts;
+    PyObject *res = NULL;
+    url_parse_error_t err =
+        url_parse(buf, (size_t)len, jb->parsed.scheme.start,
+                  jb->allow_fragments, &scratch, &ref);
+    if (err != URL_PARSE_OK) {
+        set_parse_error(err, "urljoin");
+    } else if (check_netloc(&ref.netloc, is_bytes) < 0) {
+        res = NULL;
+    } else if (!url_join(&jb->parsed, &ref, jb->relative, jb->netloc,
+                         path_buf, &parts)) {
+        Py_INCREF(url);
+        res = url;
+    } else {
+        res = unsplit_to_pyobj(&parts, jb->unsplit_flags, is_bytes,
+                               jb->ascii && ascii);
+    }
+    url_scratch_free(&scratch);
+    if (path_buf != stack) {
+        PyMem_Free(path_buf);
+    }
+    return res;
+}
+
+// Joiner(base, allow_fragments=True): urljoin with the base parsed once
+typedef struct {
+    PyObject_HEAD
+    join_base_t base;
+} JoinerObject;
+
+static PyObject *joiner_new(PyTypeObject *type, PyObject *args,
+                            PyObject *kwargs) {
+    PyObject *base = NULL;
+    int allow_fragments = 1; // "p" stores an int
+    static char *kwlist[] = {"base", "allow_fragments", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|p", kwlist, &base,
+                                     &allow_fragments)) {
+        return NULL;
+    }
+    JoinerObject *self = (JoinerObject *)type->tp_alloc(type, 0);
+    if (!self) {
+        return NULL;
+    }
+    if (join_base_init(type_state(type), &self->base, base,
+                       allow_fragments) < 0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+}
+
+// Joiner.__call__(url) -> str | bytes
+static PyObject *joiner_call(PyObject *self, PyObject *args,
+                             PyObject *kwargs) {
+    PyObject *url = NULL;
+    static char *kwlist[] = {"url", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &url)) {
+        return NULL;
+    }
+    return join_base_join(&((JoinerObject *)self)->base, url);
+}
+
+// Joiner.join_many(urls) -> list
+static PyObject *joiner_join_many(PyObject *self, PyObject *urls) {
+    const join_base_t *jb = &((JoinerObject *)self)->base;
+    PyObject *seq = PySequence_Fast(urls, "urls must be a sequence");
+    if (!seq) {
+        return NULL;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    PyObject *res = PyList_New(n);
+    for (Py_ssize_t i = 0; res && i < n; ++i) {
+        PyObject *item = join_base_join(jb, PySequence_Fast_GET_ITEM(seq, i));
+        if (!item) {
+            Py_CLEAR(res);
+            break;
+        }
+        PyList_SET_ITEM(res, i, item);
+    }
+    Py_DECREF(seq);
+    return res;
+}
+
+static void joiner_dealloc(PyObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+    join_base_free(&((JoinerObject *)self)->base);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+static PyMethodDef joiner_methods[] = {
+    {"join_many", joiner_join_many, METH_O,
+     "Join every url of a sequence against the base"},
+    {NULL, NULL, 0, NULL}};
+
+static PyMemberDef joiner_members[] = {
+    {"base", T_OBJECT, offsetof(JoinerObject, base.obj), READONLY,
+     "The base url"},
+    {NULL, 0, 0, 0, NULL}};
+
+static PyType_Slot joiner_slots[] = {
+    {Py_tp_doc, "Joiner(base, allow_fragments=True): urljoin against a base "
+                "parsed once"},
+    {Py_tp_new, joiner_new},
+    {Py_tp_call, joiner_call},
+    {Py_tp_dealloc, joiner_dealloc},
+    {Py_tp_methods, joiner_methods},
+    {Py_tp_members, joiner_members},
+    {0, NULL}};
+
+static PyType_Spec joiner_spec = {
+    .name = "abf.urllib.parse.Joiner",
+    .basicsize = sizeof(JoinerObject),
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = joiner_slots,
+};
+
+// abf_urljoin(base, url, allow_fragments=True) -> str | bytes
+static PyObject *abf_urljoin(PyObject *self, PyObject *const *args,
+                             Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "urljoin",
+        .names = {"base", "url", "allow_fragments", NULL},
+        .required = 2,
+        .max_positional = 3};
+    PyObject *argv[3];
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0) {
+        return NULL;
+    }
+    PyObject *base = argv[0], *url = argv[1];
+    int allow_fragments = fast_arg_flag(argv[2], 1);
+    if (allow_fragments < 0) {
+        return NULL;
+    }
+    // Same shortcuts as urllib.parse, before any type checks
+    int truth = PyObject_IsTrue(base);
+    if (truth <= 0) {
+        return truth < 0 ? NULL : (Py_INCREF(url), url);
+    }
+    truth = PyObject_IsTrue(url);
+    if (truth <= 0) {
+        return truth < 0 ? NULL : (Py_INCREF(base), base);
+    }
+
+    join_base_t jb;
+    PyObject *res = NULL;
+    if (join_base_init(module_state(self), &jb, base, allow_fragments) == 0) {
+        res = join_base_join(&jb, url);
+    }
+    join_base_free(&jb);
+    return res;
+}
+
+/*
+ * Canonical form and fingerprint (canon.c). A str url is canonicalized as
+ * its UTF-8 bytes and comes back as a str, any other url as bytes; a str
+ * and its UTF-8 encoding have the same fingerprint.
+ */
+
+// Helper: URL_CANON_* flags from the sort_query / drop_fragment arguments
+static int canon_flags(PyObject *sort_query, PyObject *drop_fragment,
+                       unsigned *flags) {
+    int sort = fast_arg_flag(sort_query, 0);
+    int drop = fast_arg_flag(drop_fragment, 0);
+    if (sort < 0 || drop < 0) {
+        return -1;
+    }
+    *flags = (sort ? URL_CANON_SORT_QUERY : 0) |
+             (drop ? URL_CANON_DROP_FRAGMENT : 0);
+    return 0;
+}
+
+// Helper: the seed argument, 0 when missing
+static int canon_seed(PyObject *obj, uint64_t *seed) {
+    *seed = 0;
+    if (!obj) {
+        return 0;
+    }
+    unsigned long long v = PyLong_AsUnsignedLongLong(obj);
+    if (v == (unsigned long long)-1 && PyErr_Occurred()) {
+        return -1;
+    }
+    *seed = (uint64_t)v;
+    return 0;
+}
+
+static PyObject *canon_one(PyObject *url_obj, unsigned flags) {
+    Py_buffer view;
+    const char *url;
+    Py_ssize_t url_len;
+    int is_bytes = get_url_buffer(url_obj, &view, &url, &url_len, "url");
+    if (is_bytes < 0) {
+        return NULL;
+    }
+    PyObject *res = PyBytes_FromStringAndSize(
+        NULL, (Py_ssize_t)url_canon_bound((size_t)url_len));
+    if (!res) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    // clang-format off
+    url_scratch_t scratch = {NULL};
+    size_t out_len = 0;
+    url_parse_error_t err;
+    if (url_len >= PARSE_RELEASE_GIL_MIN_LEN) {
+        Py_BEGIN_ALLOW_THREADS
+        err = url_canonicalize(url, (size_t)url_len, flags, &scratch,
+                               PyBytes_AS_STRING(res), &out_len);
+        Py_END_ALLOW_THREADS
+    } else {
+        err = url_canonicalize(url, (size_t)url_len, flags, &scratch,
+                               PyBytes_AS_STRING(res), &out_len);
+    }
+    // clang-format on
+    url_scratch_free(&scratch);
+    PyBuffer_Release(&view);
+    if (err != URL_PARSE_OK) {
+        set_parse_error(err, "canonicalize");
+        Py_DECREF(res);
+        return NULL;
+    }
+    if (is_bytes) {
+        if (_PyBytes_Resize(&res, (Py_ssize_t)out_len) < 0) {
+            return NULL;
+        }
+        return res;
+    }
+    // Only ASCII is rewritten, so UTF-8 in is UTF-8 out
+    PyObject *str = PyUnicode_DecodeUTF8(PyBytes_AS_STRING(res),
+                                         (Py_ssize_t)out_len, NULL);
+    Py_DECREF(res);
+    return str;
+}
+
+// abf_canonicalize(url: str | Buffer, *, sort_query=False,
+// drop_fragment=False) -> str | bytes
+static PyObject *abf_canonicalize(PyObject *self, PyObject *const *args,
+                                  Py_ssize_t nargs, PyObject *kwnames) {
+    (void)self;
+    static const fast_args_t spec = {
+        .fname = "canonicalize",
+        .names = {"url", "sort_query", "drop_fragment", NULL},
+        .required = 1,
+        .max_positional = 1};
+    PyObject *argv[3];
+    unsigned flags;
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0 ||
+        canon_flags(argv[1], argv[2], &flags) < 0) {
+        return NULL;
+    }
+    return canon_one(argv[0], flags);
+}
+
+// abf_fingerprint(url: str | Buffer, *, sort_query=False,
+// drop_fragment=False, seed=0) -> int
+static PyObject *abf_fingerprint(PyObject *self, PyObject *const *args,
+                                 Py_ssize_t nargs, PyObject *kwnames) {
+    (void)self;
+    static const fast_args_t spec = {
+        .fname = "fingerprint",
+        .names = {"url", "sort_query", "drop_fragment", "seed", NULL},
+        .required = 1,
+        .max_positional = 1};
+    PyObject *argv[4];
+    unsigned flags;
+    uint64_t seed;
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0 ||
+        canon_flags(argv[1], argv[2], &flags) < 0 ||
+        canon_seed(argv[3], &seed) < 0) {
+        return NULL;
+    }
+    Py_buffer view;
+    const char *url;
+    Py_ssize_t url_len;
+    if (get_url_buffer(argv[0], &view, &url, &url_len, "url") < 0) {
+        return NULL;
+    }
+    // clang-format off
+    url_scratch_t scratch = {NULL};
+    uint64_t fp;
+    url_parse_error_t err;
+    if (url_len >= PARSE_RELEASE_GIL_MIN_LEN) {
+        Py_BEGIN_ALLOW_THREADS
+        err = url_fingerprint(url, (size_t)url_len, flags, seed, &scratch,
+                              &fp);
+        Py_END_ALLOW_THREADS
+    } else {
+        err = url_fingerprint(url, (size_t)url_len, flags, seed, &scratch,
+                              &fp);
+    }
+    // clang-format on
+    url_scratch_free(&scratch);
+    PyBuffer_Release(&view);
+    if (err != URL_PARSE_OK) {
+        set_parse_error(err, "fingerprint");
+        return NULL;
+    }
+    return PyLong_FromUnsignedLongLong(fp);
+}
+
+// abf_canonicalize_many(urls: Iterable[str | Buffer], *, sort_query=False,
+// drop_fragment=False) -> list[str | bytes]
+static PyObject *abf_canonicalize_many(PyObject *self, PyObject *args,
+                                       PyObject *kwargs) {
+    (void)self;
+    PyObject *urls_obj, *sort_query = NULL, *drop_fragment = NULL;
+    static char *kwlist[] = {"urls", "sort_query", "drop_fragment", NULL};
+    unsigned flags;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|$OO", kwlist,
+                                     &urls_obj, &sort_query,
+                                     &drop_fragment) ||
+        canon_flags(sort_query, drop_fragment, &flags) < 0) {
+        return NULL;
+    }
+    PyObject *urls = PySequence_List(urls_obj);
+    if (!urls) {
+        return NULL;
+    }
+    Py_ssize_t n = PyList_GET_SIZE(urls);
+    PyObject *list = PyList_New(n);
+    for (Py_ssize_t i = 0; list && i < n; ++i) {
+        PyObject *res = canon_one(PyList_GET_ITEM(urls, i), flags);
+        if (!res) {
+            Py_CLEAR(list);
+            break;
+        }
+        PyList_SET_ITEM(list, i, res);
+    }
+    Py_DECREF(urls);
+    return list;
+}
+
+// fingerprint_many: hashes written straight into out
+typedef struct {
+    unsigned flags;
+    uint64_t seed;
+    uint64_t *out;
+    url_parse_error_t *errors;
+} fingerprint_many_t;
+
+static void fingerprint_many_kernel(void *ctx, const char **bufs,
+                                    const size_t *lens, size_t n,
+                                    Py_ssize_t start) {
+    fingerprint_many_t *fm = ctx;
+    url_fingerprint_many(bufs, lens, n, fm->flags, fm->seed, fm->out + start,
+                         fm->errors);
+}
+
+static int fingerprint_many_convert(void *ctx, PyObject *urls,
+                                    Py_ssize_t start, const char **bufs,
+                                    const size_t *lens, const char *kinds,
+                                    size_t n) {
+    (void)urls, (void)start, (void)bufs, (void)lens, (void)kinds;
+    fingerprint_many_t *fm = ctx;
+    for (size_t i = 0; i < n; ++i) {
+        if (fm->errors[i] != URL_PARSE_OK) {
+            set_parse_error(fm->errors[i], "fingerprint_many");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// abf_fingerprint_many(urls: Iterable[str | Buffer], *, sort_query=False,
+// drop_fragment=False, seed=0) -> memoryview (format 'Q')
+// The urls are hashed without the GIL, large batches on the worker pool.
+static PyObject *abf_fingerprint_many(PyObject *self, PyObject *args,
+                                      PyObject *kwargs) {
+    (void)self;
+    PyObject *urls_obj, *sort_query = NULL, *drop_fragment = NULL,
+                        *seed_obj = NULL;
+    static char *kwlist[] = {"urls", "sort_query", "drop_fragment", "seed",
+                             NULL};
+    fingerprint_many_t fm = {0};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|$OOO", kwlist,
+                                     &urls_obj, &sort_query, &drop_fragment,
+                                     &seed_obj) ||
+        canon_flags(sort_query, drop_fragment, &fm.flags) < 0 ||
+        canon_seed(seed_obj, &fm.seed) < 0) {
+        return NULL;
+    }
+    // Own copy: the items must stay alive while the GIL is released
+    PyObject *urls = PySequence_List(urls_obj);
+    if (!urls) {
+        return NULL;
+    }
+    Py_ssize_t n = PyList_GET_SIZE(urls);
+    PyObject *arr = PyBytes_FromStringAndSize(NULL, n * 8);
+    fm.errors = PyMem_Malloc(sizeof(*fm.errors) * batch_block(n));
+    PyObject *res = NULL;
+    if (arr && !fm.errors) {
+        PyErr_NoMemory();
+    } else if (arr) {
+        fm.out = (uint64_t *)PyBytes_AS_STRING(arr);
+        static const batch_ops_t ops = {fingerprint_many_kernel,
+                                        fingerprint_many_convert};
+        res = batch_run(urls, &ops, &fm) < 0 ? NULL
+                                              : batch_memoryview(arr, "Q");
+    }
+    PyMem_Free(fm.errors);
+    Py_XDECREF(arr);
+    Py_DECREF(urls);
+    return res;
+}
+
+/*
+ * Strict RFC 3986 validation (url_validate). Offsets are in characters for
+ * a str url, in bytes for a bytes-like one.
+ */
+
+// Helper: ValidationError.code, the abf::url::errc names
+static const char *validation_code(url_parse_error_t err) {
+    switch (err) {
+    case URL_PARSE_ERROR_INVALID_IPV6:
+        return "invalid_ipv6";
+    case URL_PARSE_ERROR_INVALID_NETLOC:
+        return "invalid_netloc";
+    case URL_PARSE_ERROR_INVALID_SCHEME:
+        return "invalid_scheme";
+    case URL_PARSE_ERROR_INVALID_CHAR:
+        return "invalid_char";
+    case URL_PARSE_ERROR_INVALID_ESCAPE:
+        return "invalid_escape";
+    case URL_PARSE_ERROR_INVALID_PORT:
+        return "invalid_port";
+    default:
+        return "unknown";
+    }
+}
+
+// Helper: a byte offset into a str's UTF-8 as a character offset
+static Py_ssize_t validation_offset(PyObject *url_obj, const char *utf8,
+                                    size_t offset) {
+    if (!PyUnicode_Check(url_obj) || PyUnicode_IS_ASCII(url_obj)) {
+        return (Py_ssize_t)offset;
+    }
+    Py_ssize_t chars = 0;
+    for (size_t i = 0; i < offset; ++i) {
+        chars += ((unsigned char)utf8[i] & 0xC0) != 0x80;
+    }
+    return chars;
+}
+
+static void set_validation_error(module_state_t *st, url_parse_error_t err,
+                                 Py_ssize_t offset) {
+    PyObject *exc = PyObject_CallFunction(
+        st->ValidationError, "N",
+        PyUnicode_FromFormat("%s at offset %zd", url_parse_strerror(err),
+                             offset));
+    if (!exc) {
+        return;
+    }
+    PyObject *code = PyUnicode_FromString(validation_code(err));
+    PyObject *where = PyLong_FromSsize_t(offset);
+    if (code && where && PyObject_SetAttrString(exc, "code", code) == 0 &&
+        PyObject_SetAttrString(exc, "offset", where) == 0) {
+        PyErr_SetObject(st->ValidationError, exc);
+    }
+    Py_XDECREF(code);
+    Py_XDECREF(where);
+    Py_DECREF(exc);
+}
+
+// abf_validate(url: str | Buffer) -> SplitResult | SplitResultBytes
+// The url's urlsplit() result, from the same scan as the checks. Raises
+// ValidationError (a ValueError) with .code and .offset
+static PyObject *abf_validate(PyObject *self, PyObject *const *args,
+                              Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "validate", .names = {"url", NULL}, .required = 1,
+        .max_positional = 1};
+    PyObject *argv[1];
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0) {
+        return NULL;
+    }
+    Py_buffer view;
+    const char *url;
+    Py_ssize_t url_len;
+    int is_bytes = get_url_buffer(argv[0], &view, &url, &url_len, "url");
+    if (is_bytes < 0) {
+        return NULL;
+    }
+    // clang-format off
+    url_split_result_t result;
+    size_t offset;
+    url_parse_error_t err;
+    if (url_len >= PARSE_RELEASE_GIL_MIN_LEN) {
+        Py_BEGIN_ALLOW_THREADS
+        err = url_validate(url, (size_t)url_len, &result, &offset);
+        Py_END_ALLOW_THREADS
+    } else {
+        err = url_validate(url, (size_t)url_len, &result, &offset);
+    }
+    // clang-format on
+    PyObject *res = NULL;
+    module_state_t *st = module_state(self);
+    if (err != URL_PARSE_OK) {
+        set_validation_error(st, err, validation_offset(argv[0], url, offset));
+    } else {
+        // A valid url is all ASCII
+        res = split_result_to_pyobj(st, &result, is_bytes, !is_bytes);
+    }
+    PyBuffer_Release(&view);
+    return res;
+}
+
+// validate_many: each url's error offset, -1 for a valid one
+typedef struct {
+    int64_t *out;
+    url_parse_error_t *errors;
+    size_t *offsets;
+} validate_many_t;
+
+static void validate_many_kernel(void *ctx, const char **bufs,
+                                 const size_t *lens, size_t n,
+                                 Py_ssize_t start) {
+    (void)start;
+    validate_many_t *vm = ctx;
+    url_validate_many(bufs, lens, n, vm->errors, vm->offsets);
+}
+
+static int validate_many_convert(void *ctx, PyObject *urls, Py_ssize_t start,
+                                 const char **bufs, const size_t *lens,
+                                 const char *kinds, size_t n) {
+    (void)lens, (void)kinds;
+    validate_many_t *vm = ctx;
+    for (size_t i = 0; i < n; ++i) {
+        Py_ssize_t at = start + (Py_ssize_t)i;
+        vm->out[at] = vm->errors[i] == URL_PARSE_OK
+                          ? -1
+                          : validation_offset(PyList_GET_ITEM(urls, at),
+                                              bufs[i], vm->offsets[i]);
+    }
+    return 0;
+}
+
+// abf_validate_many(urls: Iterable[str | Buffer]) -> memoryview (format 'q')
+// The offset of each url's error, -1 for a valid url; validate() gives the
+// code. The urls are checked without the GIL, large batches on the pool.
+static PyObject *abf_validate_many(PyObject *self, PyObject *args,
+                                   PyObject *kwargs) {
+    (void)self;
+    PyObject *urls_obj;
+    static char *kwlist[] = {"urls", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &urls_obj)) {
+        return NULL;
+    }
+    // Own copy: the items must stay alive while the GIL is released
+    PyObject *urls = PySequence_List(urls_obj);
+    if (!urls) {
+        return NULL;
+    }
+    Py_ssize_t n = PyList_GET_SIZE(urls);
+    PyObject *arr = PyBytes_FromStringAndSize(NULL, n * 8);
+    size_t block = batch_block(n);
+    validate_many_t vm = {
+        .errors = PyMem_Malloc(sizeof(*vm.errors) * block),
+        .offsets = PyMem_Malloc(sizeof(*vm.offsets) * block)};
+    PyObject *res = NULL;
+    if (arr && (!vm.errors || !vm.offsets)) {
+        PyErr_NoMemory();
+    } else if (arr) {
+        vm.out = (int64_t *)PyBytes_AS_STRING(arr);
+        static const batch_ops_t ops = {validate_many_kernel,
+                                        validate_many_convert};
+        res = batch_run(urls, &ops, &vm) < 0 ? NULL
+                                              : batch_memoryview(arr, "q");
+    }
+    PyMem_Free(vm.errors);
+    PyMem_Free(vm.offsets);
+    Py_XDECREF(arr);
+    Py_DECREF(urls);
+    return res;
+}
+
+/*
+ * DomainMatcher: host suffix rules compiled once (domain.c), matched
+ * against the hostname url_split finds without building any string.
+ */
+typedef struct {
+    PyObject_HEAD
+    url_domain_matcher_t *matcher;
+    PyObject *rules; // tuple, as given
+} DomainMatcherObject;
+
+// Helper: a rule index as match() returns it
+static PyObject *domain_match_to_pyobj(size_t rule) {
+    if (rule == URL_DOMAIN_NO_MATCH) {
+        Py_RETURN_NONE;
+    }
+    return PyLong_FromSize_t(rule);
+}
+
+// DomainMatcher(rules: Iterable[str | Buffer])
+static PyObject *domain_matcher_new(PyTypeObject *type, PyObject *args,
+                                    PyObject *kwargs) {
+    PyObject *rules_obj;
+    static char *kwlist[] = {"rules", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &rules_obj)) {
+        return NULL;
+    }
+    PyObject *rules = PySequence_Tuple(rules_obj);
+    if (!rules) {
+        return NULL;
+    }
+    Py_ssize_t n = PyTuple_GET_SIZE(rules);
+    const char **bufs = PyMem_Malloc(sizeof(*bufs) * (n ? (size_t)n : 1));
+    size_t *lens = PyMem_Malloc(sizeof(*lens) * (n ? (size_t)n : 1));
+    // Exports of the buffer rules, allocated on the first one
+    Py_buffer *held = NULL;
+    Py_ssize_t nheld = 0;
+    url_domain_matcher_t *matcher = NULL;
+    DomainMatcherObject *self = NULL;
+    if (!bufs || !lens) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        Py_ssize_t len;
+        Py_buffer view;
+        if (get_url_buffer(PyTuple_GET_ITEM(rules, i), &view, &bufs[i], &len,
+                           "rule") < 0) {
+            goto done;
+        }
+        if (view.obj) {
+            if (!held && !(held = PyMem_Calloc((size_t)n, sizeof(*held)))) {
+                PyBuffer_Release(&view);
+                PyErr_NoMemory();
+                goto done;
+            }
+            held[nheld++] = view;
+        }
+        lens[i] = (size_t)len;
+    }
+
+    // clang-format off
+    size_t bad_rule;
+    url_parse_error_t err;
+    Py_BEGIN_ALLOW_THREADS
+    err = url_domain_matcher_new(bufs, lens, (size_t)n, &matcher, &bad_rule);
+    Py_END_ALLOW_THREADS
+    // clang-format on
+    if (err == URL_PARSE_ERROR_INVALID_NETLOC) {
+        PyErr_Format(PyExc_ValueError, "invalid domain rule: %R",
+                     PyTuple_GET_ITEM(rules, (Py_ssize_t)bad_rule));
+        goto done;
+    }
+    if (err != URL_PARSE_OK) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    self = (DomainMatcherObject *)type->tp_alloc(type, 0);
+    if (self) {
+        self->matcher = matcher;
+        self->rules = rules;
+        matcher = NULL;
+        rules = NULL;
+    }
+
+done:
+    for (; nheld; --nheld) {
+        PyBuffer_Release(&held[nheld - 1]);
+    }
+    PyMem_Free(held);
+    PyMem_Free(bufs);
+    PyMem_Free(lens);
+    url_domain_matcher_free(matcher);
+    Py_XDECREF(rules);
+    return (PyObject *)self;
+}
+
+// DomainMatcher.match(url: str | Buffer) -> int | None
+static PyObject *domain_matcher_match(PyObject *self, PyObject *const *args,
+                                      Py_ssize_t nargs, PyObject *kwnames) {
+    static const fast_args_t spec = {
+        .fname = "match", .names = {"url", NULL}, .required = 1,
+        .max_positional = 1};
+    PyObject *argv[1];
+    if (fast_args_parse(&spec, args, nargs, kwnames, argv) < 0) {
+        return NULL;
+    }
+    const url_domain_matcher_t *matcher =
+        ((DomainMatcherObject *)self)->matcher;
+    Py_buffer view;
+    const char *url;
+    Py_ssize_t url_len;
+    if (get_url_buffer(argv[0], &view, &url, &url_len, "url") < 0) {
+        return NULL;
+    }
+    // clang-format off
+    url_scratch_t scratch = {NULL};
+    size_t rule;
+    if (url_len >= PARSE_RELEASE_GIL_MIN_LEN) {
+        Py_BEGIN_ALLOW_THREADS
+        rule = url_domain_match(matcher, url, (size_t)url_len, &scratch);
+        Py_END_ALLOW_THREADS
+    } else {
+        rule = url_domain_match(matcher, url, (size_t)url_len, &scratch);
+    }
+    // clang-format on
+    url_scratch_free(&scratch);
+    PyBuffer_Release(&view);
+    return domain_match_to_pyobj(rule);
+}
+
+// match_many: each url's rule index, -1 for none
+typedef struct {
+    const url_domain_matcher_t *matcher;
+    int64_t *out;
+    size_t *rules;
+} match_many_t;
+
+static void match_many_kernel(void *ctx, const char **bufs,
+                              const size_t *lens, size_t n,
+                              Py_ssize_t start) {
+    (void)start;
+    match_many_t *mm = ctx;
+    url_domain_match_many(mm->matcher, bufs, lens, n, mm->rules);
+}
+
+static int match_many_convert(void *ctx, PyObject *urls, Py_ssize_t start,
+                              const char **bufs, const size_t *lens,
+                              const char *kinds, size_t n) {
+    (void)urls, (void)bufs, (void)lens, (void)kinds;
+    match_many_t *mm = ctx;
+    for (size_t i = 0; i < n; ++i) {
+        mm->out[start + (Py_ssize_t)i] = mm->rules[i] == URL_DOMAIN_NO_MATCH
+                                             ? -1
+                                             : (int64_t)mm->rules[i];
+    }
+    return 0;
+}
+
+// DomainMatcher.match_many(urls: Iterable[str | Buffer])
+//     -> memoryview (format 'q')
+// The matching rule's index for each url, -1 for none. The urls are matched
+// without the GIL, large batches on the pool.
+static PyObject *domain_matcher_match_many(PyObject *self, PyObject *args,
+                                           PyObject *kwargs) {
+    PyObject *urls_obj;
+    static char *kwlist[] = {"urls", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &urls_obj)) {
+        return NULL;
+    }
+    // Own copy: the items must stay alive while the GIL is released
+    PyObject *urls = PySequence_List(urls_obj);
+    if (!urls) {
+        return NULL;
+    }
+    Py_ssize_t n = PyList_GET_SIZE(urls);
+    PyObject *arr = PyBytes_FromStringAndSize(NULL, n * 8);
+    match_many_t mm = {
+        .matcher = ((DomainMatcherObject *)self)->matcher,
+        .rules = PyMem_Malloc(sizeof(*mm.rules) * batch_block(n))};
+    PyObject *res = NULL;
+    if (arr && !mm.rules) {
+        PyErr_NoMemory();
+    } else if (arr) {
+        mm.out = (int64_t *)PyBytes_AS_STRING(arr);
+        static const batch_ops_t ops = {match_many_kernel,
+                                        match_many_convert};
+        res = batch_run(urls, &ops, &mm) < 0 ? NULL
+                                              : batch_memoryview(arr, "q");
+    }
+    PyMem_Free(mm.rules);
+    Py_XDECREF(arr);
+    Py_DECREF(urls);
+    return res;
+}
+
+static Py_ssize_t domain_matcher_len(PyObject *self) {
+    return PyTuple_GET_SIZE(((DomainMatcherObject *)self)->rules);
+}
+
+static void domain_matcher_dealloc(PyObject *self) {
+    PyTypeObject *type = Py_TYPE(self);
+    DomainMatcherObject *dm = (DomainMatcherObject *)self;
+    url_domain_matcher_free(dm->matcher);
+    Py_XDECREF(dm->rules);
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+static PyMethodDef domain_matcher_methods[] = {
+    {"match", (PyCFunction)(void (*)(void))domain_matcher_match,
+     METH_FASTCALL | METH_KEYWORDS,
+     "Index of the rule matching the url's host, None if no rule does"},
+    {"match_many", (PyCFunction)(void (*)(void))domain_matcher_match_many,
+     METH_VARARGS | METH_KEYWORDS,
+     "match() of every url, as a memoryview of int64 (-1: no match)"},
+    {NULL, NULL, 0, NULL}};
+
+static PyMemberDef domain_matcher_members[] = {
+    {"rules", T_OBJECT, offsetof(DomainMatcherObject, rules), READONLY,
+     "The rules, as a tuple"},
+    {NULL, 0, 0, 0, NULL}};
+
+static PyType_Slot domain_matcher_slots[] = {
+    {Py_tp_doc,
+     "DomainMatcher(rules): host suffix rules compiled once. \"example.com\" "
+     "matches that host and the hosts under it, \"*.example.com\" only the "
+     "hosts under it; the longest matching rule wins"},
+    {Py_tp_new, domain_matcher_new},
+    {Py_tp_dealloc, domain_matcher_dealloc},
+    {Py_tp_methods, domain_matcher_methods},
+    {Py_tp_members, domain_matcher_members},
+    {Py_sq_length, domain_matcher_len},
+    {0, NULL}};
+
+static PyType_Spec domain_matcher_spec = {
+    .name = "abf.urllib.parse.DomainMatcher",
+    .basicsize = sizeof(DomainMatcherObject),
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = domain_matcher_slots,
+};
+
+/*
+ * WhatwgURL: URL Standard parsing (whatwg.c). The object is the href str
+ * plus the component offsets into it; every getter is a substring of it.
+ */
+typedef struct {
+    PyObject_HEAD
+    PyObject *href; // ASCII str, url.href points at its data
+    whatwg_url_t url;
+} WhatwgURLObject;
+
+// Domain to ASCII with str.encode("idna"); decoding back validates "xn--"
+// labels. -1 with no exception set for an invalid domain.
+static ptrdiff_t whatwg_to_ascii(void *ctx, const char *domain, size_t len,
+                                 char *out, size_t cap) {
+    (void)ctx;
+    PyObject *ascii = NULL, *check = NULL;
+    PyObject *str = PyUnicode_DecodeUTF8(domain, (Py_ssize_t)len, NULL);
+    if (str) {
+        ascii = PyObject_CallMethod(str, "encode", "s", "idna");
+        Py_DECREF(str);
+    }
+    if (ascii) {
+        check = PyObject_CallMethod(ascii, "decode", "s", "idna");
+    }
+    ptrdiff_t n = -1;
+    if (check) {
+        Py_DECREF(check);
+        n = (ptrdiff_t)PyBytes_GET_SIZE(ascii);
+        if ((size_t)n > cap) {
+            n = -2;
+        } else {
+            memcpy(out, PyBytes_AS_STRING(ascii), (size_t)n);
+        }
+    } else if (PyErr_ExceptionMatches(PyExc_UnicodeError)) {
+        PyErr_Clear();
+    }
+    Py_XDECREF(ascii);
+    return n;
+}
+
+// Parse url (a str) against base; NULL with ValueError when it is invalid
+static PyObject *whatwg_url_create(PyTypeObject *type, PyObject *url,
+                                   const whatwg_url_t *base) {
+    if (!PyUnicode_Check(url)) {
+        PyErr_Format(PyExc_TypeError, "url must be str, not %.200s",
+                     Py_TYPE(url)->tp_name);
+        return NULL;
+    }
+    Py_ssize_t len;
+    const char *input = PyUnicode_AsUTF8AndSize(url, &len);
+    if (!input) {
+        return NULL;
+    }
+    char stack[1024];
+    char *heap = NULL, *buf = stack;
+    size_t cap = whatwg_buffer_size((size_t)len, base);
+    whatwg_url_t parsed;
+    whatwg_error_t err;
+    for (;;) {
+        if (cap > sizeof(stack)) {
+            buf = heap = PyMem_Malloc(cap);
+            if (!heap) {
+                return PyErr_NoMemory();
+            }
+        } else {
+            cap = sizeof(stack);
+        }
+        err = whatwg_parse(input, (size_t)len, base, whatwg_to_ascii, NULL,
+                           buf, cap, &parsed);
+        if (err != WHATWG_ERROR_NO_SPACE || PyErr_Occurred()) {
+            break;
+        }
+        // Only an IDNA host can outgrow whatwg_buffer_size()
+        PyMem_Free(heap);
+        heap = NULL;
+        cap *= 2;
+    }
+
+    WhatwgURLObject *self = NULL;
+    if (PyErr_Occurred()) {
+        // from the IDNA callback
+    } else if (err != WHATWG_OK) {
+        PyErr_SetString(PyExc_ValueError, whatwg_strerror(err));
+    } else if ((self = (WhatwgURLObject *)type->tp_alloc(type, 0))) {
+        self->href = PyUnicode_New(parsed.href_len, 127);
+        if (!self->href) {
+            Py_CLEAR(self);
+        } else {
+            memcpy(PyUnicode_DATA(self->href), buf, parsed.href_len);
+            self->url = parsed;
+            self->url.href = PyUnicode_DATA(self->href);
+        }
+    }
+    PyMem_Free(heap);
+    return (PyObject *)self;
+}
+
+// A base argument: None, a WhatwgURL or a str parsed first (as a type).
+// *owned keeps a parsed str alive.
+static int whatwg_get_base(PyTypeObject *type, PyObject *base,
+                           const whatwg_url_t **url, PyObject **owned) {
+    *url = NULL;
+    *owned = NULL;
+    if (!base || base == Py_None) {
+        return 0;
+    }
+    if (!PyObject_TypeCheck(base, type)) {
+        base = *owned = whatwg_url_create(type, base, NULL);
+        if (!base) {
+            return -1;
+        }
+    }
+    *url = &((WhatwgURLObject *)base)->url;
+    return 0;
+}
+
+static PyObject *whatwg_url_new(PyTypeObject *type, PyObject *args,
+                                PyObject *kwargs) {
+    PyObject *url = NULL, *base_obj = NULL;
+    static char *kwlist[] = {"url", "base", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", kwlist, &url,
+                                     &base_obj)) {
+        return NULL;
+    }
+    const whatwg_url_t *base;
+    PyObject *owned;
+    if (whatwg_get_base(type, base_obj, &base, &owned) < 0) {
+        return NULL;
+    }
+    PyObject *res = whatwg_url_create(type, url, base);
+    Py_XDECREF(owned);
+    return res;
+}
+
+// WhatwgURL.can_parse(url, base=None) -> bool, like URL.canParse()
+static PyObject *whatwg_url_can_parse(PyObject *cls, PyObject *args,
+                                      PyObject *kwargs) {
+    PyObject *res = whatwg_url_new((PyTypeObject *)cls, args, kwargs);
+    if (res) {
+        Py_DECREF(res);
+        Py_RETURN_TRUE;
+    }
+    if (PyErr_ExceptionMatches(PyExc_ValueError) &&
+        !PyErr_ExceptionMatches(PyExc_UnicodeError)) {
+        PyErr_Clear();
+        Py_RETURN_FALSE;
+    }
+    return NULL;
+}
+
+static inline PyObject *whatwg_url_slice(WhatwgURLObject *self, size_t start,
+                                         size_t end) {
+    return PyUnicode_Substring(self->href, (Py_ssize_t)start,
+                               (Py_ssize_t)end);
+}
+
+static inline uint32_t whatwg_url_path_end(const whatwg_url_t *u) {
+    if (u->search_start != WHATWG_OMITTED) {
+        return u->search_start;
+    }
+    return u->hash_start != WHATWG_OMITTED ? u->hash_start : u->href_len;
+}
+
+static PyObject *whatwg_url_get_href(PyObject *op, void *closure) {
+    (void)closure;
+    PyObject *href = ((WhatwgURLObject *)op)->href;
+    Py_INCREF(href);
+    return href;
+}
+
+static PyObject *whatwg_url_get_protocol(PyObject *op, void *closure) {
+    (void)closure;
+    WhatwgURLObject *self = (WhatwgURLObject *)op;
+    return whatwg_url_slice(self, 0, self->url.protocol_end);
+}
+
+static PyObject *whatwg_url_get_username(PyObject *op, void *closure) {
+    (void)closure;
+    WhatwgURLObject *self = (WhatwgURLObject *)op;
+    return whatwg_url_slice(self, self->url.username_start,
+                            self->url.username_end);
+}
+
+static PyObject *whatwg_url_get_password(PyObject *op, void *closure) {
+    (void)closure;
+    WhatwgURLObject *self = (WhatwgURLObject *)op;
+    return whatwg_url_slice(self, self->url.password_start,
+                            self->url.password_end);
+}
+
+// host is hostname plus ":port" when there is one
+static PyObject *whatwg_url_get_host(PyObject *op, void *closure) {
+    WhatwgURLObject *self = (WhatwgURLObject *)op;
+    uint32_t end = closure ? self->url.host_end : self->url.pathname_start;
+    return whatwg_url_slice(self, self->url.host_start,
+                            self->url.has_authority ? end
+                                                    : self->url.host_start);
+}
+
+static PyObject *whatwg_url_get_port(PyObject *op, void *closure) {
+    (void)closure;
+    WhatwgURLObject *self = (WhatwgURLObject *)op;
+    if (self->url.port < 0) {
+        return PyUnicode_New(0, 0);
+    }
+    return whatwg_url_slice(self, self->url.host_end + 1,
+                            self->url.pathname_start);
+}
+
+static PyObject *whatwg_url_get_pathname(PyObject *op, void *closure) {
+    (void)closure;
+    WhatwgURLObject *self = (WhatwgURLObject *)op;
+    return whatwg_url_slice(self, self->url.pathname_start,
+                            whatwg_url_path_end(&self->url));
+}
+
+// search and hash are "" for both a missing and an empty query / fragment
+static PyObject *whatwg_url_get_search(PyObject *op, void *closure) {
+    (void)closure;
+    WhatwgURLObject *self = (WhatwgURLObject *)op;
+    uint32_t start = self->url.search_start;
+    uint32_t end = self->url.hash_start != WHATWG_OMITTED
+                       ? self->url.hash_start
+                       : self->url.href_len;
+    if (start == WHATWG_OMITTED || end - start == 1) {
+        return PyUnicode_New(0, 0);
+    }
+    return whatwg_url_slice(self, start, end);
+}
+
+static PyObject *whatwg_url_get_hash(PyObject *op, void *closure) {
+    (void)closure;
+    WhatwgURLObject *self = (WhatwgURLObject *)op;
+    uint32_t start = self->url.hash_start;
+    if (start == WHATWG_OMITTED || self->url.href_len - start == 1) {
+        return PyUnicode_New(0, 0);
+    }
+    return whatwg_url_slice(self, start, self->url.href_len);
+}
+
+// Serialized origin: scheme://host[:port] for special schemes but file,
+// the inner URL's for blob:http(s) URLs, "null" for everything else
+static PyObject *whatwg_url_get_origin(PyObject *op, void *closure) {
+    (void)closure;
+    WhatwgURLObject *self = (WhatwgURLObject *)op;
+    const whatwg_url_t *u = &self->url;
+    if (u->scheme != WHATWG_SCHEME_OTHER && u->scheme != WHATWG_SCHEME_FILE) {
+        // scheme "//" host, without the credentials
+        size_t host_len = u->pathname_start - u->host_start;
+        PyObject *res = PyUnicode_New(u->protocol_end + 2 + host_len, 127);
+        if (res) {
+            char *out = PyUnicode_DATA(res);
+            memcpy(out, u->href, u->protocol_end);
+            memcpy(out + u->protocol_end, "//", 2);
+            memcpy(out + u->protocol_end + 2, u->href + u->host_start,
+                   host_len);
+        }
+        return res;
+    }
+    if (u->scheme == WHATWG_SCHEME_OTHER && u->protocol_end == 5 &&
+        memcmp(u->href, "blob:", 5) == 0) {
+        PyObject *path = whatwg_url_get_pathname(op, NULL);
+        PyObject *inner =
+            path ? whatwg_url_create(Py_TYPE(op), path, NULL) : NULL;
+        Py_XDECREF(path);
+        if (!inner) {
+            if (!PyErr_ExceptionMatches(PyExc_ValueError)) {
+                return NULL;
+            }
+            PyErr_Clear();
+        } else {
+            uint8_t scheme = ((WhatwgURLObject *)inner)->url.scheme;
+            PyObject *res =
+                scheme == WHATWG_SCHEME_HTTP || scheme == WHATWG_SCHEME_HTTPS
+                    ? whatwg_url_get_origin(inner, NULL)
+                    : NULL;
+            Py_DECREF(inner);
+            if (res) {
+                return res;
+            }
+        }
+    }
+    return PyUnicode_FromString("null");
+}
+
+static PyObject *whatwg_url_repr(PyObject *op) {
+    return PyUnicode_FromFormat("WhatwgURL(%R)", ((WhatwgURLObject *)op)->href);
+}
+
+static PyObject *whatwg_url_str(PyObject *op) {
+    return whatwg_url_get_href(op, NULL);
+}
+
+static PyObject *whatwg_url_richcompare(PyObject *op, PyObject *other,
+                                        int cmp) {
+    if (!PyObject_TypeCheck(other, Py_TYPE(op)) ||
+        (cmp != Py_EQ && cmp != Py_NE)) {
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+    return PyObject_RichCompare(((WhatwgURLObject *)op)->href,
+                                ((WhatwgURLObject *)other)->href, cmp);
+}
+
+static Py_hash_t whatwg_url_hash(PyObject *op) {
+    return PyObject_Hash(((WhatwgURLObject *)op)->href);
+}
+
+static void whatwg_url_dealloc(PyObject *op) {
+    PyTypeObject *type = Py_TYPE(op);
+    Py_XDECREF(((WhatwgURLObject *)op)->href);
+    type->tp_free(op);
+    Py_DECREF(type);
+}
+
+static PyMethodDef whatwg_url_methods[] = {
+    {"can_parse", (PyCFunction)(void (*)(void))whatwg_url_can_parse,
+     METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+     "Whether url (against base) parses"},
+    {NULL, NULL, 0, NULL}};
+
+static PyGetSetDef whatwg_url_getset[] = {
+    {"href", whatwg_url_get_href, NULL, NULL, NULL},
+    {"protocol", whatwg_url_get_protocol, NULL, NULL, NULL},
+    {"username", whatwg_url_get_username, NULL, NULL, NULL},
+    {"password", whatwg_url_get_password, NULL, NULL, NULL},
+    {"host", whatwg_url_get_host, NULL, NULL, NULL},
+    {"hostname", whatwg_url_get_host, NULL, NULL, (void *)1},
+    {"port", whatwg_url_get_port, NULL, NULL, NULL},
+    {"pathname", whatwg_url_get_pathname, NULL, NULL, NULL},
+    {"search", whatwg_url_get_search, NULL, NULL, NULL},
+    {"hash", whatwg_url_get_hash, NULL, NULL, NULL},
+    {"origin", whatwg_url_get_origin, NULL, NULL, NULL},
+    {NULL, NULL, NULL, NULL, NULL}};
+
+static PyType_Slot whatwg_url_slots[] = {
+    {Py_tp_doc, "WhatwgURL(url, base=None): url parsed as the URL Standard "
+                "(and browsers) do; raises ValueError when it is invalid"},
+    {Py_tp_new, whatwg_url_new},
+    {Py_tp_dealloc, whatwg_url_dealloc},
+    {Py_tp_repr, whatwg_url_repr},
+    {Py_tp_str, whatwg_url_str},
+    {Py_tp_richcompare, whatwg_url_richcompare},
+    {Py_tp_hash, whatwg_url_hash},
+    {Py_tp_methods, whatwg_url_methods},
+    {Py_tp_getset, whatwg_url_getset},
+    {0, NULL}};
+
+static PyType_Spec whatwg_url_spec = {
+    .name = "abf.urllib.parse.WhatwgURL",
+    .basicsize = sizeof(WhatwgURLObject),
+    .flags = Py_TPFLAGS_DEFAULT,
+    .slots = whatwg_url_slots,
+};
+
+static PyMethodDef AbfParseMethods[] = {
+    {"urlparse", (PyCFunction)(void (*)(void))abf_url_parse,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"urlsplit", (PyCFunction)(void (*)(void))abf_urlsplit,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"urlunsplit", (PyCFunction)(void (*)(void))abf_urlunsplit,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"urlunparse", (PyCFunction)(void (*)(void))abf_urlunparse,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"urljoin", (PyCFunction)(void (*)(void))abf_urljoin,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"urlsplit_many", (PyCFunction)(void (*)(void))abf_urlsplit_many,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"urlparse_many", (PyCFunction)(void (*)(void))abf_urlparse_many,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"urlsplit_columns", (PyCFunction)(void (*)(void))abf_urlsplit_columns,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"urlparse_columns", (PyCFunction)(void (*)(void))abf_urlparse_columns,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"iter_urlsplit", (PyCFunction)(void (*)(void))abf_iter_urlsplit,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"iter_urlparse", (PyCFunction)(void (*)(void))abf_iter_urlparse,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"quote", (PyCFunction)(void (*)(void))abf_url_quote,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"quote_plus", (PyCFunction)(void (*)(void))abf_quote_plus,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"quote_from_bytes", (PyCFunction)(void (*)(void))abf_quote_from_bytes,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"urlencode", (PyCFunction)(void (*)(void))abf_urlencode,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"parse_qsl", (PyCFunction)(void (*)(void))abf_parse_qsl,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"parse_qs", (PyCFunction)(void (*)(void))abf_parse_qs,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"unquote", (PyCFunction)(void (*)(void))abf_unquote,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"unquote_plus", (PyCFunction)(void (*)(void))abf_unquote_plus,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"unquote_to_bytes", (PyCFunction)(void (*)(void))abf_unquote_to_bytes,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"canonicalize", (PyCFunction)(void (*)(void))abf_canonicalize,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"fingerprint", (PyCFunction)(void (*)(void))abf_fingerprint,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"canonicalize_many", (PyCFunction)(void (*)(void))abf_canonicalize_many,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"fingerprint_many", (PyCFunction)(void (*)(void))abf_fingerprint_many,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"validate", (PyCFunction)(void (*)(void))abf_validate,
+     METH_FASTCALL | METH_KEYWORDS, ""},
+    {"validate_many", (PyCFunction)(void (*)(void))abf_validate_many,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"set_cache_size", (PyCFunction)(void (*)(void))abf_set_cache_size,
+     METH_VARARGS | METH_KEYWORDS, ""},
+    {"cache_clear", abf_cache_clear, METH_NOARGS, ""},
+    {"cache_info", abf_cache_info, METH_NOARGS, ""},
+    {"stats", abf_stats, METH_NOARGS, ""},
+    {"reset_stats", abf_reset_stats, METH_NOARGS, ""},
+    {"simd_level", abf_simd_level, METH_NOARGS, ""},
+    {NULL, NULL, 0, NULL}};
+
+// Helper: create a type of the module, add it and keep it in *slot
+static int add_type(PyObject *m, const char *name, PyType_Spec *spec,
+                    PyTypeObject **slot) {
+    PyTypeObject *type =
+        (PyTypeObject *)PyType_FromModuleAndSpec(m, spec, NULL);
+    if (!type) {
+        return -1;
+    }
+#if PY_VERSION_HEX < 0x030A0000
+    // No Py_TPFLAGS_DISALLOW_INSTANTIATION: drop the inherited object.__new__
+    bool has_new = false;
+    for (PyType_Slot *s = spec->slots; s->slot; ++s) {
+        has_new |= s->slot == Py_tp_new;
+    }
+    if (!has_new) {
+        type->tp_new = NULL;
+    }
+#endif
+    *slot = type;
+    Py_INCREF(type);
+    if (PyModule_AddObject(m, name, (PyObject *)type) < 0) {
+        Py_DECREF(type);
+        return -1;
+    }
+    return 0;
+}
+
+// Helper: a new reference to attribute name of obj into *slot
+static int get_attr(PyObject *obj, const char *name, PyObject **slot) {
+    *slot = PyObject_GetAttrString(obj, name);
+    return *slot ? 0 : -1;
+}
+
+// Fills in the module_state_t flags that follow the running urllib.parse
+static int probe_stdlib(module_state_t *st, PyObject *urllib_parse) {
+    // Python 3.13 unquotes a bytes query to bytes; before that it is decoded
+    // as ASCII, so a %80 escape cannot be encoded back
+    PyObject *res =
+        PyObject_CallMethod(urllib_parse, "parse_qsl", "y", "a=%80");
+    if (!res && !PyErr_ExceptionMatches(PyExc_UnicodeError)) {
+        return -1;
+    }
+    PyErr_Clear();
+    st->qs_raw_bytes = res != NULL;
+    Py_XDECREF(res);
+
+    // Python 3.12.4 and 3.13 no longer add an empty netloc before a
+    // relative path: "http:path" rather than "http:///path"
+    res = PyObject_CallMethod(urllib_parse, "urlunsplit", "((sssss))", "http",
+                              "", "path", "", "");
+    if (!res) {
+        return -1;
+    }
+    int rc = PyUnicode_CompareWithASCIIString(res, "http:path");
+    Py_DECREF(res);
+    st->unsplit_flags = rc == 0 ? URL_UNSPLIT_EMPTY_NETLOC : 0;
+    return 0;
+}
+
+static int module_exec(PyObject *m) {
+    module_state_t *st = module_state(m);
+
+    PyObject *urllib_parse = PyImport_ImportModule("urllib.parse");
+    if (!urllib_parse) {
+        return -1;
+    }
+    int rc = 0;
+    if (get_attr(urllib_parse, "uses_netloc", &st->uses_netloc) < 0 ||
+        get_attr(urllib_parse, "uses_relative", &st->uses_relative) < 0 ||
+        get_attr(urllib_parse, "quote", &st->quote_via_quote[1]) < 0 ||
+        get_attr(urllib_parse, "quote_plus", &st->quote_via_plus[1]) < 0 ||
+        get_attr(urllib_parse, "SplitResult", &st->split_result_type) < 0 ||
+        get_attr(urllib_parse, "SplitResultBytes",
+                 &st->split_result_bytes_type) < 0 ||
+        get_attr(urllib_parse, "ParseResult", &st->parse_result_type) < 0 ||
+        get_attr(urllib_parse, "ParseResultBytes",
+                 &st->parse_result_bytes_type) < 0 ||
+        probe_stdlib(st, urllib_parse) < 0) {
+        rc = -1;
+    }
+    Py_DECREF(urllib_parse);
+    if (rc < 0) {
+        return -1;
+    }
+    // components_to_result allocates these tuple subclasses directly
+    PyObject *result_types[] = {
+        st->split_result_type, st->split_result_bytes_type,
+        st->parse_result_type, st->parse_result_bytes_type};
+    for (size_t i = 0; i < 4; ++i) {
+        if (!PyType_Check(result_types[i]) ||
+            !PyType_IsSubtype((PyTypeObject *)result_types[i],
+                              &PyTuple_Type)) {
+            PyErr_SetString(PyExc_TypeError,
+                            "urllib.parse result types are not tuples");
+            return -1;
+        }
+    }
+
+    st->CacheInfoType = PyStructSequence_NewType(&cache_info_desc);
+    if (!st->CacheInfoType) {
+        return -1;
+    }
+    st->ValidationError = PyErr_NewExceptionWithDoc(
+        "abf.urllib.parse.ValidationError",
+        "A url validate() rejects; code names the error, offset is where "
+        "it is.",
+        PyExc_ValueError, NULL);
+    if (!st->ValidationError) {
+        return -1;
+    }
+    Py_INCREF(st->ValidationError);
+    if (PyModule_AddObject(m, "ValidationError", st->ValidationError) < 0) {
+        Py_DECREF(st->ValidationError);
+        return -1;
+    }
+
+    if (add_type(m, "LazySplitResult", &lazy_split_result_spec,
+                 &st->LazySplitResultType) < 0 ||
+        add_type(m, "LazyParseResult", &lazy_parse_result_spec,
+                 &st->LazyParseResultType) < 0 ||
+        add_type(m, "UrlColumns", &columns_spec, &st->UrlColumnsType) < 0 ||
+        add_type(m, "UrlStream", &stream_spec, &st->UrlStreamType) < 0 ||
+        add_type(m, "Quoter", &quoter_spec, &st->QuoterType) < 0 ||
+        add_type(m, "Joiner", &joiner_spec, &st->JoinerType) < 0 ||
+        add_type(m, "DomainMatcher", &domain_matcher_spec,
+                 &st->DomainMatcherType) < 0 ||
+        add_type(m, "WhatwgURL", &whatwg_url_spec, &st->WhatwgURLType) < 0) {
+        return -1;
+    }
+    // urlencode recognizes these as quote_via; a cycle through the module
+    // that module_traverse reports
+    if (get_attr(m, "quote", &st->quote_via_quote[0]) < 0 ||
+        get_attr(m, "quote_plus", &st->quote_via_plus[0]) < 0) {
+        return -1;
+    }
+    st->quoter_cache = PyDict_New();
+    st->quoter_plus_cache = PyDict_New();
+    if (!st->quoter_cache || !st->quoter_plus_cache) {
+        return -1;
+    }
+    PyObject *default_safe = PyUnicode_FromString("/");
+    PyObject *default_plus_safe = PyUnicode_FromString("");
+    if (default_safe && default_plus_safe) {
+        st->default_quoter =
+            quoter_create(st->QuoterType, default_safe, false);
+        st->default_plus_quoter =
+            quoter_create(st->QuoterType, default_plus_safe, true);
+    }
+    Py_XDECREF(default_safe);
+    Py_XDECREF(default_plus_safe);
+    if (!st->default_quoter || !st->default_plus_quoter) {
+        return -1;
+    }
+    return 0;
+}
+
+// The state's references, for module_traverse / module_clear
+#define MODULE_STATE_REFS(st, X)                                               \
+    X((st)->split_result_type);                                                \
+    X((st)->split_result_bytes_type);                                          \
+    X((st)->parse_result_type);                                                \
+    X((st)->parse_result_bytes_type);                                          \
+    X((st)->uses_netloc);                                                      \
+    X((st)->uses_relative);                                                    \
+    X((st)->quote_via_quote[0]);                                               \
+    X((st)->quote_via_quote[1]);                                               \
+    X((st)->quote_via_plus[0]);                                                \
+    X((st)->quote_via_plus[1]);                                                \
+    X((st)->LazySplitResultType);                                              \
+    X((st)->LazyParseResultType);                                              \
+    X((st)->UrlColumnsType);                                                   \
+    X((st)->UrlStreamType);                                                    \
+    X((st)->QuoterType);                                                       \
+    X((st)->JoinerType);                                                       \
+    X((st)->DomainMatcherType);                                                \
+    X((st)->WhatwgURLType);                                                    \
+    X((st)->CacheInfoType);                                                    \
+    X((st)->ValidationError);                                                  \
+    X((st)->quoter_cache);                                                     \
+    X((st)->quoter_plus_cache);                                                \
+    X((st)->default_quoter);                                                   \
+    X((st)->default_plus_quoter)
+
+static int module_traverse(PyObject *m, visitproc visit, void *arg) {
+    module_state_t *st = module_state(m);
+    MODULE_STATE_REFS(st, Py_VISIT);
+    return 0;
+}
+
+static int module_clear(PyObject *m) {
+    module_state_t *st = module_state(m);
+    MODULE_STATE_REFS(st, Py_CLEAR);
+    size_t size;
+    cache_entry_t *slots = cache_detach(st, &size);
+    cache_table_free(slots, size);
+    return 0;
+}
+
+static void module_free(void *m) { module_clear((PyObject *)m); }
+
+static PyModuleDef_Slot module_slots[] = {
+    {Py_mod_exec, module_exec},
+#ifdef Py_mod_multiple_interpreters
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_mod_gil
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}};
+
+static struct PyModuleDef module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "parse",
+    .m_doc = "A Bit Faster urllib.parse (C version)",
+    .m_size = sizeof(module_state_t),
+    .m_methods = AbfParseMethods,
+    .m_slots = module_slots,
+    .m_traverse = module_traverse,
+    .m_clear = module_clear,
+    .m_free = module_free,
+};
+
+PyMODINIT_FUNC PyInit_parse(void) { return PyModuleDef_Init(&module); }
@@ -1,8 +1,18 @@
 #define _GNU_SOURCE
 #include "parse.h"
-#include <ctype.h>
+#include "pool.h"
+#include "stats.h"
 #include <inttypes.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <strings.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define P_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define P_SIMD_X86 0
+#endif
 
 enum {
     ASCII_SIZE = 256,
@@ -54,145 +64,962 @@ static inline void p_set_component(url_component_t *comp, const char *start,
     comp->length = len;
 }
 
+static const bool p_UNSAFE_CHARS[ASCII_SIZE] = {
+    ['\t'] = true, ['\r'] = true, ['\n'] = true};
+
+/*
+ * Scratch memory: a list of blocks, newest first, each filled front to back.
+ */
+enum { P_SCRATCH_BLOCK = 4096 };
+
+struct url_scratch_block {
+    struct url_scratch_block *next;
+    size_t len; // bytes in use
+    size_t cap;
+    char data[];
+};
+
+static char *p_scratch_alloc(url_scratch_t *scratch, size_t n) {
+    struct url_scratch_block *b = scratch->head;
+    if (!b || b->cap - b->len < n) {
+        size_t cap = n > P_SCRATCH_BLOCK ? n : P_SCRATCH_BLOCK;
+        b = malloc(sizeof(*b) + cap);
+        if (!b) {
+            return NULL;
+        }
+        b->next = scratch->head;
+        b->len = 0;
+        b->cap = cap;
+        scratch->head = b;
+    }
+    char *p = b->data + b->len;
+    b->len += n;
+    return p;
+}
+
+// Move every block of from to the front of to; to may be shared by threads
+static void p_scratch_splice(url_scratch_t *to, url_scratch_t *from) {
+    struct url_scratch_block *first = from->head, *last = first;
+    if (!first) {
+        return;
+    }
+    while (last->next) {
+        last = last->next;
+    }
+    last->next = __atomic_load_n(&to->head, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&to->head, &last->next, first, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    from->head = NULL;
+}
+
+void url_scratch_reset(url_scratch_t *scratch) {
+    struct url_scratch_block *b = scratch->head;
+    if (!b) {
+        return;
+    }
+    url_scratch_t rest = {b->next};
+    url_scratch_free(&rest);
+    b->next = NULL;
+    b->len = 0;
+}
+
+void url_scratch_free(url_scratch_t *scratch) {
+    struct url_scratch_block *b = scratch->head;
+    while (b) {
+        struct url_scratch_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    scratch->head = NULL;
+}
+
+// clang-format off
+static const bool p_URL_SCHEME_CHARS[ASCII_SIZE] = {
+    ['A' ... 'Z'] = true,
+    ['a' ... 'z'] = true,
+    ['0' ... '9'] = true,
+    ['+'] = true,
+    ['-'] = true,
+    ['.'] = true
+};
+// clang-format on
+
+// Scheme must start with an ASCII letter and contain only scheme chars, the
+// same check urllib.parse does on url[:url.find(':')]
+static inline bool p_is_valid_scheme(const char *url, const char *colon) {
+    if (!url || !colon || colon <= url) {
+        return false;
+    }
+    unsigned char first = (unsigned char)url[0];
+    if (!p_URL_SCHEME_CHARS[first] || (first >= '0' && first <= '9') ||
+        first == '+' || first == '-' || first == '.') {
+        return false;
+    }
+    for (const char *p = url; p < colon; ++p) {
+        if (!p_URL_SCHEME_CHARS[(unsigned char)*p]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Block kernels and CPU dispatch.
+ *
+ * The input is classified in P_BLOCK_SIZE byte blocks into bitmasks (bit i
+ * describes byte i of the block). Each kernel is built once per SIMD level
+ * with a target attribute, so a generic x86-64 build still runs the widest
+ * variant the CPU has; the level is picked when the library is loaded, see
+ * url_simd_level in parse.h.
+ */
+enum { P_BLOCK_SIZE = 64 };
+
+#if P_SIMD_X86
+#define P_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+typedef struct {
+    uint64_t structural; // ':' '/' '?' '#' ';'
+    uint64_t unsafe;     // '\t' '\r' '\n'
+    uint64_t control;    // 0x00 - 0x20 (C0 control or space)
+} p_block_masks_t;
+
+typedef struct {
+    void (*classify)(const char *block, p_block_masks_t *m);
+    // masks[k]: bit i set <=> byte i of the block is bytes[k], count <= 4
+    void (*byte_masks)(const char *block, const char *bytes, size_t count,
+                       uint64_t *masks);
+    // Bit i set <=> byte i of the quote_block bytes at p must be encoded
+    uint64_t (*quote_unsafe)(const char *p, const uint8_t *lo_nibble);
+    size_t quote_block; // 0: the quote loops stay scalar
+} p_kernels_t;
+
+static void p_classify_scalar(const char *block, p_block_masks_t *m) {
+    m->structural = m->unsafe = m->control = 0;
+    for (size_t i = 0; i < P_BLOCK_SIZE; ++i) {
+        unsigned char c = (unsigned char)block[i];
+        uint64_t bit = (uint64_t)1 << i;
+        if (c == ':' || c == '/' || c == '?' || c == '#' || c == ';') {
+            m->structural |= bit;
+        }
+        if (p_UNSAFE_CHARS[c]) {
+            m->unsafe |= bit;
+        }
+        if (c <= URL_WHITESPACE_LAST) {
+            m->control |= bit;
+        }
+    }
+}
+
+static void p_byte_masks_scalar(const char *block, const char *bytes,
+                                size_t count, uint64_t *masks) {
+    for (size_t k = 0; k < count; ++k) {
+        masks[k] = 0;
+    }
+    for (size_t i = 0; i < P_BLOCK_SIZE; ++i) {
+        for (size_t k = 0; k < count; ++k) {
+            if (block[i] == bytes[k]) {
+                masks[k] |= (uint64_t)1 << i;
+            }
+        }
+    }
+}
+
+#if P_SIMD_X86
+
+// SSE4.2: plain byte compares beat PCMPESTRM for a 5 byte set
+P_TARGET("sse4.2")
+static inline void p_classify_16(const char *p, uint32_t *structural,
+                                 uint32_t *unsafe, uint32_t *control) {
+    const __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i s = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+    s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('?')));
+    s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8('#')));
+    s = _mm_or_si128(s, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+    __m128i u = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    u = _mm_or_si128(u, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    const __m128i c = _mm_cmpeq_epi8(
+        _mm_min_epu8(v, _mm_set1_epi8(URL_WHITESPACE_LAST)), v);
+    *structural = (uint32_t)_mm_movemask_epi8(s);
+    *unsafe = (uint32_t)_mm_movemask_epi8(u);
+    *control = (uint32_t)_mm_movemask_epi8(c);
+}
+
+P_TARGET("sse4.2")
+static void p_classify_sse42(const char *block, p_block_masks_t *m) {
+    m->structural = m->unsafe = m->control = 0;
+    for (size_t i = 0; i < P_BLOCK_SIZE; i += 16) {
+        uint32_t s, u, c;
+        p_classify_16(block + i, &s, &u, &c);
+        m->structural |= (uint64_t)s << i;
+        m->unsafe |= (uint64_t)u << i;
+        m->control |= (uint64_t)c << i;
+    }
+}
+
+P_TARGET("sse4.2")
+static void p_byte_masks_sse42(const char *block, const char *bytes,
+                               size_t count, uint64_t *masks) {
+    __m128i v[P_BLOCK_SIZE / 16];
+    for (size_t i = 0; i < P_BLOCK_SIZE / 16; ++i) {
+        v[i] = _mm_loadu_si128((const __m128i *)(block + 16 * i));
+    }
+    for (size_t k = 0; k < count; ++k) {
+        const __m128i c = _mm_set1_epi8(bytes[k]);
+        uint64_t mask = 0;
+        for (size_t i = 0; i < P_BLOCK_SIZE / 16; ++i) {
+            mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(
+                        _mm_cmpeq_epi8(v[i], c))
+                    << (16 * i);
+        }
+        masks[k] = mask;
+    }
+}
+
+// pshufb picks the row of the low nibble, then the bit of the high nibble;
+// bytes >= 0x80 select no bit and are never safe
+P_TARGET("sse4.2")
+static uint64_t p_quote_unsafe_sse42(const char *p, const uint8_t *lo_nibble) {
+    const __m128i table = _mm_loadu_si128((const __m128i *)lo_nibble);
+    const __m128i v = _mm_loadu_si128((const __m128i *)p);
+    const __m128i bitsel = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 0,
+                                         0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(NIBBLE_MASK);
+    const __m128i row = _mm_shuffle_epi8(table, _mm_and_si128(v, nibble));
+    const __m128i bit = _mm_shuffle_epi8(
+        bitsel, _mm_and_si128(_mm_srli_epi16(v, NIBBLE_BITS), nibble));
+    const __m128i safe = _mm_and_si128(row, bit);
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(safe, _mm_setzero_si128()));
+}
+
+P_TARGET("avx2")
+static inline void p_classify_32(const char *p, uint32_t *structural,
+                                 uint32_t *unsafe, uint32_t *control) {
+    const __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i s = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')));
+    s = _mm256_or_si256(s, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('?')));
+    s = _mm256_or_si256(s, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#')));
+    s = _mm256_or_si256(s, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+    __m256i u = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    u = _mm256_or_si256(u, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    const __m256i c = _mm256_cmpeq_epi8(
+        _mm256_min_epu8(v, _mm256_set1_epi8(URL_WHITESPACE_LAST)), v);
+    *structural = (uint32_t)_mm256_movemask_epi8(s);
+    *unsafe = (uint32_t)_mm256_movemask_epi8(u);
+    *control = (uint32_t)_mm256_movemask_epi8(c);
+}
+
+P_TARGET("avx2")
+static void p_classify_avx2(const char *block, p_block_masks_t *m) {
+    uint32_t s_lo, s_hi, u_lo, u_hi, c_lo, c_hi;
+    p_classify_32(block, &s_lo, &u_lo, &c_lo);
+    p_classify_32(block + 32, &s_hi, &u_hi, &c_hi);
+    m->structural = (uint64_t)s_hi << 32 | s_lo;
+    m->unsafe = (uint64_t)u_hi << 32 | u_lo;
+    m->control = (uint64_t)c_hi << 32 | c_lo;
+}
+
+P_TARGET("avx2")
+static void p_byte_masks_avx2(const char *block, const char *bytes,
+                              size_t count, uint64_t *masks) {
+    const __m256i lo = _mm256_loadu_si256((const __m256i *)block);
+    const __m256i hi = _mm256_loadu_si256((const __m256i *)(block + 32));
+    for (size_t k = 0; k < count; ++k) {
+        const __m256i c = _mm256_set1_epi8(bytes[k]);
+        masks[k] = (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                       _mm256_cmpeq_epi8(hi, c))
+                       << 32 |
+                   (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, c));
+    }
+}
+
+P_TARGET("avx2")
+static uint64_t p_quote_unsafe_avx2(const char *p, const uint8_t *lo_nibble) {
+    const __m256i table = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)lo_nibble));
+    const __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    const __m256i bitsel = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i nibble = _mm256_set1_epi8(NIBBLE_MASK);
+    const __m256i row = _mm256_shuffle_epi8(table, _mm256_and_si256(v, nibble));
+    const __m256i bit = _mm256_shuffle_epi8(
+        bitsel, _mm256_and_si256(_mm256_srli_epi16(v, NIBBLE_BITS), nibble));
+    const __m256i safe = _mm256_and_si256(row, bit);
+    return (uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(safe, _mm256_setzero_si256()));
+}
+
+P_TARGET("avx512bw")
+static void p_classify_avx512bw(const char *block, p_block_masks_t *m) {
+    const __m512i v = _mm512_loadu_si512((const void *)block);
+    m->structural = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(':')) |
+                    _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('/')) |
+                    _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('?')) |
+                    _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('#')) |
+                    _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(';'));
+    m->unsafe = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\t')) |
+                _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\r')) |
+                _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\n'));
+    m->control =
+        _mm512_cmple_epu8_mask(v, _mm512_set1_epi8(URL_WHITESPACE_LAST));
+}
+
+P_TARGET("avx512bw")
+static void p_byte_masks_avx512bw(const char *block, const char *bytes,
+                                  size_t count, uint64_t *masks) {
+    const __m512i v = _mm512_loadu_si512((const void *)block);
+    for (size_t k = 0; k < count; ++k) {
+        masks[k] = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(bytes[k]));
+    }
+}
+
+P_TARGET("avx512bw")
+static uint64_t p_quote_unsafe_avx512bw(const char *p,
+                                        const uint8_t *lo_nibble) {
+    const __m512i table = _mm512_broadcast_i32x4(
+        _mm_loadu_si128((const __m128i *)lo_nibble));
+    const __m512i v = _mm512_loadu_si512((const void *)p);
+    const __m512i bitsel = _mm512_broadcast_i32x4(_mm_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m512i nibble = _mm512_set1_epi8(NIBBLE_MASK);
+    const __m512i row = _mm512_shuffle_epi8(table, _mm512_and_si512(v, nibble));
+    const __m512i bit = _mm512_shuffle_epi8(
+        bitsel, _mm512_and_si512(_mm512_srli_epi16(v, NIBBLE_BITS), nibble));
+    return ~(uint64_t)_mm512_test_epi8_mask(row, bit);
+}
+
+#endif
+
+static const p_kernels_t p_KERNELS[URL_SIMD_LEVELS] = {
+    [URL_SIMD_SCALAR] = {.classify = p_classify_scalar,
+                         .byte_masks = p_byte_masks_scalar},
+#if P_SIMD_X86
+    [URL_SIMD_SSE42] = {.classify = p_classify_sse42,
+                        .byte_masks = p_byte_masks_sse42,
+                        .quote_unsafe = p_quote_unsafe_sse42,
+                        .quote_block = 16},
+    [URL_SIMD_AVX2] = {.classify = p_classify_avx2,
+                       .byte_masks = p_byte_masks_avx2,
+                       .quote_unsafe = p_quote_unsafe_avx2,
+                       .quote_block = 32},
+    [URL_SIMD_AVX512BW] = {.classify = p_classify_avx512bw,
+                           .byte_masks = p_byte_masks_avx512bw,
+                           .quote_unsafe = p_quote_unsafe_avx512bw,
+                           .quote_block = 64},
+#endif
+};
+
+static struct {
+    const p_kernels_t *kernels;
+    url_simd_level_t level;
+} p_simd = {.kernels = &p_KERNELS[URL_SIMD_SCALAR], .level = URL_SIMD_SCALAR};
+
+static inline const p_kernels_t *p_kernels(void) {
+    return __atomic_load_n(&p_simd.kernels, __ATOMIC_RELAXED);
+}
+
+static const char *const p_SIMD_NAMES[URL_SIMD_LEVELS] = {
+    [URL_SIMD_SCALAR] = "scalar",
+    [URL_SIMD_SSE42] = "sse4.2",
+    [URL_SIMD_AVX2] = "avx2",
+    [URL_SIMD_AVX512BW] = "avx512bw"};
+
+const char *url_simd_name(url_simd_level_t level) {
+    return level < URL_SIMD_LEVELS ? p_SIMD_NAMES[level] : NULL;
+}
+
+url_simd_level_t url_simd_supported(void) {
+#if P_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        return URL_SIMD_AVX512BW;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return URL_SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return URL_SIMD_SSE42;
+    }
+#endif
+    return URL_SIMD_SCALAR;
+}
+
+url_simd_level_t url_simd_level(void) {
+    return __atomic_load_n(&p_simd.level, __ATOMIC_RELAXED);
+}
+
+url_simd_level_t url_simd_select(url_simd_level_t level) {
+    url_simd_level_t best = url_simd_supported();
+    if (level > best) {
+        level = best;
+    }
+    // Every level gives the same results, so calls already running may
+    // finish on the old kernels
+    __atomic_store_n(&p_simd.level, level, __ATOMIC_RELAXED);
+    __atomic_store_n(&p_simd.kernels, &p_KERNELS[level], __ATOMIC_RELAXED);
+    return level;
+}
+
+__attribute__((constructor)) static void p_simd_init(void) {
+    url_simd_level_t level = URL_SIMD_LEVELS;
+    const char *env = getenv("ABF_URLLIB_SIMD");
+    if (env && *env) {
+        for (int i = 0; i < URL_SIMD_LEVELS; ++i) {
+            if (strcasecmp(env, p_SIMD_NAMES[i]) == 0) {
+                level = (url_simd_level_t)i;
+            }
+        }
+    }
+    url_simd_select(level);
+}
+
+// Classify the last, partial block: pad it with a byte that belongs to no
+// class and drop the bits past the end
+static inline void p_classify_tail(const p_kernels_t *k, const char *block,
+                                   size_t n, p_block_masks_t *m) {
+    char tmp[P_BLOCK_SIZE];
+    memset(tmp, 'a', sizeof(tmp));
+    memcpy(tmp, block, n);
+    k->classify(tmp, m);
+    uint64_t valid = ((uint64_t)1 << n) - 1;
+    m->structural &= valid;
+    m->unsafe &= valid;
+    m->control &= valid;
+}
+
+static inline void p_classify(const p_kernels_t *k, const char *p, size_t n,
+                              p_block_masks_t *m) {
+    if (n >= P_BLOCK_SIZE) {
+        k->classify(p, m);
+    } else {
+        p_classify_tail(k, p, n, m);
+    }
+}
+
+// Leading C0 controls and spaces, as urllib.parse strips them
 static inline void p_lstrip_ws(const char **url, size_t *url_len) {
-    size_t i = 0, n = *url_len;
-    const char *tmp_str = *url;
-    while (i < n && (unsigned char)tmp_str[i] <= URL_WHITESPACE_LAST) {
-        i++;
+    const char *p = *url;
+    size_t n = *url_len, i = 0;
+    if (n == 0 || (unsigned char)p[0] > URL_WHITESPACE_LAST) {
+        return; // the common case needs no block
+    }
+    const p_kernels_t *k = p_kernels();
+    for (size_t off = 0; off < n; off += P_BLOCK_SIZE) {
+        p_block_masks_t m;
+        p_classify(k, p + off, n - off, &m);
+        uint64_t kept = ~m.control;
+        if (kept) {
+            i = off + (size_t)__builtin_ctzll(kept);
+            break;
+        }
+        i = off + P_BLOCK_SIZE;
+    }
+    if (i > n) {
+        i = n; // a partial block's padding never counts as control
     }
-    *url = tmp_str + i;
+    *url = p + i;
     *url_len = n - i;
 }
 
-static inline void p_rstrip_ws(const char **url, size_t *url_len) {
-    size_t n = *url_len;
-    const char *tmp_str = *url;
+// Copy url without its unsafe bytes, one memcpy per run between them;
+// returns the copied length
+static size_t p_copy_safe_bytes(char *out, const char *url, size_t url_len) {
+    const p_kernels_t *k = p_kernels();
+    size_t run = 0; // start of the run not yet copied
+    size_t n = 0;
+    for (size_t off = 0; off < url_len; off += P_BLOCK_SIZE) {
+        p_block_masks_t m;
+        p_classify(k, url + off, url_len - off, &m);
+        uint64_t bits = m.unsafe;
+        while (bits) {
+            size_t pos = off + (size_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            memcpy(out + n, url + run, pos - run);
+            n += pos - run;
+            run = pos + 1;
+        }
+    }
+    memcpy(out + n, url + run, url_len - run);
+    return n + url_len - run;
+}
+
+/*
+ * Structural scanner.
+ *
+ * The split state machine below only visits the set bits of the structural
+ * mask, so every component boundary is found in one pass over the input
+ * instead of separate memchr/byte loops for the scheme, netloc, fragment and
+ * query.
+ */
+
+typedef enum {
+    P_SCAN_SCHEME,
+    P_SCAN_NETLOC,
+    P_SCAN_PATH,
+    P_SCAN_QUERY,
+    P_SCAN_DONE
+} p_scan_state_t;
+
+enum { P_SCAN_NONE = SIZE_MAX };
 
-    while (n > 0 && (unsigned char)tmp_str[n - 1] <= URL_WHITESPACE_LAST) {
-        n--;
+typedef struct {
+    const char *url;
+    size_t len;
+    bool allow_fragments;
+    p_scan_state_t state;
+    size_t next;       // delimiters below this offset are already consumed
+    size_t start;      // start of the component being scanned
+    size_t semicolon;  // first ';' after the last '/' of the path
+} p_scanner_t;
+
+// After the scheme is decided: "//" starts a netloc, anything else a path
+static inline void p_scan_begin(p_scanner_t *sc, size_t rest) {
+    if (sc->len - rest >= 2 && sc->url[rest] == '/' &&
+        sc->url[rest + 1] == '/') {
+        sc->state = P_SCAN_NETLOC;
+        sc->start = rest + 2;
+    } else {
+        sc->state = P_SCAN_PATH;
+        sc->start = rest;
     }
+    sc->next = sc->start;
+}
 
-    *url = tmp_str;
-    *url_len = n;
+// Feed one structural byte at offset pos to the split state machine
+static inline void p_scan_delim(p_scanner_t *sc, size_t pos,
+                                url_split_result_t *result) {
+    const char *url = sc->url;
+    const char c = url[pos];
+    for (;;) {
+        switch (sc->state) {
+        case P_SCAN_SCHEME: {
+            size_t rest = 0;
+            if (c == ':' && p_is_valid_scheme(url, url + pos)) {
+                p_set_component(&result->scheme, url, pos);
+                rest = pos + 1;
+            } else if (c == ':') {
+                URL_STAT_INC(URL_STAT_INVALID_SCHEME);
+            }
+            p_scan_begin(sc, rest);
+            if (pos < sc->next) {
+                return;
+            }
+            continue; // re-dispatch pos in the new state
+        }
+        case P_SCAN_NETLOC:
+            if (c == '/' || c == '?' || c == '#') {
+                p_set_component(&result->netloc, url + sc->start,
+                                pos - sc->start);
+                sc->state = P_SCAN_PATH;
+                sc->start = pos;
+                continue;
+            }
+            return;
+        case P_SCAN_PATH:
+            if (c == '/') {
+                sc->semicolon = P_SCAN_NONE;
+            } else if (c == ';') {
+                if (sc->semicolon == P_SCAN_NONE) {
+                    sc->semicolon = pos;
+                }
+            } else if (c == '?') {
+                p_set_component(&result->path, url + sc->start,
+                                pos - sc->start);
+                sc->state = P_SCAN_QUERY;
+                sc->start = pos + 1;
+            } else if (c == '#' && sc->allow_fragments) {
+                p_set_component(&result->path, url + sc->start,
+                                pos - sc->start);
+                p_set_component(&result->fragment, url + pos + 1,
+                                sc->len - pos - 1);
+                sc->state = P_SCAN_DONE;
+            }
+            return;
+        case P_SCAN_QUERY:
+            if (c == '#' && sc->allow_fragments) {
+                p_set_component(&result->query, url + sc->start,
+                                pos - sc->start);
+                p_set_component(&result->fragment, url + pos + 1,
+                                sc->len - pos - 1);
+                sc->state = P_SCAN_DONE;
+            }
+            return;
+        case P_SCAN_DONE:
+            return;
+        }
+    }
 }
 
-static const bool p_UNSAFE_CHARS[ASCII_SIZE] = {
-    ['\t'] = true, ['\r'] = true, ['\n'] = true};
+// Close the component that runs up to the end of the input
+static inline void p_scan_end(p_scanner_t *sc, url_split_result_t *result) {
+    const char *url = sc->url;
+    switch (sc->state) {
+    case P_SCAN_SCHEME:
+        p_scan_begin(sc, 0);
+        p_set_component(&result->path, url, sc->len);
+        break;
+    case P_SCAN_NETLOC:
+        p_set_component(&result->netloc, url + sc->start,
+                        sc->len - sc->start);
+        p_set_component(&result->path, url + sc->len, 0);
+        break;
+    case P_SCAN_PATH:
+        p_set_component(&result->path, url + sc->start, sc->len - sc->start);
+        break;
+    case P_SCAN_QUERY:
+        p_set_component(&result->query, url + sc->start, sc->len - sc->start);
+        break;
+    case P_SCAN_DONE:
+        break;
+    }
+}
+
+// One pass over url. Returns false as soon as an unsafe byte is seen: those
+// must be removed before any boundary can be trusted.
+static bool p_scan(const char *url, size_t url_len, bool allow_fragments,
+                   url_split_result_t *result, size_t *semicolon) {
+    p_scanner_t sc = {.url = url,
+                      .len = url_len,
+                      .allow_fragments = allow_fragments,
+                      .state = P_SCAN_SCHEME,
+                      .next = 0,
+                      .start = 0,
+                      .semicolon = P_SCAN_NONE};
 
-// Helper: remove unsafe bytes from a buffer inline
-static inline void p_remove_unsafe_bytes(char **url, size_t *url_len) {
-    char *buf = *url;
-    size_t len = *url_len;
-    size_t out = 0;
-    for (size_t i = 0; i < len; ++i) {
-        unsigned const char c = buf[i];
-        bool is_unsafe = p_UNSAFE_CHARS[c];
-        if (!is_unsafe) {
-            if (out != i) {
-                buf[out] = buf[i];
+    const p_kernels_t *k = p_kernels();
+    for (size_t off = 0; off < url_len; off += P_BLOCK_SIZE) {
+        p_block_masks_t m;
+        p_classify(k, url + off, url_len - off, &m);
+        if (m.unsafe) {
+            return false;
+        }
+        uint64_t bits = sc.state == P_SCAN_DONE ? 0 : m.structural;
+        while (bits) {
+            size_t pos = off + (size_t)__builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (pos >= sc.next) {
+                p_scan_delim(&sc, pos, result);
+                if (sc.state == P_SCAN_DONE) {
+                    break;
+                }
             }
-            out++;
         }
     }
-    *url_len = out;
+    *semicolon = sc.semicolon;
+    p_scan_end(&sc, result);
+    return true;
 }
 
-static inline bool p_is_valid_scheme(const char *url, const char *colon) {
-    if (!url || !colon || colon <= url) {
+/*
+ * Netloc sub-components. Netlocs are short, so a plain pass over the netloc
+ * bytes follows the block scan rather than widening its structural class.
+ */
+static inline bool p_is_hex(char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+// Dotted quad as ipaddress.IPv4Address takes it: no leading zeros
+static bool p_is_ipv4(const char *s, size_t n) {
+    const char *end = s + n;
+    for (int octet = 0; octet < 4; ++octet) {
+        const char *dot = memchr(s, '.', (size_t)(end - s));
+        const char *stop = octet < 3 ? dot : end;
+        if (!stop || (octet == 3 && dot)) {
+            return false;
+        }
+        size_t len = (size_t)(stop - s);
+        if (len == 0 || len > 3 || (len > 1 && s[0] == '0')) {
+            return false;
+        }
+        unsigned value = 0;
+        for (size_t i = 0; i < len; ++i) {
+            if (s[i] < '0' || s[i] > '9') {
+                return false;
+            }
+            value = value * 10 + (unsigned)(s[i] - '0');
+        }
+        if (value > 255) {
+            return false;
+        }
+        s = stop + 1;
+    }
+    return true;
+}
+
+enum { P_IPV6_HEXTETS = 8, P_IPV6_MAX_PARTS = P_IPV6_HEXTETS + 1 };
+
+// ipaddress.IPv6Address rules: an optional %scope, at most one "::" and an
+// optional IPv4 tail counting for two hextets
+static bool p_is_ipv6(const char *s, size_t n) {
+    const char *pct = memchr(s, '%', n);
+    if (pct) {
+        size_t scope = n - (size_t)(pct - s) - 1;
+        if (!scope || memchr(pct + 1, '%', scope)) {
+            return false;
+        }
+        n = (size_t)(pct - s);
+    }
+    if (!n) {
         return false;
     }
-    if (!isalpha(url[0])) {
+
+    size_t starts[P_IPV6_MAX_PARTS], lens[P_IPV6_MAX_PARTS], k = 0;
+    for (size_t i = 0;;) {
+        const char *colon = memchr(s + i, ':', n - i);
+        size_t e = colon ? (size_t)(colon - s) : n;
+        if (k == P_IPV6_MAX_PARTS) {
+            return false;
+        }
+        starts[k] = i;
+        lens[k++] = e - i;
+        if (!colon) {
+            break;
+        }
+        i = e + 1;
+    }
+    if (k < 3) {
         return false;
     }
-    for (const char *p = url; p < colon; ++p) {
-        if (!(isalnum(*p) || *p == '+' || *p == '-' || *p == '.')) {
+    bool v4 = memchr(s + starts[k - 1], '.', lens[k - 1]) != NULL;
+    if (v4 && !p_is_ipv4(s + starts[k - 1], lens[k - 1])) {
+        return false;
+    }
+    size_t nhex = v4 ? k - 1 : k; // parts that are hextets
+    size_t nparts = v4 ? k + 1 : k;
+    if (nparts > P_IPV6_MAX_PARTS) {
+        return false;
+    }
+
+    size_t skip = P_SCAN_NONE;
+    for (size_t j = 1; j + 1 < nparts; ++j) {
+        if (j < nhex && !lens[j]) {
+            if (skip != P_SCAN_NONE) {
+                return false;
+            }
+            skip = j;
+        }
+    }
+    bool first_empty = !lens[0];
+    bool last_empty = !v4 && !lens[k - 1];
+    size_t hi, lo;
+    if (skip != P_SCAN_NONE) {
+        hi = skip;
+        lo = nparts - skip - 1;
+        if ((first_empty && --hi) || (last_empty && --lo) ||
+            hi + lo >= P_IPV6_HEXTETS) {
+            return false;
+        }
+    } else {
+        if (nparts != P_IPV6_HEXTETS || first_empty || last_empty) {
             return false;
         }
+        hi = nparts;
+        lo = 0;
+    }
+    for (size_t j = 0; j < nhex; ++j) {
+        if (j >= hi && j < nparts - lo) {
+            continue;
+        }
+        if (!lens[j] || lens[j] > 4) {
+            return false;
+        }
+        for (size_t i = 0; i < lens[j]; ++i) {
+            if (!p_is_hex(s[starts[j] + i])) {
+                return false;
+            }
+        }
     }
     return true;
 }
 
-static inline size_t p_extract_netloc(const char *url, size_t url_len) {
-    size_t netloc_len = 0;
-    while (netloc_len < url_len && url[netloc_len] != '/' &&
-           url[netloc_len] != '?' && url[netloc_len] != '#') {
-        netloc_len++;
+// urllib.parse's _check_bracketed_host: IPvFuture ("v" hex+ "." any+) or an
+// IPv6 address (an IPv4 address may not be bracketed). RFC 3986 also takes
+// a "V", urllib does not.
+static bool p_is_bracketed_host(const char *s, size_t n, bool rfc) {
+    if (n && (s[0] == 'v' || (rfc && s[0] == 'V'))) {
+        size_t i = 1;
+        while (i < n && p_is_hex(s[i])) {
+            ++i;
+        }
+        return i > 1 && i + 1 < n && s[i] == '.';
     }
-    return netloc_len;
+    return p_is_ipv6(s, n);
 }
 
-// Faster url_split implementation (no unicode, no CPython API)
-url_parse_error_t url_split(char *url, size_t url_len, const char *scheme,
-                            bool allow_fragments, url_split_result_t *result) {
-    // Init
+static url_parse_error_t p_split_netloc(const char *netloc, size_t len,
+                                        bool rfc, url_netloc_t *out) {
+    memset(out, 0, sizeof(*out));
+    if (!len) {
+        return URL_PARSE_OK;
+    }
+    const char *end = netloc + len;
+
+    // urlsplit's checks look at the whole netloc, userinfo included
+    const char *open = memchr(netloc, '[', len);
+    const char *close = memchr(netloc, ']', len);
+    if (!open != !close) {
+        return URL_PARSE_ERROR_INVALID_IPV6;
+    }
+    if (open) {
+        const char *stop = memchr(open + 1, ']', (size_t)(end - open - 1));
+        if (!p_is_bracketed_host(open + 1,
+                                 (size_t)((stop ? stop : end) - open - 1),
+                                 rfc)) {
+            return URL_PARSE_ERROR_INVALID_NETLOC;
+        }
+    }
+
+    // userinfo up to the last '@', split at its first ':'
+    const char *host = netloc;
+    const char *at = memrchr(netloc, '@', len);
+    if (at) {
+        const char *colon = memchr(netloc, ':', (size_t)(at - netloc));
+        const char *user_end = colon ? colon : at;
+        p_set_component(&out->username, netloc, (size_t)(user_end - netloc));
+        if (colon) {
+            p_set_component(&out->password, colon + 1,
+                            (size_t)(at - colon - 1));
+        }
+        host = at + 1;
+    }
+
+    // hostinfo: "[host]...:port" or "host:port"
+    const char *host_end, *colon;
+    const char *bracket = memchr(host, '[', (size_t)(end - host));
+    if (bracket) {
+        host = bracket + 1;
+        host_end = memchr(host, ']', (size_t)(end - host));
+        colon = host_end ? memchr(host_end, ':', (size_t)(end - host_end))
+                         : NULL;
+    } else {
+        colon = memchr(host, ':', (size_t)(end - host));
+        host_end = colon;
+    }
+    if (!host_end) {
+        host_end = end;
+    }
+    p_set_component(&out->hostname, host, (size_t)(host_end - host));
+    if (colon && colon + 1 < end) {
+        p_set_component(&out->port, colon + 1, (size_t)(end - colon - 1));
+    }
+    // The scope of a scoped IPv6 address keeps its case
+    for (const char *p = host; p < host_end && *p != '%'; ++p) {
+        if (*p >= 'A' && *p <= 'Z') {
+            out->host_upper = true;
+            break;
+        }
+    }
+    return URL_PARSE_OK;
+}
+
+// Shared by url_split and url_parse. *semicolon gets the offset of the first
+// ';' after the last '/' of the path (P_SCAN_NONE if there is none).
+static inline void p_reset_split_result(url_split_result_t *result) {
     p_set_component(&result->scheme, NULL, 0);
     p_set_component(&result->netloc, NULL, 0);
     p_set_component(&result->path, NULL, 0);
     p_set_component(&result->query, NULL, 0);
     p_set_component(&result->fragment, NULL, 0);
+    memset(&result->netloc_parts, 0, sizeof(result->netloc_parts));
+}
+
+static url_parse_error_t p_split(const char *url, size_t url_len,
+                                 const char *scheme, bool allow_fragments,
+                                 url_scratch_t *scratch,
+                                 url_split_result_t *result,
+                                 const char **semicolon) {
+    p_reset_split_result(result);
+    URL_STAT_INC(URL_STAT_SPLIT);
+    URL_STAT_LEN(url_len);
 
     // Strip only leading spaces/control chars (WHATWG also strip trailing) as
     // urllib.parse does
-    p_lstrip_ws((const char **)&url, &url_len);
-    p_remove_unsafe_bytes(&url, &url_len);
-
-    // Scheme detection
-    const char *colon = memchr(url, ':', url_len);
-    if (colon) {
-        // Prepare scheme for validation
-        const char *scheme_start = url;
-        size_t scheme_len = (size_t)(colon - url);
-        p_lstrip_ws(
-            &scheme_start,
-            &scheme_len); // Strip both sides for scheme as urllib.parse does
-        p_rstrip_ws(&scheme_start, &scheme_len);
-        if (p_is_valid_scheme(scheme_start, scheme_start + scheme_len)) {
-            p_set_component(&result->scheme, scheme_start, scheme_len);
-            url_len -= (colon - url + 1);
-            url = (char *)colon + 1;
-        } else if (scheme && scheme_len) {
-            p_set_component(&result->scheme, scheme, scheme_len);
-        }
-    }
-
-    // Netloc
-    if (url_len >= 2 && url[0] == '/' && url[1] == '/') {
-        url += 2;
-        url_len -= 2;
-        size_t netloc_len = p_extract_netloc(url, url_len);
-        p_set_component(&result->netloc, url, netloc_len);
-        url += netloc_len;
-        url_len -= netloc_len;
-    }
-
-    // Fragment
-    if (allow_fragments) {
-        const char *frag = memchr(url, '#', url_len);
-        if (frag) {
-            p_set_component(&result->fragment, frag + 1,
-                            url + url_len - (frag + 1));
-            url_len = frag - url;
-        }
-    }
-
-    // Query
-    const char *qmark = memchr(url, '?', url_len);
-    if (qmark) {
-        p_set_component(&result->query, qmark + 1, url + url_len - (qmark + 1));
-        url_len = qmark - url;
-    }
-
-    // Path
-    p_set_component(&result->path, url, url_len);
-    return URL_PARSE_OK;
+    p_lstrip_ws(&url, &url_len);
+
+    size_t semi = P_SCAN_NONE;
+    if (!p_scan(url, url_len, allow_fragments, result, &semi)) {
+        // Rare path: scan a copy without '\t', '\r', '\n'. The scan itself
+        // is the check, so a clean url is never copied.
+        URL_STAT_INC(URL_STAT_UNSAFE_COPY);
+        char *copy = p_scratch_alloc(scratch, url_len);
+        if (!copy) {
+            return URL_PARSE_ERROR_OUT_OF_MEMORY;
+        }
+        url_len = p_copy_safe_bytes(copy, url, url_len);
+        url = copy;
+        p_reset_split_result(result);
+        p_scan(url, url_len, allow_fragments, result, &semi);
+    }
+    p_set_component(&result->source, url, url_len);
+
+    if (!result->scheme.start && scheme) {
+        p_set_component(&result->scheme, scheme, strlen(scheme));
+    }
+    // The path ends where the scan left the path state, so a ';' found there
+    // is always inside the path component
+    *semicolon = semi == P_SCAN_NONE ? NULL : url + semi;
+    url_parse_error_t err =
+        p_split_netloc(result->netloc.start, result->netloc.length, false,
+                       &result->netloc_parts);
+    if (err != URL_PARSE_OK) {
+        URL_STAT_INC(URL_STAT_INVALID_NETLOC);
+    }
+    return err;
+}
+
+const char *url_parse_strerror(url_parse_error_t err) {
+    switch (err) {
+    case URL_PARSE_OK:
+        return "no error";
+    case URL_PARSE_ERROR_INVALID_IPV6:
+        return "Invalid IPv6 URL";
+    case URL_PARSE_ERROR_INVALID_NETLOC:
+        return "Invalid bracketed host in netloc";
+    case URL_PARSE_ERROR_OUT_OF_MEMORY:
+        return "out of memory";
+    case URL_PARSE_ERROR_INVALID_INPUT:
+        return "invalid input";
+    case URL_PARSE_ERROR_ABORTED:
+        return "aborted";
+    case URL_PARSE_ERROR_INVALID_SCHEME:
+        return "invalid scheme";
+    case URL_PARSE_ERROR_INVALID_CHAR:
+        return "invalid character";
+    case URL_PARSE_ERROR_INVALID_ESCAPE:
+        return "invalid percent-escape";
+    case URL_PARSE_ERROR_INVALID_PORT:
+        return "invalid port";
+    default:
+        return "parse error";
+    }
+}
+
+// Faster url_split implementation (no unicode, no CPython API)
+url_parse_error_t url_split(const char *url, size_t url_len,
+                            const char *scheme, bool allow_fragments,
+                            url_scratch_t *scratch,
+                            url_split_result_t *result) {
+    const char *semicolon;
+    return p_split(url, url_len, scheme, allow_fragments, scratch, result,
+                   &semicolon);
 }
 
 // url_parse: also split params as urllib.parse does
-url_parse_error_t url_parse(char *url, size_t url_len, const char *scheme,
-                            bool allow_fragments, url_parse_result_t *result) {
+url_parse_error_t url_parse(const char *url, size_t url_len,
+                            const char *scheme, bool allow_fragments,
+                            url_scratch_t *scratch,
+                            url_parse_result_t *result) {
     url_split_result_t split;
-    url_parse_error_t err =
-        url_split(url, url_len, scheme, allow_fragments, &split);
+    const char *semicolon;
+    URL_STAT_INC(URL_STAT_PARSE);
+    url_parse_error_t err = p_split(url, url_len, scheme, allow_fragments,
+                                    scratch, &split, &semicolon);
     if (err != URL_PARSE_OK) {
         return err;
     }
@@ -202,78 +1029,406 @@ url_parse_error_t url_parse(char *url, size_t url_len, const char *scheme,
     result->path = split.path;
     result->query = split.query;
     result->fragment = split.fragment;
+    result->netloc_parts = split.netloc_parts;
+    result->source = split.source;
     result->has_params = false;
+    result->params.start = NULL;
+    result->params.length = 0;
 
-    // Params: only if scheme uses params and ';' in path
+    // Params: only if scheme uses params and ';' in the last path segment
     bool uses_params = false;
     const char *result_scheme = result->scheme.start;
     size_t result_scheme_len = result->scheme.length;
     size_t scheme_count = 0;
     const scheme_with_params_t *schemes =
         p_URL_SCHEMES_WITH_PARAMS(&scheme_count);
-    if (result_scheme && result_scheme_len) {
+    // urllib.parse lowercases a scheme read from the url, never the default
+    // scheme argument, before its case-sensitive uses_params lookup
+    int (*cmp)(const char *, const char *, size_t) =
+        scheme && result_scheme == scheme ? strncmp : strncasecmp;
+    if (semicolon) {
         for (size_t i = 0; i < scheme_count; ++i) {
+            // result_scheme is NULL for no scheme, which only "" matches
             if (result_scheme_len == schemes[i].len &&
-                strncmp(result_scheme, schemes[i].name, schemes[i].len) == 0) {
+                (!result_scheme_len ||
+                 cmp(result_scheme, schemes[i].name, schemes[i].len) == 0)) {
                 uses_params = true;
                 break;
             }
         }
     }
     if (uses_params) {
-        // Only split params at the first ';' in the last segment of the path
-        // (after last '/') as urllib.parse does
+        // The scanner already found the first ';' after the last '/' of the
+        // path, as urllib.parse's _splitparams does
         const char *path_start = result->path.start;
         size_t path_len = result->path.length;
+        size_t plen = (size_t)(semicolon - path_start);
+        p_set_component(&result->params, semicolon + 1, path_len - plen - 1);
+        result->path.length = plen;
+        result->has_params = true;
+        URL_STAT_INC(URL_STAT_HAS_PARAMS);
+    }
+    return URL_PARSE_OK;
+}
+
+/*
+ * Batch parsing. Small batches run inline, large ones are spread over the
+ * worker pool in fixed-size chunks.
+ */
+enum { URL_BATCH_PARALLEL_MIN = 16384, URL_BATCH_CHUNK = 512 };
 
-        const char *last_slash = NULL;
-        last_slash = memrchr(path_start, '/', path_len); // memrchr (GNU)
-
-        const char *segment_start = last_slash ? last_slash + 1 : path_start;
-        size_t segment_len = path_len - (segment_start - path_start);
-        const char *semicolon = memchr(segment_start, ';', segment_len);
-        if (semicolon) {
-            size_t plen = (size_t)(semicolon - path_start);
-            url_component_t params_tmp;
-            p_set_component(&params_tmp, semicolon + 1, path_len - plen - 1);
-            result->params = params_tmp;
-            result->path.length = plen;
-            result->has_params = true;
+typedef struct {
+    const char *const *urls;
+    const size_t *url_lens;
+    const char *scheme;
+    bool allow_fragments;
+    url_scratch_t *scratch; // every task's copies end up here
+    url_split_result_t *split_results;
+    url_parse_result_t *parse_results;
+    url_parse_error_t *errors;
+} p_batch_t;
+
+static void p_batch_task(void *ctx, size_t begin, size_t end) {
+    p_batch_t *batch = ctx;
+    url_scratch_t scratch = {NULL};
+    for (size_t i = begin; i < end; ++i) {
+        url_parse_error_t err;
+        if (batch->split_results) {
+            err = url_split(batch->urls[i], batch->url_lens[i], batch->scheme,
+                            batch->allow_fragments, &scratch,
+                            &batch->split_results[i]);
         } else {
-            result->params.start = NULL;
-            result->params.length = 0;
+            err = url_parse(batch->urls[i], batch->url_lens[i], batch->scheme,
+                            batch->allow_fragments, &scratch,
+                            &batch->parse_results[i]);
         }
+        if (batch->errors) {
+            batch->errors[i] = err;
+        }
+    }
+    p_scratch_splice(batch->scratch, &scratch);
+}
+
+static void p_batch_run(p_batch_t *batch, size_t count) {
+    if (count < URL_BATCH_PARALLEL_MIN) {
+        p_batch_task(batch, 0, count);
+    } else {
+        url_pool_run(count, URL_BATCH_CHUNK, p_batch_task, batch);
+    }
+}
+
+void url_split_many(const char *const *urls, const size_t *url_lens,
+                    size_t count, const char *scheme, bool allow_fragments,
+                    url_scratch_t *scratch, url_split_result_t *results,
+                    url_parse_error_t *errors) {
+    p_batch_t batch = {.urls = urls,
+                       .url_lens = url_lens,
+                       .scheme = scheme,
+                       .allow_fragments = allow_fragments,
+                       .scratch = scratch,
+                       .split_results = results,
+                       .errors = errors};
+    p_batch_run(&batch, count);
+}
+
+void url_parse_many(const char *const *urls, const size_t *url_lens,
+                    size_t count, const char *scheme, bool allow_fragments,
+                    url_scratch_t *scratch, url_parse_result_t *results,
+                    url_parse_error_t *errors) {
+    p_batch_t batch = {.urls = urls,
+                       .url_lens = url_lens,
+                       .scheme = scheme,
+                       .allow_fragments = allow_fragments,
+                       .scratch = scratch,
+                       .parse_results = results,
+                       .errors = errors};
+    p_batch_run(&batch, count);
+}
+
+/*
+ * Streaming. Complete lines are parsed in place in the chunk; only a url
+ * that straddles a chunk boundary is copied, into one carry-over buffer that
+ * grows to the longest such url and is reused after that. The same goes for
+ * the scratch block of urls with tabs or newlines.
+ */
+void url_stream_init(url_stream_t *stream, const char *scheme,
+                     bool allow_fragments, bool params, url_stream_cb callback,
+                     void *ctx) {
+    memset(stream, 0, sizeof(*stream));
+    stream->callback = callback;
+    stream->ctx = ctx;
+    stream->scheme = scheme;
+    stream->allow_fragments = allow_fragments;
+    stream->params = params;
+}
+
+void url_stream_free(url_stream_t *stream) {
+    url_scratch_free(&stream->scratch);
+    free(stream->carry);
+    stream->carry = NULL;
+    stream->carry_len = stream->carry_cap = 0;
+}
+
+static url_parse_error_t p_stream_emit(url_stream_t *stream,
+                                       const char *line, size_t len) {
+    url_parse_result_t result;
+    url_parse_error_t err;
+    if (stream->params) {
+        err = url_parse(line, len, stream->scheme, stream->allow_fragments,
+                        &stream->scratch, &result);
     } else {
-        result->params.start = NULL;
-        result->params.length = 0;
+        url_split_result_t split;
+        err = url_split(line, len, stream->scheme, stream->allow_fragments,
+                        &stream->scratch, &split);
+        result.scheme = split.scheme;
+        result.netloc = split.netloc;
+        result.path = split.path;
+        p_set_component(&result.params, NULL, 0);
+        result.query = split.query;
+        result.fragment = split.fragment;
+        result.netloc_parts = split.netloc_parts;
+        result.source = split.source;
+        result.has_params = false;
+    }
+    int stop = stream->callback(stream->ctx, line, len, &result, err);
+    url_scratch_reset(&stream->scratch);
+    return stop ? URL_PARSE_ERROR_ABORTED : URL_PARSE_OK;
+}
+
+static bool p_stream_carry(url_stream_t *stream, const char *data,
+                           size_t len) {
+    if (stream->carry_len + len > stream->carry_cap) {
+        size_t cap = stream->carry_cap ? stream->carry_cap : 256;
+        while (cap < stream->carry_len + len) {
+            cap *= 2;
+        }
+        char *carry = realloc(stream->carry, cap);
+        if (!carry) {
+            return false;
+        }
+        stream->carry = carry;
+        stream->carry_cap = cap;
+    }
+    memcpy(stream->carry + stream->carry_len, data, len);
+    stream->carry_len += len;
+    return true;
+}
+
+url_parse_error_t url_stream_feed(url_stream_t *stream, const char *chunk,
+                                  size_t chunk_len) {
+    const char *p = chunk, *end = chunk + chunk_len;
+    url_parse_error_t err;
+
+    if (stream->carry_len) {
+        const char *nl = memchr(p, '\n', chunk_len);
+        if (!p_stream_carry(stream, p, (size_t)((nl ? nl : end) - p))) {
+            return URL_PARSE_ERROR_OUT_OF_MEMORY;
+        }
+        if (!nl) {
+            return URL_PARSE_OK;
+        }
+        size_t len = stream->carry_len;
+        stream->carry_len = 0;
+        err = p_stream_emit(stream, stream->carry, len);
+        if (err != URL_PARSE_OK) {
+            return err;
+        }
+        p = nl + 1;
+    }
+
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl) {
+            return p_stream_carry(stream, p, (size_t)(end - p))
+                       ? URL_PARSE_OK
+                       : URL_PARSE_ERROR_OUT_OF_MEMORY;
+        }
+        err = p_stream_emit(stream, p, (size_t)(nl - p));
+        if (err != URL_PARSE_OK) {
+            return err;
+        }
+        p = nl + 1;
     }
     return URL_PARSE_OK;
 }
 
+url_parse_error_t url_stream_finish(url_stream_t *stream) {
+    if (!stream->carry_len) {
+        return URL_PARSE_OK;
+    }
+    size_t len = stream->carry_len;
+    stream->carry_len = 0;
+    return p_stream_emit(stream, stream->carry, len);
+}
+
+/*
+ * Quoting.
+ *
+ * The safe set is compiled once into a 256-bit bitmap. For the SIMD path the
+ * same set is also stored as a nibble table: bit (c >> 4) of
+ * lo_nibble[c & 0xF] is set when the ASCII byte c is safe, so a block is
+ * classified with two byte shuffles. Bytes >= 0x80 are never safe, the same
+ * as urllib.parse which drops non-ASCII bytes from safe.
+ *
+ * For quote_plus a space is always treated as unsafe, even when it is in
+ * safe, and then written as '+' instead of "%20".
+ */
+void url_quote_table_init(url_quote_table_t *table, const char *safe,
+                          size_t safe_len, bool space_plus) {
+    memset(table, 0, sizeof(*table));
+    for (size_t c = 0; c < ASCII_SIZE; ++c) {
+        if (p_URL_SAFE_ALWAYS[c]) {
+            table->bitmap[c / 64] |= (uint64_t)1 << (c % 64);
+        }
+    }
+    for (size_t i = 0; safe && i < safe_len; ++i) {
+        unsigned char c = (unsigned char)safe[i];
+        if (c < 0x80) {
+            table->bitmap[c / 64] |= (uint64_t)1 << (c % 64);
+        }
+    }
+    table->space_plus = space_plus;
+    if (space_plus) {
+        table->bitmap[' ' / 64] &= ~((uint64_t)1 << (' ' % 64));
+    }
+    for (size_t c = 0; c < 0x80; ++c) {
+        if (table->bitmap[c / 64] & ((uint64_t)1 << (c % 64))) {
+            table->lo_nibble[c & NIBBLE_MASK] |= (uint8_t)(1 << (c >> 4));
+        }
+    }
+}
+
+static inline bool p_quote_is_safe(const url_quote_table_t *table,
+                                   unsigned char c) {
+    return (table->bitmap[c / 64] >> (c % 64)) & 1;
+}
+
+// Mask of the bytes of the next block that need encoding; *block gets the
+// number of bytes the mask covers (0: the level has no quote kernel). A
+// short last block is padded with 'a', which every table keeps.
+static inline uint64_t p_quote_unsafe_block(const p_kernels_t *k,
+                                            const char *p, size_t n,
+                                            const url_quote_table_t *table,
+                                            size_t *block) {
+    if (!k->quote_block) {
+        *block = 0;
+        return 0;
+    }
+    if (n >= k->quote_block) {
+        *block = k->quote_block;
+        return k->quote_unsafe(p, table->lo_nibble);
+    }
+    char tmp[P_BLOCK_SIZE];
+    memset(tmp, 'a', sizeof(tmp));
+    memcpy(tmp, p, n);
+    *block = n;
+    return k->quote_unsafe(tmp, table->lo_nibble) & (((uint64_t)1 << n) - 1);
+}
+
+size_t url_quote_len(const char *input, size_t input_len,
+                     const url_quote_table_t *table) {
+    size_t needed = input_len;
+    size_t i = 0;
+    size_t block;
+    const p_kernels_t *k = p_kernels();
+    while (i < input_len) {
+        uint64_t unsafe =
+            p_quote_unsafe_block(k, input + i, input_len - i, table, &block);
+        if (!block) {
+            break;
+        }
+        needed += (URL_PERCENT_ENCODED_LEN - 1) *
+                  (size_t)__builtin_popcountll(unsafe);
+        if (table->space_plus) {
+            // A space is one '+', not three bytes
+            while (unsafe) {
+                size_t pos = (size_t)__builtin_ctzll(unsafe);
+                unsafe &= unsafe - 1;
+                if (input[i + pos] == ' ') {
+                    needed -= URL_PERCENT_ENCODED_LEN - 1;
+                }
+            }
+        }
+        i += block;
+    }
+    for (; i < input_len; ++i) {
+        unsigned char c = (unsigned char)input[i];
+        if (!p_quote_is_safe(table, c) && !(c == ' ' && table->space_plus)) {
+            needed += URL_PERCENT_ENCODED_LEN - 1;
+        }
+    }
+    return needed;
+}
+
+static inline char *p_percent_encode_fwd(unsigned char c,
+                                        const url_quote_table_t *table,
+                                        char *out) {
+    static const char hex[] = "0123456789ABCDEF";
+    if (c == ' ' && table->space_plus) {
+        *out = '+';
+        return out + 1;
+    }
+    out[0] = '%';
+    out[1] = hex[(c >> NIBBLE_BITS) & NIBBLE_MASK];
+    out[2] = hex[c & NIBBLE_MASK];
+    return out + URL_PERCENT_ENCODED_LEN;
+}
+
+// out must hold url_quote_len(input, input_len, table) bytes, no terminator
+// is written
+void url_quote_write(const char *input, size_t input_len,
+                     const url_quote_table_t *table, char *out) {
+    size_t i = 0;
+    size_t block;
+    const p_kernels_t *k = p_kernels();
+    while (i < input_len) {
+        uint64_t unsafe =
+            p_quote_unsafe_block(k, input + i, input_len - i, table, &block);
+        if (!block) {
+            break;
+        }
+        // Copy the safe runs between unsafe bytes in one go
+        size_t run = 0;
+        while (unsafe) {
+            size_t pos = (size_t)__builtin_ctzll(unsafe);
+            unsafe &= unsafe - 1;
+            memcpy(out, input + i + run, pos - run);
+            out += pos - run;
+            out = p_percent_encode_fwd((unsigned char)input[i + pos], table,
+                                      out);
+            run = pos + 1;
+        }
+        memcpy(out, input + i + run, block - run);
+        out += block - run;
+        i += block;
+    }
+    for (; i < input_len; ++i) {
+        unsigned char c = (unsigned char)input[i];
+        if (p_quote_is_safe(table, c)) {
+            *out++ = (char)c;
+        } else {
+            out = p_percent_encode_fwd(c, table, out);
+        }
+    }
+}
+
 // url_quote: percent-encode all except "safe" chars inplace
 // Note: buf must be with size orig_len * 3 + 1 if we will percent encode whole
 // string
 url_parse_error_t url_quote(char *buf, size_t orig_str_len, const char *safe,
                             size_t safe_len) {
-    // Allocate a temporary array to store "is safe" flags and
-    // find new buf cap and calculate which characters are safe
-    bool is_safe_arr[orig_str_len];
-    size_t needed = 0;
-    for (size_t i = 0; i < orig_str_len; ++i) {
-        char c = buf[i];
-        bool is_safe = p_URL_SAFE_ALWAYS[(unsigned char)c] ||
-                       (safe && safe_len && memchr(safe, c, safe_len));
-        is_safe_arr[i] = is_safe;
-        needed += is_safe ? 1 : URL_PERCENT_ENCODED_LEN;
-    }
+    url_quote_table_t table;
+    url_quote_table_init(&table, safe, safe_len, false);
+    size_t needed = url_quote_len(buf, orig_str_len, &table);
 
     size_t inp_idx = orig_str_len;
     size_t out_idx = needed;
     buf[out_idx] = '\0'; // Null-terminate
 
+    // Expand backwards so nothing is overwritten before it is read
     while (inp_idx > 0) {
         char c = buf[--inp_idx];
-        if (is_safe_arr[inp_idx]) {
+        if (p_quote_is_safe(&table, (unsigned char)c)) {
             buf[--out_idx] = c;
         } else {
             p_percent_encode(c, buf, &out_idx);
@@ -281,4 +1436,717 @@ url_parse_error_t url_quote(char *buf, size_t orig_str_len, const char *safe,
     }
 
     return URL_PARSE_OK;
-}
\ No newline at end of file
+}
+
+/*
+ * Strict RFC 3986 validation.
+ *
+ * The structural scan splits the url exactly as url_split does. Within the
+ * bounds it finds, every component's character class is the query one
+ * (pchar '/' '?'): the bytes a narrower class leaves out are the very ones
+ * that end that component, or, for the userinfo and host, few enough to
+ * look for in the short netloc. So one pass of the quote kernel over the
+ * whole url checks every component. '%' is in no class: each one is
+ * reported and its two hex digits checked.
+ */
+enum {
+    P_RFC_QUERY,  // unreserved sub-delims ':' '@' '/' '?'
+    P_RFC_FUTURE, // unreserved sub-delims ':' (IPvFuture)
+    P_RFC_ZONE,   // unreserved (RFC 6874 ZoneID)
+    P_RFC_PCT,    // '%' alone
+    P_RFC_HEX,    // HEXDIG alone
+    P_RFC_CLASSES
+};
+
+#define P_RFC_SUB_DELIMS "!$&'()*+,;="
+
+static url_quote_table_t p_rfc_classes[P_RFC_CLASSES];
+
+// A quote table of exactly set, without the always safe bytes
+static void p_rfc_table_only(url_quote_table_t *table, const char *set) {
+    memset(table, 0, sizeof(*table));
+    for (const char *p = set; *p; ++p) {
+        unsigned char c = (unsigned char)*p;
+        table->bitmap[c / 64] |= (uint64_t)1 << (c % 64);
+        table->lo_nibble[c & NIBBLE_MASK] |= (uint8_t)(1 << (c >> 4));
+    }
+}
+
+__attribute__((constructor)) static void p_rfc_init(void) {
+    static const char *const extra[] = {
+        [P_RFC_QUERY] = P_RFC_SUB_DELIMS ":@/?",
+        [P_RFC_FUTURE] = P_RFC_SUB_DELIMS ":",
+        [P_RFC_ZONE] = ""};
+    for (size_t i = 0; i < sizeof(extra) / sizeof(extra[0]); ++i) {
+        url_quote_table_init(&p_rfc_classes[i], extra[i], strlen(extra[i]),
+                             false);
+    }
+    p_rfc_table_only(&p_rfc_classes[P_RFC_PCT], "%");
+    p_rfc_table_only(&p_rfc_classes[P_RFC_HEX], "0123456789ABCDEFabcdef");
+}
+
+typedef struct {
+    size_t hash;                     // the '#' before the fragment
+    size_t netloc_start, netloc_end; // brackets are checked in there
+} p_rfc_bounds_t;
+
+// Whether the byte at pos, outside the class, is still allowed: a '%' that
+// starts an escape when pct is set and, with bounds, the fragment's '#' and
+// the brackets of the netloc
+static inline bool p_rfc_allowed(const char *s, size_t n, size_t pos,
+                                 bool pct, const p_rfc_bounds_t *bounds) {
+    const char c = s[pos];
+    if (c == '%') {
+        return pct && pos + 2 < n && p_is_hex(s[pos + 1]) &&
+               p_is_hex(s[pos + 2]);
+    }
+    if (!bounds) {
+        return false;
+    }
+    return c == '#' ? pos == bounds->hash
+                    : (c == '[' || c == ']') && pos >= bounds->netloc_start &&
+                          pos < bounds->netloc_end;
+}
+
+// Offset of the first byte of s[0, n) outside the class and not allowed by
+// p_rfc_allowed, n if there is none
+static size_t p_rfc_span(const p_kernels_t *k, const char *s, size_t n,
+                         int cls, bool pct, const p_rfc_bounds_t *bounds) {
+    const url_quote_table_t *table = &p_rfc_classes[cls];
+    const size_t block = k->quote_block;
+    if (!block) {
+        for (size_t i = 0; i < n; ++i) {
+            if (!p_quote_is_safe(table, (unsigned char)s[i]) &&
+                !p_rfc_allowed(s, n, i, pct, bounds)) {
+                return i;
+            }
+        }
+        return n;
+    }
+    const uint64_t full = ~(uint64_t)0 >> (P_BLOCK_SIZE - block);
+    char tmp[P_BLOCK_SIZE];
+    for (size_t i = 0; i < n; i += block) {
+        const char *p = s + i;
+        uint64_t valid = full;
+        if (n - i < block) {
+            memset(tmp, 'a', block);
+            memcpy(tmp, p, n - i);
+            p = tmp;
+            valid = ((uint64_t)1 << (n - i)) - 1;
+        }
+        uint64_t bad = k->quote_unsafe(p, table->lo_nibble) & valid;
+        if (bad && pct) {
+            // Escapes whose digits are in the block, the others are left
+            // to p_rfc_allowed
+            const uint64_t pcts =
+                ~k->quote_unsafe(p, p_rfc_classes[P_RFC_PCT].lo_nibble) & bad;
+            if (pcts) {
+                const uint64_t hex =
+                    ~k->quote_unsafe(p, p_rfc_classes[P_RFC_HEX].lo_nibble) &
+                    valid;
+                bad &= ~(pcts & hex >> 1 & hex >> 2);
+            }
+        }
+        while (bad) {
+            size_t pos = i + (size_t)__builtin_ctzll(bad);
+            bad &= bad - 1;
+            if (!p_rfc_allowed(s, n, pos, pct, bounds)) {
+                return pos;
+            }
+        }
+    }
+    return n;
+}
+
+// Offset of the first '[' or ']' (or also c) in s[0, n), n if none
+static inline size_t p_rfc_find(const char *s, size_t n, char c) {
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i] == '[' || s[i] == ']' || s[i] == c) {
+            return i;
+        }
+    }
+    return n;
+}
+
+// The inside of "[...]": IPvFuture, or an IPv6 address with an optional
+// RFC 6874 zone ("%25" then unreserved or escaped bytes)
+static bool p_rfc_ip_literal(const p_kernels_t *k, const char *s, size_t n) {
+    if (n && (s[0] == 'v' || s[0] == 'V')) {
+        size_t i = 1;
+        while (i < n && p_is_hex(s[i])) {
+            ++i;
+        }
+        return i > 1 && i + 1 < n && s[i] == '.' &&
+               p_rfc_span(k, s + i + 1, n - i - 1, P_RFC_FUTURE, false,
+                          NULL) == n - i - 1;
+    }
+    const char *pct = memchr(s, '%', n);
+    if (!pct) {
+        return p_is_ipv6(s, n);
+    }
+    size_t addr = (size_t)(pct - s);
+    size_t zone = n - addr - URL_PERCENT_ENCODED_LEN;
+    return n - addr > URL_PERCENT_ENCODED_LEN &&
+           memcmp(pct, "%25", URL_PERCENT_ENCODED_LEN) == 0 &&
+           p_rfc_span(k, pct + URL_PERCENT_ENCODED_LEN, zone, P_RFC_ZONE,
+                      true, NULL) == zone &&
+           p_is_ipv6(s, addr);
+}
+
+enum { P_PORT_MAX = 65535 };
+
+// authority = [ userinfo "@" ] host [ ":" port ], past the class check:
+// what is left is '@' and brackets in the userinfo, brackets in a reg-name,
+// the IP literal and the port
+static url_parse_error_t p_rfc_authority(const p_kernels_t *k,
+                                         const char *url,
+                                         const url_component_t *netloc,
+                                         size_t *offset) {
+    const char *s = netloc->start;
+    const char *end = s + netloc->length;
+    const char *at = memrchr(s, '@', netloc->length);
+    const char *host = at ? at + 1 : s;
+    size_t bad = p_rfc_find(s, (size_t)(host - s), '@');
+    if (at && s + bad < at) {
+        *offset = (size_t)(s - url) + bad;
+        return URL_PARSE_ERROR_INVALID_CHAR;
+    }
+    const char *host_end;
+    if (host < end && *host == '[') {
+        const char *close = memchr(host, ']', (size_t)(end - host));
+        if (!close ||
+            !p_rfc_ip_literal(k, host + 1, (size_t)(close - host - 1))) {
+            *offset = (size_t)(host - url);
+            return URL_PARSE_ERROR_INVALID_IPV6;
+        }
+        host_end = close + 1;
+        if (host_end < end && *host_end != ':') {
+            *offset = (size_t)(host_end - url);
+            return URL_PARSE_ERROR_INVALID_CHAR;
+        }
+    } else {
+        host_end = memchr(host, ':', (size_t)(end - host));
+        if (!host_end) {
+            host_end = end;
+        }
+        bad = p_rfc_find(host, (size_t)(host_end - host), '[');
+        if (host + bad < host_end) {
+            *offset = (size_t)(host - url) + bad;
+            return URL_PARSE_ERROR_INVALID_CHAR;
+        }
+    }
+    // port = *DIGIT, in the range urllib.parse's port property accepts
+    if (host_end < end) {
+        const char *port = host_end + 1;
+        unsigned value = 0;
+        for (const char *p = port; p < end; ++p) {
+            if (*p < '0' || *p > '9') {
+                *offset = (size_t)(p - url);
+                return URL_PARSE_ERROR_INVALID_PORT;
+            }
+            value = value * 10 + (unsigned)(*p - '0');
+            if (value > P_PORT_MAX) {
+                *offset = (size_t)(port - url);
+                return URL_PARSE_ERROR_INVALID_PORT;
+            }
+        }
+    }
+    return URL_PARSE_OK;
+}
+
+static url_parse_error_t p_validate(const char *url, size_t url_len,
+                                    url_split_result_t *result,
+                                    size_t *offset) {
+    const p_kernels_t *k = p_kernels();
+    size_t semi;
+    if (!p_scan(url, url_len, true, result, &semi)) {
+        // '\t' '\r' '\n' end the scan before any boundary is known
+        for (size_t off = 0;; off += P_BLOCK_SIZE) {
+            p_block_masks_t m;
+            p_classify(k, url + off, url_len - off, &m);
+            if (m.unsafe) {
+                *offset = off + (size_t)__builtin_ctzll(m.unsafe);
+                return URL_PARSE_ERROR_INVALID_CHAR;
+            }
+        }
+    }
+    p_set_component(&result->source, url, url_len);
+    const url_component_t *netloc = &result->netloc;
+    p_rfc_bounds_t bounds = {.hash = P_SCAN_NONE};
+    if (result->fragment.start) {
+        bounds.hash = (size_t)(result->fragment.start - url) - 1;
+    }
+    if (netloc->start) {
+        bounds.netloc_start = (size_t)(netloc->start - url);
+        bounds.netloc_end = bounds.netloc_start + netloc->length;
+    }
+
+    // The leftmost error wins: the class check's, the netloc's or the ':'
+    // of a relative path's first segment
+    size_t bad = p_rfc_span(k, url, url_len, P_RFC_QUERY, true, &bounds);
+    url_parse_error_t err = bad < url_len && url[bad] == '%'
+                                ? URL_PARSE_ERROR_INVALID_ESCAPE
+                                : URL_PARSE_ERROR_INVALID_CHAR;
+    size_t first = bad;
+    if (netloc->start) {
+        size_t at;
+        url_parse_error_t netloc_err = p_rfc_authority(k, url, netloc, &at);
+        if (netloc_err != URL_PARSE_OK && at < first) {
+            err = netloc_err;
+            first = at;
+        }
+    } else if (!result->scheme.start) {
+        // path-noscheme: a ':' in the first segment would read as a scheme
+        const url_component_t *path = &result->path;
+        const char *colon = memchr(path->start, ':', path->length);
+        if (colon && (size_t)(colon - url) < bad &&
+            !memchr(path->start, '/', (size_t)(colon - path->start))) {
+            err = URL_PARSE_ERROR_INVALID_SCHEME;
+            first = 0;
+        }
+    }
+    if (first < url_len) {
+        *offset = first;
+        return err;
+    }
+    // The authority check above passed, so this only fills netloc_parts; an
+    // error would still point at the IP literal
+    err = p_split_netloc(netloc->start, netloc->length, true,
+                         &result->netloc_parts);
+    if (err != URL_PARSE_OK) {
+        const char *open = memchr(netloc->start, '[', netloc->length);
+        *offset = (size_t)((open ? open : netloc->start) - url);
+    }
+    return err;
+}
+
+url_parse_error_t url_validate(const char *url, size_t url_len,
+                               url_split_result_t *result,
+                               size_t *error_offset) {
+    url_split_result_t local;
+    if (!result) {
+        result = &local;
+    }
+    p_reset_split_result(result);
+    size_t offset = 0;
+    url_parse_error_t err = p_validate(url, url_len, result, &offset);
+    if (error_offset) {
+        *error_offset = offset;
+    }
+    return err;
+}
+
+typedef struct {
+    const char *const *urls;
+    const size_t *url_lens;
+    url_parse_error_t *errors;
+    size_t *offsets;
+} p_validate_batch_t;
+
+static void p_validate_task(void *ctx, size_t begin, size_t end) {
+    p_validate_batch_t *batch = ctx;
+    for (size_t i = begin; i < end; ++i) {
+        size_t offset;
+        batch->errors[i] =
+            url_validate(batch->urls[i], batch->url_lens[i], NULL, &offset);
+        if (batch->offsets) {
+            batch->offsets[i] = offset;
+        }
+    }
+}
+
+void url_validate_many(const char *const *urls, const size_t *url_lens,
+                       size_t count, url_parse_error_t *errors,
+                       size_t *offsets) {
+    p_validate_batch_t batch = {.urls = urls,
+                                .url_lens = url_lens,
+                                .errors = errors,
+                                .offsets = offsets};
+    if (count < URL_BATCH_PARALLEL_MIN) {
+        p_validate_task(&batch, 0, count);
+    } else {
+        url_pool_run(count, URL_BATCH_CHUNK, p_validate_task, &batch);
+    }
+}
+
+/*
+ * Unquoting.
+ *
+ * '%' (and '+' for the plus variant) are found a 64 byte block at a time;
+ * the literal runs between them are copied with one memmove each, so the
+ * output may alias the input.
+ */
+
+// Hex digit value plus one, 0 for bytes that are not hex digits
+// clang-format off
+static const uint8_t p_HEX_DIGIT[ASCII_SIZE] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16
+};
+// clang-format on
+
+// Bit i set <=> byte i of the block is '%' or plus_char
+static inline uint64_t p_unquote_mask(const p_kernels_t *k, const char *p,
+                                      size_t n, char plus_char) {
+    const char bytes[2] = {'%', plus_char};
+    uint64_t masks[2];
+    if (n >= P_BLOCK_SIZE) {
+        k->byte_masks(p, bytes, 2, masks);
+        return masks[0] | masks[1];
+    }
+    char tmp[P_BLOCK_SIZE];
+    memset(tmp, 'a', sizeof(tmp));
+    memcpy(tmp, p, n);
+    k->byte_masks(tmp, bytes, 2, masks);
+    return (masks[0] | masks[1]) & (((uint64_t)1 << n) - 1);
+}
+
+size_t url_unquote_find(const char *input, size_t input_len, bool plus) {
+    const char plus_char = plus ? '+' : '%';
+    const p_kernels_t *k = p_kernels();
+    for (size_t off = 0; off < input_len; off += P_BLOCK_SIZE) {
+        uint64_t mask =
+            p_unquote_mask(k, input + off, input_len - off, plus_char);
+        if (mask) {
+            return off + (size_t)__builtin_ctzll(mask);
+        }
+    }
+    return input_len;
+}
+
+size_t url_unquote(const char *input, size_t input_len, bool plus,
+                   char *out) {
+    const char plus_char = plus ? '+' : '%';
+    const p_kernels_t *k = p_kernels();
+    size_t run = 0; // start of the literal run not yet copied
+    size_t out_len = 0;
+    for (size_t off = 0; off < input_len; off += P_BLOCK_SIZE) {
+        uint64_t mask =
+            p_unquote_mask(k, input + off, input_len - off, plus_char);
+        // Hex digits consumed by an escape are never '%' or '+', so every
+        // set bit starts a new escape
+        while (mask) {
+            size_t pos = off + (size_t)__builtin_ctzll(mask);
+            mask &= mask - 1;
+            unsigned hi, lo;
+            char decoded;
+            if (input[pos] != '%') {
+                decoded = ' ';
+            } else if (pos + 2 < input_len &&
+                       (hi = p_HEX_DIGIT[(unsigned char)input[pos + 1]]) &&
+                       (lo = p_HEX_DIGIT[(unsigned char)input[pos + 2]])) {
+                decoded = (char)((hi - 1) << NIBBLE_BITS | (lo - 1));
+            } else {
+                continue; // a lone '%' stays part of the literal run
+            }
+            memmove(out + out_len, input + run, pos - run);
+            out_len += pos - run;
+            out[out_len++] = decoded;
+            run = pos + (input[pos] == '%' ? URL_PERCENT_ENCODED_LEN : 1);
+        }
+    }
+    memmove(out + out_len, input + run, input_len - run);
+    return out_len + input_len - run;
+}
+
+/*
+ * Query strings.
+ *
+ * Each 64 byte block is classified once into separator, '=', '%' and '+'
+ * masks; a field is then located by bit scans, noting whether its name and
+ * value need unquoting at all.
+ */
+enum { P_QUERY_SEP, P_QUERY_EQ, P_QUERY_PERCENT, P_QUERY_PLUS };
+
+static void p_query_classify(url_query_iter_t *it, size_t block) {
+    const char *p = it->query + block;
+    size_t n = it->len - block;
+    char tmp[P_BLOCK_SIZE];
+    uint64_t valid = ~(uint64_t)0;
+    if (n < P_BLOCK_SIZE) {
+        memset(tmp, 'a', sizeof(tmp));
+        memcpy(tmp, p, n);
+        p = tmp;
+        valid = ((uint64_t)1 << n) - 1;
+    }
+    it->block = block;
+    const char bytes[] = {[P_QUERY_SEP] = it->separator,
+                          [P_QUERY_EQ] = '=',
+                          [P_QUERY_PERCENT] = '%',
+                          [P_QUERY_PLUS] = '+'};
+    p_kernels()->byte_masks(p, bytes, sizeof(bytes), it->masks);
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+        it->masks[i] &= valid;
+    }
+}
+
+void url_query_iter_init(url_query_iter_t *it, const char *query, size_t len,
+                         char separator) {
+    it->query = query;
+    it->len = len;
+    // An empty query has no fields at all, not one empty field
+    it->pos = len ? 0 : 1;
+    it->separator = separator;
+    if (len) {
+        p_query_classify(it, 0);
+    }
+}
+
+// Escape flags of the bits of block masks `m` that are set in `range`
+static inline uint8_t p_query_escapes(const uint64_t *m, uint64_t range) {
+    return (uint8_t)((m[P_QUERY_PERCENT] & range ? URL_QUERY_PERCENT : 0) |
+                     (m[P_QUERY_PLUS] & range ? URL_QUERY_PLUS : 0));
+}
+
+bool url_query_next(url_query_iter_t *it, url_query_field_t *field) {
+    if (it->pos > it->len) {
+        return false;
+    }
+    const size_t start = it->pos;
+    size_t eq = P_SCAN_NONE;
+    size_t end = it->len;
+    field->name_escapes = field->value_escapes = 0;
+
+    for (size_t cursor = start; cursor < it->len;) {
+        size_t block = cursor & ~(size_t)(P_BLOCK_SIZE - 1);
+        if (block != it->block) {
+            p_query_classify(it, block);
+        }
+        const uint64_t *m = it->masks;
+        uint64_t range = ~(uint64_t)0 << (cursor - block);
+        uint64_t sep = m[P_QUERY_SEP] & range;
+        if (sep) {
+            // Bits from the cursor up to (excluding) the separator
+            range &= (sep & -sep) - 1;
+        }
+        uint64_t eqs = m[P_QUERY_EQ] & range;
+        if (eq == P_SCAN_NONE && eqs) {
+            size_t bit = (size_t)__builtin_ctzll(eqs);
+            eq = block + bit;
+            uint64_t before = ((uint64_t)1 << bit) - 1;
+            field->name_escapes |= p_query_escapes(m, range & before);
+            field->value_escapes |=
+                p_query_escapes(m, range & ~before & ~((uint64_t)1 << bit));
+        } else if (eq == P_SCAN_NONE) {
+            field->name_escapes |= p_query_escapes(m, range);
+        } else {
+            field->value_escapes |= p_query_escapes(m, range);
+        }
+        if (sep) {
+            end = block + (size_t)__builtin_ctzll(sep);
+            break;
+        }
+        cursor = block + P_BLOCK_SIZE;
+    }
+
+    it->pos = end + 1; // past the separator, or past the end when last
+    field->has_value = eq != P_SCAN_NONE;
+    if (field->has_value) {
+        p_set_component(&field->name, it->query + start, eq - start);
+        p_set_component(&field->value, it->query + eq + 1, end - eq - 1);
+    } else {
+        p_set_component(&field->name, it->query + start, end - start);
+        p_set_component(&field->value, it->query + end, 0);
+    }
+    return true;
+}
+
+/*
+ * Unsplitting: the inverse of url_split / url_parse with urllib.parse's
+ * rules for "//", ";params", '?' and '#'. The length is computed with
+ * out == NULL first, so the caller can allocate the result exactly once.
+ */
+
+// Byte i of path + ";" + params (the path urlunparse hands to urlunsplit)
+static inline char p_unsplit_path_at(const url_unsplit_t *parts, size_t i) {
+    if (i < parts->path.length) {
+        return parts->path.start[i];
+    }
+    i -= parts->path.length;
+    if (!parts->params.length) {
+        return '\0';
+    }
+    return i == 0 ? ';'
+                  : (i - 1 < parts->params.length ? parts->params.start[i - 1]
+                                                  : '\0');
+}
+
+static inline size_t p_unsplit_put(char *out, size_t pos, const char *src,
+                                   size_t len) {
+    if (out && len) {
+        memcpy(out + pos, src, len);
+    }
+    return pos + len;
+}
+
+size_t url_unsplit(const url_unsplit_t *parts, unsigned flags, char *out) {
+    size_t path_len = parts->path.length +
+                      (parts->params.length ? parts->params.length + 1 : 0);
+    bool slash = p_unsplit_path_at(parts, 0) == '/';
+    bool slashes = slash && p_unsplit_path_at(parts, 1) == '/';
+    bool scheme_netloc = parts->scheme.length && parts->scheme_uses_netloc;
+    bool netloc =
+        parts->netloc.length ||
+        (flags & URL_UNSPLIT_EMPTY_NETLOC
+             ? slashes || (scheme_netloc && (!path_len || slash))
+             : scheme_netloc && !slashes);
+    size_t pos = 0;
+    if (parts->scheme.length) {
+        pos = p_unsplit_put(out, pos, parts->scheme.start,
+                            parts->scheme.length);
+        pos = p_unsplit_put(out, pos, ":", 1);
+    }
+    if (netloc) {
+        pos = p_unsplit_put(out, pos, "//", 2);
+        pos = p_unsplit_put(out, pos, parts->netloc.start,
+                            parts->netloc.length);
+        if (path_len && !slash) {
+            pos = p_unsplit_put(out, pos, "/", 1);
+        }
+    }
+    pos = p_unsplit_put(out, pos, parts->path.start, parts->path.length);
+    if (parts->params.length) {
+        pos = p_unsplit_put(out, pos, ";", 1);
+        pos = p_unsplit_put(out, pos, parts->params.start,
+                            parts->params.length);
+    }
+    if (parts->query.length) {
+        pos = p_unsplit_put(out, pos, "?", 1);
+        pos = p_unsplit_put(out, pos, parts->query.start, parts->query.length);
+    }
+    if (parts->fragment.length) {
+        pos = p_unsplit_put(out, pos, "#", 1);
+        pos = p_unsplit_put(out, pos, parts->fragment.start,
+                            parts->fragment.length);
+    }
+    return pos;
+}
+
+/*
+ * Joining, as urllib.parse.urljoin does it (its take on RFC 3986 5.2).
+ *
+ * The merged path is built in one forward pass: segments are appended to
+ * the output as they come, and ".." truncates the output back to the
+ * previous '/'.
+ */
+typedef struct {
+    char *out;
+    size_t len;
+    size_t nseg;  // segments written (the first one may be empty)
+    size_t index; // segments seen, dropped ones included
+    bool filter;  // drop empty segments that are neither first nor last
+} p_join_path_t;
+
+static void p_join_segment(p_join_path_t *jp, const char *seg, size_t len,
+                           bool last) {
+    size_t index = jp->index++;
+    if (jp->filter && !len && index && !last) {
+        return;
+    }
+    bool dot = len == 1 && seg[0] == '.';
+    bool dotdot = len == 2 && seg[0] == '.' && seg[1] == '.';
+    if (dotdot) {
+        // Pop the last segment; a ".." above the root is ignored
+        if (jp->nseg) {
+            const char *slash =
+                --jp->nseg ? memrchr(jp->out, '/', jp->len) : NULL;
+            jp->len = slash ? (size_t)(slash - jp->out) : 0;
+        }
+    } else if (!dot) {
+        if (jp->nseg++) {
+            jp->out[jp->len++] = '/';
+        }
+        memcpy(jp->out + jp->len, seg, len);
+        jp->len += len;
+    }
+    if (last && (dot || dotdot)) {
+        // A trailing "." or ".." leaves a directory: keep the final '/'
+        if (jp->nseg++) {
+            jp->out[jp->len++] = '/';
+        }
+    }
+}
+
+// Feed every '/'-separated segment of s[0, len)
+static void p_join_segments(p_join_path_t *jp, const char *s, size_t len,
+                            bool last) {
+    const char *end = s + len;
+    for (;;) {
+        const char *slash = memchr(s, '/', (size_t)(end - s));
+        if (!slash) {
+            p_join_segment(jp, s, (size_t)(end - s), last);
+            return;
+        }
+        p_join_segment(jp, s, (size_t)(slash - s), false);
+        s = slash + 1;
+    }
+}
+
+size_t url_join_path(const char *base_path, size_t base_len, const char *path,
+                     size_t path_len, char *out) {
+    p_join_path_t jp = {.out = out};
+    if (path_len && path[0] == '/') {
+        // An absolute path ignores the base path altogether
+        p_join_segments(&jp, path, path_len, true);
+    } else {
+        // The base path without its last segment, which is not a directory
+        jp.filter = true;
+        const char *slash =
+            base_len ? memrchr(base_path, '/', base_len) : NULL;
+        if (slash) {
+            p_join_segments(&jp, base_path, (size_t)(slash - base_path),
+                            false);
+            if (slash == base_path + base_len - 1) {
+                p_join_segment(&jp, "", 0, false);
+            }
+        } else if (!base_len) {
+            p_join_segment(&jp, "", 0, false);
+        }
+        p_join_segments(&jp, path, path_len, true);
+    }
+    if (!jp.len) {
+        out[jp.len++] = '/';
+    }
+    return jp.len;
+}
+
+bool url_join(const url_parse_result_t *base, const url_parse_result_t *ref,
+              bool relative, bool netloc, char *path_buf,
+              url_unsplit_t *parts) {
+    if (ref->scheme.length != base->scheme.length ||
+        (ref->scheme.length &&
+         strncasecmp(ref->scheme.start, base->scheme.start,
+                     base->scheme.length) != 0) ||
+        !relative) {
+        return false;
+    }
+    memset(parts, 0, sizeof(*parts));
+    parts->scheme = base->scheme;
+    parts->netloc = ref->netloc;
+    parts->path = ref->path;
+    parts->params = ref->params;
+    parts->query = ref->query;
+    parts->fragment = ref->fragment;
+    parts->scheme_uses_netloc = netloc;
+    if (netloc) {
+        if (ref->netloc.length) {
+            return true;
+        }
+        parts->netloc = base->netloc;
+    }
+
+    if (!ref->path.length && !ref->params.length) {
+        parts->path = base->path;
+        parts->params = base->params;
+        if (!ref->query.length) {
+            parts->query = base->query;
+        }
+        return true;
+    }
+    size_t len = url_join_path(base->path.start, base->path.length,
+                               ref->path.start, ref->path.length, path_buf);
+    p_set_component(&parts->path, path_buf, len);
+    return true;
+}
@@ -2,14 +2,29 @@
 #define PARSE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* URL component structure */
 typedef struct {
     const char *start;
     size_t length;
 } url_component_t;
 
+/* netloc sub-components, as urllib.parse's username, password, hostname and
+ * port properties see them. A NULL start means None. */
+typedef struct {
+    url_component_t username; /* NULL without '@' */
+    url_component_t password; /* NULL without ':' in the userinfo */
+    url_component_t hostname; /* '[' ']' removed, not lowercased */
+    url_component_t port;     /* NULL when missing or empty */
+    bool host_upper;          /* A-Z in hostname before any '%' zone */
+} url_netloc_t;
+
 /* URL parse result structure */
 typedef struct {
     url_component_t scheme;
@@ -19,6 +34,8 @@ typedef struct {
     url_component_t query;
     url_component_t fragment;
     bool has_params;
+    url_netloc_t netloc_parts;
+    url_component_t source; /* the bytes the components point into */
 } url_parse_result_t;
 
 /* URL split result structure (without params) */
@@ -28,6 +45,8 @@ typedef struct {
     url_component_t path;
     url_component_t query;
     url_component_t fragment;
+    url_netloc_t netloc_parts;
+    url_component_t source; /* the bytes the components point into */
 } url_split_result_t;
 
 /* Error codes */
@@ -37,18 +56,236 @@ typedef enum {
     URL_PARSE_ERROR_INVALID_NETLOC = 2,
     URL_PARSE_ERROR_OUT_OF_MEMORY = 3,
     URL_PARSE_ERROR_INVALID_INPUT = 4,
+    URL_PARSE_ERROR_ABORTED = 5,
+    /* url_validate only */
+    URL_PARSE_ERROR_INVALID_SCHEME = 6,
+    URL_PARSE_ERROR_INVALID_CHAR = 7,
+    URL_PARSE_ERROR_INVALID_ESCAPE = 8,
+    URL_PARSE_ERROR_INVALID_PORT = 9,
     URL_PARSE_ERROR_UNKNOWN = 64
 } url_parse_error_t;
 
-/* Core parsing functions */
-url_parse_error_t url_parse(char *url, size_t url_len, const char *scheme,
-                            bool allow_fragments, url_parse_result_t *result);
+/* Message for an error code, as urllib.parse words it where it has one */
+const char *url_parse_strerror(url_parse_error_t err);
+
+/*
+ * SIMD level of the block kernels (structural scan, whitespace strip,
+ * unsafe byte removal, quote/unquote and query scans). The widest level the
+ * CPU supports is selected when the library is loaded; ABF_URLLIB_SIMD
+ * (scalar, sse4.2, avx2 or avx512bw) caps it. Every level gives the same
+ * results.
+ */
+typedef enum {
+    URL_SIMD_SCALAR,
+    URL_SIMD_SSE42,
+    URL_SIMD_AVX2,
+    URL_SIMD_AVX512BW,
+    URL_SIMD_LEVELS
+} url_simd_level_t;
+
+url_simd_level_t url_simd_level(void);
+
+/* Widest level this CPU runs */
+url_simd_level_t url_simd_supported(void);
+
+/* Switch to level, capped at url_simd_supported; returns the level used */
+url_simd_level_t url_simd_select(url_simd_level_t level);
+
+/* "scalar", "sse4.2", "avx2", "avx512bw"; NULL for an unknown level */
+const char *url_simd_name(url_simd_level_t level);
+
+/* Scratch memory for the urls that contain '\t', '\r' or '\n': urllib.parse
+ * drops those, so such a url is parsed from a copy without them and its
+ * result points into that copy. Blocks never move, so results stay valid
+ * until the scratch is reset or freed. Zero-initialize before first use. */
+struct url_scratch_block;
+
+typedef struct {
+    struct url_scratch_block *head; /* newest block, NULL when unused */
+} url_scratch_t;
+
+/* Keep the newest block for reuse, free the others */
+void url_scratch_reset(url_scratch_t *scratch);
 
-url_parse_error_t url_split(char *url, size_t url_len, const char *scheme,
-                            bool allow_fragments, url_split_result_t *result);
+void url_scratch_free(url_scratch_t *scratch);
 
-/* Quote function. */
+/* Core parsing functions. url is only read: result->source is url (after
+ * its leading whitespace) or, for the rare url with '\t', '\r' or '\n', its
+ * cleaned copy in scratch. A netloc with unbalanced brackets gives
+ * INVALID_IPV6, a bracketed host that is not an IPv6 address or IPvFuture
+ * gives INVALID_NETLOC. scheme is the default scheme, NULL or "" for
+ * none. */
+url_parse_error_t url_parse(const char *url, size_t url_len,
+                            const char *scheme, bool allow_fragments,
+                            url_scratch_t *scratch,
+                            url_parse_result_t *result);
+
+url_parse_error_t url_split(const char *url, size_t url_len,
+                            const char *scheme, bool allow_fragments,
+                            url_scratch_t *scratch,
+                            url_split_result_t *result);
+
+/* Batch parsing: urls[i] (url_lens[i] bytes) -> results[i], errors[i] (errors
+ * may be NULL), copies in scratch as for url_split. Large batches run on the
+ * worker pool, see pool.h. */
+void url_split_many(const char *const *urls, const size_t *url_lens,
+                    size_t count, const char *scheme, bool allow_fragments,
+                    url_scratch_t *scratch, url_split_result_t *results,
+                    url_parse_error_t *errors);
+
+void url_parse_many(const char *const *urls, const size_t *url_lens,
+                    size_t count, const char *scheme, bool allow_fragments,
+                    url_scratch_t *scratch, url_parse_result_t *results,
+                    url_parse_error_t *errors);
+
+/*
+ * Strict RFC 3986 check of a URI-reference (an absolute URI or a relative
+ * reference), where url_split accepts anything urllib.parse does. Every
+ * component must hold only its own character class, each '%' must start a
+ * %XX escape, the port must be digits up to 65535 and a bracketed host an
+ * IPv6 address (RFC 6874 zone allowed) or IPvFuture. No byte is stripped
+ * or removed: spaces, controls and non-ASCII bytes are errors.
+ *
+ * On error *error_offset (may be NULL) gets the offset of the offending
+ * byte: the '%' of a bad escape, the '[' of a bad IP literal, the start of
+ * an out of range port, offset 0 for a ':' in the first segment of a
+ * relative path (it would read as a scheme). Components are checked left
+ * to right, so it is the leftmost error but for '\t' '\r' '\n', which are
+ * found first. On success result (may be NULL) is as url_split gives it.
+ */
+url_parse_error_t url_validate(const char *url, size_t url_len,
+                               url_split_result_t *result,
+                               size_t *error_offset);
+
+/* url_validate of urls[i] into errors[i], offsets[i] (offsets may be NULL).
+ * Large batches run on the worker pool. */
+void url_validate_many(const char *const *urls, const size_t *url_lens,
+                       size_t count, url_parse_error_t *errors,
+                       size_t *offsets);
+
+/* Streaming: newline separated urls fed in arbitrary chunks. The callback
+ * gets every url (without its '\n') with its parse result; returning non-zero
+ * stops the stream. Without params, url_split is used and params is empty. */
+typedef int (*url_stream_cb)(void *ctx, const char *line, size_t line_len,
+                             const url_parse_result_t *result,
+                             url_parse_error_t err);
+
+typedef struct {
+    url_stream_cb callback;
+    void *ctx;
+    const char *scheme;
+    bool allow_fragments;
+    bool params;
+    char *carry; /* start of a url that continues in the next chunk */
+    size_t carry_len;
+    size_t carry_cap;
+    url_scratch_t scratch; /* reset after every callback */
+} url_stream_t;
+
+void url_stream_init(url_stream_t *stream, const char *scheme,
+                     bool allow_fragments, bool params, url_stream_cb callback,
+                     void *ctx);
+
+/* chunk is only read and need not outlive the call */
+url_parse_error_t url_stream_feed(url_stream_t *stream, const char *chunk,
+                                  size_t chunk_len);
+
+/* Parse a last url that has no trailing newline */
+url_parse_error_t url_stream_finish(url_stream_t *stream);
+
+void url_stream_free(url_stream_t *stream);
+
+/* Compiled quote "safe" set (always safe chars included) */
+typedef struct {
+    uint64_t bitmap[4];    /* bit c set: byte c is copied unchanged */
+    uint8_t lo_nibble[16]; /* SIMD lookup: bit (c >> 4) of lo_nibble[c & 0xF] */
+    bool space_plus;       /* quote_plus: ' ' is written as '+' */
+} url_quote_table_t;
+
+void url_quote_table_init(url_quote_table_t *table, const char *safe,
+                          size_t safe_len, bool space_plus);
+
+/* Exact quoted length, then write it into out (no terminator). */
+size_t url_quote_len(const char *input, size_t input_len,
+                     const url_quote_table_t *table);
+
+void url_quote_write(const char *input, size_t input_len,
+                     const url_quote_table_t *table, char *out);
+
+/* Quote function (in place, input must have room for input_len * 3 + 1). */
 url_parse_error_t url_quote(char *input, size_t input_len, const char *safe,
                             size_t safe_len);
 
+/* Offset of the first '%' (or '+' when plus), input_len if there is none */
+size_t url_unquote_find(const char *input, size_t input_len, bool plus);
+
+/* Decode %XX escapes (and '+' as space when plus) into out, which needs
+   input_len bytes and may be input itself; returns the decoded length. */
+size_t url_unquote(const char *input, size_t input_len, bool plus, char *out);
+
+/* Query string fields: name[=value], split on a one byte separator */
+enum { URL_QUERY_PERCENT = 1, URL_QUERY_PLUS = 2 };
+
+typedef struct {
+    url_component_t name;
+    url_component_t value;
+    bool has_value;        /* the field contains '=' */
+    uint8_t name_escapes;  /* URL_QUERY_PERCENT | URL_QUERY_PLUS */
+    uint8_t value_escapes; /* 0: the value is used as is */
+} url_query_field_t;
+
+typedef struct {
+    const char *query;
+    size_t len;
+    size_t pos;         /* start of the next field, > len when done */
+    size_t block;       /* offset of the classified block */
+    uint64_t masks[4];  /* separator, '=', '%', '+' bits of that block */
+    char separator;
+} url_query_iter_t;
+
+void url_query_iter_init(url_query_iter_t *it, const char *query, size_t len,
+                         char separator);
+
+/* Next field (possibly empty), false after the last one */
+bool url_query_next(url_query_iter_t *it, url_query_field_t *field);
+
+/* Components to recombine; params is empty for urlunsplit */
+typedef struct {
+    url_component_t scheme;
+    url_component_t netloc;
+    url_component_t path;
+    url_component_t params;
+    url_component_t query;
+    url_component_t fragment;
+    bool scheme_uses_netloc; /* scheme is in urllib.parse.uses_netloc */
+} url_unsplit_t;
+
+/* url_unsplit flags. URL_UNSPLIT_EMPTY_NETLOC is the rule of CPython 3.12.4
+   and 3.13 on: "//" is added before a path starting with "//" too, and for
+   a scheme in uses_netloc only before an empty or absolute path. Without
+   it, such a scheme always gets "//" unless the path starts with "//". */
+enum { URL_UNSPLIT_EMPTY_NETLOC = 1 };
+
+/* Write the url into out and return its length; out == NULL only measures */
+size_t url_unsplit(const url_unsplit_t *parts, unsigned flags, char *out);
+
+/* Merge a relative path into a base path and remove dot segments, as
+   urllib.parse.urljoin does; out needs base_len + path_len + 2 bytes. */
+size_t url_join_path(const char *base_path, size_t base_len, const char *path,
+                     size_t path_len, char *out);
+
+/* urllib.parse.urljoin on parsed urls. ref must have been parsed with the
+   base's scheme as default scheme, and the base's scheme (also the output
+   scheme) must be lowercase. relative / netloc: the scheme is in
+   uses_relative / uses_netloc. Returns false when the result is ref itself;
+   otherwise fills parts, whose path may point into path_buf (sized for
+   url_join_path). */
+bool url_join(const url_parse_result_t *base, const url_parse_result_t *ref,
+              bool relative, bool netloc, char *path_buf,
+              url_unsplit_t *parts);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
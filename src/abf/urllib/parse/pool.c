@@ -0,0 +1,209 @@
+#define _GNU_SOURCE
+#include "pool.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+enum {
+    POOL_MAX_THREADS = 64,
+    CACHE_LINE = 64
+};
+
+// One participant's share of the job. next is advanced by the owner and by
+// thieves alike, so every chunk is handed out exactly once.
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_size_t next;
+    size_t end;
+} p_pool_range_t;
+
+typedef struct {
+    url_pool_task_fn fn;
+    void *ctx;
+    size_t chunk;
+    size_t nranges;
+    p_pool_range_t ranges[POOL_MAX_THREADS];
+    atomic_size_t pending; // participants that have not finished yet
+} p_pool_job_t;
+
+static struct {
+    pthread_once_t once;      // pthread_atfork registration
+    pthread_mutex_t run_lock; // one job at a time; guards started
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    bool started;    // the workers run in this process
+    size_t nthreads; // participants, including the caller
+    unsigned long generation;
+    p_pool_job_t *job;
+} p_pool = {.once = PTHREAD_ONCE_INIT,
+            .run_lock = PTHREAD_MUTEX_INITIALIZER,
+            .lock = PTHREAD_MUTEX_INITIALIZER,
+            .work_cv = PTHREAD_COND_INITIALIZER,
+            .done_cv = PTHREAD_COND_INITIALIZER,
+            .nthreads = 1};
+
+// Take the next chunk of range r, false once it is drained
+static inline bool p_pool_take(p_pool_job_t *job, p_pool_range_t *r,
+                               size_t *begin, size_t *end) {
+    size_t b = atomic_fetch_add_explicit(&r->next, job->chunk,
+                                         memory_order_relaxed);
+    if (b >= r->end) {
+        return false;
+    }
+    *begin = b;
+    *end = b + job->chunk < r->end ? b + job->chunk : r->end;
+    return true;
+}
+
+static void p_pool_work(p_pool_job_t *job, size_t self) {
+    size_t begin, end;
+    // Own range first, then steal from the others in ring order
+    for (size_t k = 0; k < job->nranges; ++k) {
+        p_pool_range_t *r = &job->ranges[(self + k) % job->nranges];
+        while (p_pool_take(job, r, &begin, &end)) {
+            job->fn(job->ctx, begin, end);
+        }
+    }
+    if (atomic_fetch_sub_explicit(&job->pending, 1, memory_order_acq_rel) ==
+        1) {
+        pthread_mutex_lock(&p_pool.lock);
+        pthread_cond_signal(&p_pool.done_cv);
+        pthread_mutex_unlock(&p_pool.lock);
+    }
+}
+
+static void *p_pool_worker(void *arg) {
+    size_t self = (size_t)arg;
+    unsigned long seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&p_pool.lock);
+        while (p_pool.generation == seen) {
+            pthread_cond_wait(&p_pool.work_cv, &p_pool.lock);
+        }
+        seen = p_pool.generation;
+        p_pool_job_t *job = p_pool.job;
+        pthread_mutex_unlock(&p_pool.lock);
+        p_pool_work(job, self);
+    }
+    return NULL;
+}
+
+static void p_pool_start(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *env = getenv("ABF_URLLIB_THREADS");
+    if (env && *env) {
+        n = strtol(env, NULL, 10);
+    }
+    if (n < 1) {
+        n = 1;
+    }
+    if (n > POOL_MAX_THREADS) {
+        n = POOL_MAX_THREADS;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    size_t started = 1; // the caller
+    for (long i = 1; i < n; ++i) {
+        pthread_t tid;
+        if (pthread_create(&tid, &attr, p_pool_worker, (void *)started) != 0) {
+            break;
+        }
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+    p_pool.nthreads = started;
+}
+
+/*
+ * fork() copies only the calling thread: the child would get the pool's
+ * state but none of its workers. The locks are held across the fork, so no
+ * job is running, and the child starts over with an unstarted pool that
+ * url_pool_size starts again.
+ */
+static void p_pool_prepare(void) {
+    pthread_mutex_lock(&p_pool.run_lock);
+    pthread_mutex_lock(&p_pool.lock);
+}
+
+static void p_pool_parent(void) {
+    pthread_mutex_unlock(&p_pool.lock);
+    pthread_mutex_unlock(&p_pool.run_lock);
+}
+
+// The forking thread held the locks and is the child's only thread; the
+// condition variables may still count the parent's workers as waiters
+static void p_pool_child(void) {
+    pthread_cond_init(&p_pool.work_cv, NULL);
+    pthread_cond_init(&p_pool.done_cv, NULL);
+    p_pool.started = false;
+    p_pool.nthreads = 1;
+    p_pool.generation = 0; // new workers wait for the next job
+    p_pool.job = NULL;
+    pthread_mutex_unlock(&p_pool.lock);
+    pthread_mutex_unlock(&p_pool.run_lock);
+}
+
+static void p_pool_register(void) {
+    pthread_atfork(p_pool_prepare, p_pool_parent, p_pool_child);
+}
+
+size_t url_pool_size(void) {
+    pthread_once(&p_pool.once, p_pool_register);
+    pthread_mutex_lock(&p_pool.run_lock);
+    if (!p_pool.started) {
+        p_pool_start();
+        p_pool.started = true;
+    }
+    size_t nthreads = p_pool.nthreads;
+    pthread_mutex_unlock(&p_pool.run_lock);
+    return nthreads;
+}
+
+void url_pool_run(size_t count, size_t chunk, url_pool_task_fn fn,
+                  void *ctx) {
+    if (count == 0) {
+        return;
+    }
+    if (chunk == 0) {
+        chunk = 1;
+    }
+    size_t nthreads = url_pool_size();
+    if (nthreads == 1 || count <= chunk) {
+        fn(ctx, 0, count);
+        return;
+    }
+
+    p_pool_job_t job = {.fn = fn, .ctx = ctx, .chunk = chunk};
+    job.nranges = nthreads;
+    size_t share = count / nthreads, extra = count % nthreads, begin = 0;
+    for (size_t i = 0; i < nthreads; ++i) {
+        size_t len = share + (i < extra ? 1 : 0);
+        atomic_init(&job.ranges[i].next, begin);
+        job.ranges[i].end = begin + len;
+        begin += len;
+    }
+    atomic_init(&job.pending, nthreads);
+
+    pthread_mutex_lock(&p_pool.run_lock);
+    pthread_mutex_lock(&p_pool.lock);
+    p_pool.job = &job;
+    p_pool.generation++;
+    pthread_cond_broadcast(&p_pool.work_cv);
+    pthread_mutex_unlock(&p_pool.lock);
+
+    p_pool_work(&job, 0);
+
+    // Every worker takes part in every job, so once pending drops to zero
+    // nobody touches job again
+    pthread_mutex_lock(&p_pool.lock);
+    while (atomic_load_explicit(&job.pending, memory_order_acquire) != 0) {
+        pthread_cond_wait(&p_pool.done_cv, &p_pool.lock);
+    }
+    p_pool.job = NULL;
+    pthread_mutex_unlock(&p_pool.lock);
+    pthread_mutex_unlock(&p_pool.run_lock);
+}
@@ -0,0 +1,32 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Process one chunk [begin, end) of a parallel job */
+typedef void (*url_pool_task_fn)(void *ctx, size_t begin, size_t end);
+
+/*
+ * Run fn over [0, count) on the shared fixed-size worker pool, chunk items at
+ * a time. The range is split evenly between the participants (the calling
+ * thread is one of them); a participant that runs out of work steals chunks
+ * from the others. Returns once every chunk is done. Jobs from different
+ * callers are serialized.
+ *
+ * The pool has one participant per online CPU unless ABF_URLLIB_THREADS is
+ * set; it is started on first use, and again in a fork()ed child.
+ */
+void url_pool_run(size_t count, size_t chunk, url_pool_task_fn fn, void *ctx);
+
+/* Number of participants in a url_pool_run job (1: everything inline) */
+size_t url_pool_size(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+#include "stats.h"
+
+#ifdef ABF_STATS
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Thread_local url_stats_t *url_stats_tls;
+
+static struct {
+    pthread_once_t once;
+    pthread_key_t key; // destructor folds an exiting thread's block in
+    pthread_mutex_t lock;
+    url_stats_t *live;
+    url_stats_t retired; // sum of the blocks of exited threads
+} p_stats = {.once = PTHREAD_ONCE_INIT, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void p_stats_add(url_stats_t *to, const url_stats_t *from) {
+    for (size_t i = 0; i < URL_STAT_COUNT; ++i) {
+        to->counters[i] += __atomic_load_n(&from->counters[i], __ATOMIC_RELAXED);
+    }
+    for (size_t i = 0; i < URL_STATS_LEN_BUCKETS; ++i) {
+        to->length_log2[i] +=
+            __atomic_load_n(&from->length_log2[i], __ATOMIC_RELAXED);
+    }
+}
+
+static void p_stats_detach(void *block) {
+    url_stats_t *s = block;
+    pthread_mutex_lock(&p_stats.lock);
+    p_stats_add(&p_stats.retired, s);
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else {
+        p_stats.live = s->next;
+    }
+    if (s->next) {
+        s->next->prev = s->prev;
+    }
+    pthread_mutex_unlock(&p_stats.lock);
+    free(s);
+}
+
+static void p_stats_init(void) {
+    pthread_key_create(&p_stats.key, p_stats_detach);
+}
+
+url_stats_t *url_stats_attach(void) {
+    pthread_once(&p_stats.once, p_stats_init);
+    url_stats_t *s = calloc(1, sizeof(*s));
+    if (!s) {
+        return NULL;
+    }
+    pthread_mutex_lock(&p_stats.lock);
+    s->next = p_stats.live;
+    if (s->next) {
+        s->next->prev = s;
+    }
+    p_stats.live = s;
+    pthread_mutex_unlock(&p_stats.lock);
+    pthread_setspecific(p_stats.key, s);
+    url_stats_tls = s;
+    return s;
+}
+
+const char *url_stat_name(url_stat_t stat) {
+    static const char *const names[URL_STAT_COUNT] = {
+        [URL_STAT_SPLIT] = "split",
+        [URL_STAT_PARSE] = "parse",
+        [URL_STAT_UNSAFE_COPY] = "unsafe_copy",
+        [URL_STAT_INVALID_SCHEME] = "invalid_scheme",
+        [URL_STAT_INVALID_NETLOC] = "invalid_netloc",
+        [URL_STAT_HAS_PARAMS] = "has_params",
+        [URL_STAT_BYTES_INPUT] = "bytes_input",
+        [URL_STAT_STR_INPUT] = "str_input",
+        [URL_STAT_STR_NON_ASCII] = "str_non_ascii",
+        [URL_STAT_STDLIB_FALLBACK] = "stdlib_fallback"};
+    return stat < URL_STAT_COUNT ? names[stat] : NULL;
+}
+
+void url_stats_read(url_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&p_stats.lock);
+    p_stats_add(out, &p_stats.retired);
+    for (url_stats_t *s = p_stats.live; s; s = s->next) {
+        p_stats_add(out, s);
+    }
+    pthread_mutex_unlock(&p_stats.lock);
+    out->prev = out->next = NULL;
+}
+
+void url_stats_reset(void) {
+    pthread_mutex_lock(&p_stats.lock);
+    memset(&p_stats.retired, 0, sizeof(p_stats.retired));
+    for (url_stats_t *s = p_stats.live; s; s = s->next) {
+        for (size_t i = 0; i < URL_STAT_COUNT; ++i) {
+            __atomic_store_n(&s->counters[i], 0, __ATOMIC_RELAXED);
+        }
+        for (size_t i = 0; i < URL_STATS_LEN_BUCKETS; ++i) {
+            __atomic_store_n(&s->length_log2[i], 0, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&p_stats.lock);
+}
+
+#else
+
+typedef int p_stats_disabled_t; // ISO C wants something in every unit
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hot-path counters, only compiled in with -DABF_STATS: without it the
+ * URL_STAT_* macros expand to nothing and none of this exists.
+ *
+ * Every thread counts into a block of its own with plain relaxed stores (no
+ * locked instructions, no shared cache lines). url_stats_read() sums the
+ * blocks of the live threads and what exited threads left behind.
+ */
+#ifdef ABF_STATS
+
+typedef enum {
+    URL_STAT_SPLIT = 0,       /* urls split (url_parse included) */
+    URL_STAT_PARSE,           /* of those, by url_parse */
+    URL_STAT_UNSAFE_COPY,     /* copied to drop '\t' '\r' '\n' first */
+    URL_STAT_INVALID_SCHEME,  /* a ':' whose prefix is not a scheme */
+    URL_STAT_INVALID_NETLOC,  /* rejected bracketed / IPv6 netloc */
+    URL_STAT_HAS_PARAMS,      /* url_parse found ;params */
+    URL_STAT_BYTES_INPUT,     /* bytes arguments */
+    URL_STAT_STR_INPUT,       /* str arguments */
+    URL_STAT_STR_NON_ASCII,   /* of those, needing a UTF-8 conversion */
+    URL_STAT_STDLIB_FALLBACK, /* calls handed to urllib.parse */
+    URL_STAT_COUNT
+} url_stat_t;
+
+/* Bucket b counts urls of bit length b (0: empty), the last one the rest */
+enum { URL_STATS_LEN_BUCKETS = 33 };
+
+typedef struct url_stats {
+    uint64_t counters[URL_STAT_COUNT];
+    uint64_t length_log2[URL_STATS_LEN_BUCKETS];
+    struct url_stats *prev, *next; /* live blocks */
+} url_stats_t;
+
+extern _Thread_local url_stats_t *url_stats_tls;
+
+/* The calling thread's block, created on first use (NULL without memory) */
+url_stats_t *url_stats_attach(void);
+
+static inline url_stats_t *url_stats_mine(void) {
+    return url_stats_tls ? url_stats_tls : url_stats_attach();
+}
+
+static inline void url_stats_inc(url_stat_t stat) {
+    url_stats_t *s = url_stats_mine();
+    if (s) {
+        __atomic_store_n(&s->counters[stat], s->counters[stat] + 1,
+                         __ATOMIC_RELAXED);
+    }
+}
+
+static inline void url_stats_len(size_t len) {
+    url_stats_t *s = url_stats_mine();
+    if (s) {
+        size_t b = len ? 64 - (size_t)__builtin_clzll((unsigned long long)len)
+                       : 0;
+        if (b >= URL_STATS_LEN_BUCKETS) {
+            b = URL_STATS_LEN_BUCKETS - 1;
+        }
+        __atomic_store_n(&s->length_log2[b], s->length_log2[b] + 1,
+                         __ATOMIC_RELAXED);
+    }
+}
+
+/* Name of a counter, as stats() reports it */
+const char *url_stat_name(url_stat_t stat);
+
+/* Sum of every thread's counters into out (its list links are unused) */
+void url_stats_read(url_stats_t *out);
+
+/* Zero every thread's counters; increments racing with it may survive */
+void url_stats_reset(void);
+
+#define URL_STAT_INC(stat) url_stats_inc(stat)
+#define URL_STAT_LEN(len) url_stats_len(len)
+
+#else
+
+#define URL_STAT_INC(stat) ((void)0)
+#define URL_STAT_LEN(len) ((void)0)
+
+#endif
+
+#endif
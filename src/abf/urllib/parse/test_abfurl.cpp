@@ -0,0 +1,105 @@
+#include <abfurl/abfurl.hpp>
+#include <array>
+#include <cstdio>
+
+using namespace abf::url::literals;
+using abf::url::errc;
+
+// Parsed by the compiler
+constexpr auto api =
+    "https://user:pw@API.example.com:8443/v1/users?page=2#top"_url;
+static_assert(api.scheme == "https" && api.path == "/v1/users");
+static_assert(api.query == "page=2" && api.fragment == "top");
+static_assert(api.netloc_parts.username == "user" &&
+              api.netloc_parts.password == "pw");
+static_assert(api.netloc_parts.hostname == "API.example.com" &&
+              api.netloc_parts.port == "8443" && api.netloc_parts.host_upper);
+
+constexpr std::array routes = {"/users"_url, "/users/me?fields=id"_url,
+                               "//cdn.example.com/static/"_url};
+static_assert(routes[1].query == "fields=id");
+static_assert(routes[2].netloc == "cdn.example.com");
+
+static_assert(abf::url::parse("http://h/a;b/c;d?q").params == "d");
+static_assert(!abf::url::parse("mailto:a;b").has_params);
+static_assert(abf::url::split("//h/p", "ftp").scheme == "ftp");
+static_assert(abf::url::split("http://[::1/").error == errc::invalid_ipv6);
+static_assert(abf::url::split("http://[::1x]/").error ==
+              errc::invalid_netloc);
+static_assert(abf::url::split("http://h\t/").error == errc::invalid_input);
+
+// The compile-time parser, run at run time, against the C library
+static const char *const urls[] = {
+    "",
+    "  http://a/b",
+    "http://user:pw@host:80/p;x/q;y?k=v#f",
+    "HTTP://Host/",
+    "http://[::1]:8080/x",
+    "http://[fe80::1%25eth0]/",
+    "http://[v1.fe]/",
+    "http://[1.2.3.4]/",
+    "http://[::ffff:1.2.3.4]/",
+    "http://[1:2:3:4:5:6:7:8:9]/",
+    "http://[::1/",
+    "http://::1]/",
+    "http://a@b@c:/",
+    "http://h?#",
+    "http://h#a?b",
+    "x:y",
+    "1x:y",
+    "a/b:c",
+    "path;params",
+    "/a;b/c?d;e",
+    "//host",
+    "///p",
+    "mailto:user@example.com",
+    "tel:+1;ext=2",
+    "http:/a;x",
+};
+
+static bool same(const char *url, std::string_view scheme,
+                 bool allow_fragments) {
+    std::size_t semicolon;
+    auto ct = abf::url::detail::split(url, scheme, allow_fragments,
+                                      &semicolon);
+    auto rt = abf::url::split(url, scheme, allow_fragments);
+    auto ctp = abf::url::detail::parse(url, scheme, allow_fragments);
+    auto rtp = abf::url::parse(url, scheme, allow_fragments);
+    // A rejected url's components are unspecified
+    return ct.error == rt.error && ctp.error == rtp.error &&
+           (ct.error != errc::ok || (ct == rt && ctp == rtp));
+}
+
+int main() {
+    for (const char *url : urls) {
+        for (std::string_view scheme : {"", "http", "mailto"}) {
+            for (bool allow_fragments : {true, false}) {
+                if (!same(url, scheme, allow_fragments)) {
+                    printf("constexpr mismatch: %s\n", url);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    // Urls with tabs or newlines need a parser
+    abf::url::parser parser;
+    auto tabbed = parser.split("ht\ttp://ho\nst/p");
+    if (abf::url::split("ht\ttp://ho\nst/p").error != errc::invalid_input ||
+        !tabbed || tabbed.scheme != "http" || tabbed.netloc != "host") {
+        printf("parser error\n");
+        return 1;
+    }
+    parser.reset();
+
+    // What urlsplit lets through, validate does not
+    auto strict = abf::url::validate("http://h:80/a b");
+    if (!abf::url::validate("http://[fe80::1%25eth0]:80/?q#f") ||
+        strict.error != errc::invalid_char || strict.offset != 13 ||
+        abf::url::validate("http://h:99999/").error != errc::invalid_port ||
+        abf::url::validate("/a%2g").offset != 2) {
+        printf("validate error\n");
+        return 1;
+    }
+    return 0;
+}
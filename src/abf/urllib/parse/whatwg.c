@@ -0,0 +1,1178 @@
+#define _GNU_SOURCE
+#include "whatwg.h"
+#include <string.h>
+
+/*
+ * The spec's basic URL parser (no state override), written as straight-line
+ * code per state group rather than one loop over code points. The href is
+ * written front to back into the output buffer; the only edits after the
+ * fact are path shortening (truncate at the last '/') and the "/." prefix of
+ * a hostless path that starts with an empty segment.
+ */
+
+enum { W_EOF = -1, W_SLACK = 64 };
+
+/* Percent-encode sets, one bit each. C0 controls, DEL and every non-ASCII
+ * byte are in all of them; the C0 control set itself is mask 0. */
+enum {
+    W_FRAGMENT = 1 << 0,
+    W_QUERY = 1 << 1,
+    W_SPECIAL_QUERY = 1 << 2,
+    W_PATH = 1 << 3,
+    W_USERINFO = 1 << 4,
+    W_QUERY_UP = W_QUERY | W_SPECIAL_QUERY | W_PATH | W_USERINFO,
+    W_PATH_UP = W_PATH | W_USERINFO
+};
+
+// clang-format off
+static const uint8_t w_ENCODE_SETS[128] = {
+    [' '] = W_FRAGMENT | W_QUERY_UP,
+    ['"'] = W_FRAGMENT | W_QUERY_UP,
+    ['<'] = W_FRAGMENT | W_QUERY_UP,
+    ['>'] = W_FRAGMENT | W_QUERY_UP,
+    ['#'] = W_QUERY_UP,
+    ['\''] = W_SPECIAL_QUERY,
+    ['`'] = W_FRAGMENT | W_PATH_UP,
+    ['?'] = W_PATH_UP,
+    ['^'] = W_USERINFO,
+    ['{'] = W_PATH_UP,
+    ['}'] = W_PATH_UP,
+    ['/'] = W_USERINFO,
+    [':'] = W_USERINFO,
+    [';'] = W_USERINFO,
+    ['='] = W_USERINFO,
+    ['@'] = W_USERINFO,
+    ['['] = W_USERINFO,
+    ['\\'] = W_USERINFO,
+    [']'] = W_USERINFO,
+    ['|'] = W_USERINFO,
+};
+
+/* Forbidden host code points; domains also forbid C0 controls, '%', DEL */
+static const bool w_FORBIDDEN_HOST[128] = {
+    [0] = true, ['\t'] = true, ['\n'] = true, ['\r'] = true, [' '] = true,
+    ['#'] = true, ['/'] = true, [':'] = true, ['<'] = true, ['>'] = true,
+    ['?'] = true, ['@'] = true, ['['] = true, ['\\'] = true, [']'] = true,
+    ['^'] = true, ['|'] = true,
+};
+// clang-format on
+
+static inline bool w_encode(unsigned char c, uint8_t set) {
+    return c < 0x20 || c >= 0x7F || (w_ENCODE_SETS[c] & set);
+}
+
+static inline bool w_forbidden_domain(unsigned char c) {
+    return c <= 0x20 || c >= 0x7F || c == '%' || w_FORBIDDEN_HOST[c];
+}
+
+static inline bool w_is_alpha(int c) {
+    return ((unsigned)c | 0x20) - 'a' < 26;
+}
+
+static inline bool w_is_digit(int c) { return (unsigned)c - '0' < 10; }
+
+static inline int w_hex_value(int c) {
+    if (w_is_digit(c)) {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+typedef struct {
+    const char *in; // input, trimmed and without tab/newline
+    size_t len;
+    size_t pos;
+    char *out; // href being written
+    size_t cap;
+    size_t n;
+    bool overflow; // a write did not fit: the result is WHATWG_ERROR_NO_SPACE
+    const whatwg_url_t *base;
+    whatwg_url_t *url;
+    whatwg_to_ascii_fn to_ascii;
+    void *ctx;
+} w_parser_t;
+
+static inline int w_at(const w_parser_t *p, size_t i) {
+    return i < p->len ? (unsigned char)p->in[i] : W_EOF;
+}
+
+static inline bool w_special(const w_parser_t *p) {
+    return p->url->scheme != WHATWG_SCHEME_OTHER;
+}
+
+// '/', or '\\' in a special URL
+static inline bool w_is_slash(const w_parser_t *p, int c) {
+    return c == '/' || (c == '\\' && w_special(p));
+}
+
+static inline bool w_reserve(w_parser_t *p, size_t k) {
+    if (p->cap - p->n < k) {
+        p->overflow = true;
+        return false;
+    }
+    return true;
+}
+
+static inline void w_write(w_parser_t *p, const char *s, size_t k) {
+    if (k && w_reserve(p, k)) {
+        memcpy(p->out + p->n, s, k);
+        p->n += k;
+    }
+}
+
+static inline void w_put(w_parser_t *p, char c) { w_write(p, &c, 1); }
+
+static void w_write_encoded(w_parser_t *p, const char *s, size_t k,
+                            uint8_t set) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t i = 0;
+    while (i < k) {
+        size_t run = i;
+        while (run < k && !w_encode((unsigned char)s[run], set)) {
+            ++run;
+        }
+        w_write(p, s + i, run - i);
+        if (run == k) {
+            break;
+        }
+        unsigned char c = (unsigned char)s[run];
+        char esc[3] = {'%', hex[c >> 4], hex[c & 0xF]};
+        w_write(p, esc, sizeof(esc));
+        i = run + 1;
+    }
+}
+
+static void w_write_decimal(w_parser_t *p, uint32_t v) {
+    char digits[10];
+    size_t k = sizeof(digits);
+    do {
+        digits[--k] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    w_write(p, digits + k, sizeof(digits) - k);
+}
+
+// End of the path / query of a parsed URL whose href is len bytes long
+static inline uint32_t w_path_end(const whatwg_url_t *u, size_t len) {
+    if (u->search_start != WHATWG_OMITTED) {
+        return u->search_start;
+    }
+    return u->hash_start != WHATWG_OMITTED ? u->hash_start : (uint32_t)len;
+}
+
+static inline uint32_t w_query_end(const whatwg_url_t *u, size_t len) {
+    return u->hash_start != WHATWG_OMITTED ? u->hash_start : (uint32_t)len;
+}
+
+/*
+ * Schemes
+ */
+static whatwg_scheme_t w_scheme_type(const char *s, size_t n) {
+    switch (n) {
+    case 2:
+        return memcmp(s, "ws", 2) == 0 ? WHATWG_SCHEME_WS
+                                       : WHATWG_SCHEME_OTHER;
+    case 3:
+        if (memcmp(s, "wss", 3) == 0) {
+            return WHATWG_SCHEME_WSS;
+        }
+        return memcmp(s, "ftp", 3) == 0 ? WHATWG_SCHEME_FTP
+                                        : WHATWG_SCHEME_OTHER;
+    case 4:
+        if (memcmp(s, "http", 4) == 0) {
+            return WHATWG_SCHEME_HTTP;
+        }
+        return memcmp(s, "file", 4) == 0 ? WHATWG_SCHEME_FILE
+                                         : WHATWG_SCHEME_OTHER;
+    case 5:
+        return memcmp(s, "https", 5) == 0 ? WHATWG_SCHEME_HTTPS
+                                          : WHATWG_SCHEME_OTHER;
+    default:
+        return WHATWG_SCHEME_OTHER;
+    }
+}
+
+int whatwg_default_port(whatwg_scheme_t scheme) {
+    switch (scheme) {
+    case WHATWG_SCHEME_HTTP:
+    case WHATWG_SCHEME_WS:
+        return 80;
+    case WHATWG_SCHEME_HTTPS:
+    case WHATWG_SCHEME_WSS:
+        return 443;
+    case WHATWG_SCHEME_FTP:
+        return 21;
+    default:
+        return -1;
+    }
+}
+
+/*
+ * Hosts
+ */
+
+// One part of an IPv4 address: decimal, 0x hex or 0 octal. Values past
+// 2^32 saturate, which every caller rejects anyway.
+static bool w_ipv4_number(const char *s, size_t n, uint64_t *value) {
+    if (!n) {
+        return false;
+    }
+    unsigned radix = 10;
+    if (n >= 2 && s[0] == '0' && (s[1] | 0x20) == 'x') {
+        radix = 16;
+        s += 2;
+        n -= 2;
+    } else if (n >= 2 && s[0] == '0') {
+        radix = 8;
+        ++s;
+        --n;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int d = w_hex_value((unsigned char)s[i]);
+        if (d < 0 || (unsigned)d >= radix) {
+            return false;
+        }
+        if (v <= UINT32_MAX) {
+            v = v * radix + (unsigned)d;
+        }
+    }
+    *value = v;
+    return true;
+}
+
+// The last label (ignoring one trailing dot) is all digits or 0x hex
+static bool w_ends_in_number(const char *s, size_t n) {
+    if (n && s[n - 1] == '.') {
+        --n;
+    }
+    const char *dot = n ? memrchr(s, '.', n) : NULL;
+    const char *last = dot ? dot + 1 : s;
+    size_t k = (size_t)(s + n - last);
+    if (!k) {
+        return false;
+    }
+    size_t i = 0;
+    while (i < k && w_is_digit((unsigned char)last[i])) {
+        ++i;
+    }
+    if (i == k) {
+        return true;
+    }
+    if (k < 2 || last[0] != '0' || (last[1] | 0x20) != 'x') {
+        return false;
+    }
+    for (i = 2; i < k; ++i) {
+        if (w_hex_value((unsigned char)last[i]) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool w_parse_ipv4(const char *s, size_t n, uint32_t *addr) {
+    if (n && s[n - 1] == '.') {
+        --n;
+    }
+    uint64_t numbers[4];
+    size_t count = 0;
+    const char *end = s + n;
+    for (;;) {
+        const char *dot = memchr(s, '.', (size_t)(end - s));
+        const char *part_end = dot ? dot : end;
+        if (count == 4 ||
+            !w_ipv4_number(s, (size_t)(part_end - s), &numbers[count++])) {
+            return false;
+        }
+        if (!dot) {
+            break;
+        }
+        s = dot + 1;
+    }
+    uint64_t v = numbers[count - 1];
+    if (v >= (uint64_t)1 << (8 * (5 - count))) {
+        return false;
+    }
+    for (size_t i = 0; i + 1 < count; ++i) {
+        if (numbers[i] > 255) {
+            return false;
+        }
+        v += numbers[i] << (8 * (3 - i));
+    }
+    *addr = (uint32_t)v;
+    return true;
+}
+
+static void w_write_ipv4(w_parser_t *p, uint32_t addr) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        w_write_decimal(p, (addr >> shift) & 0xFF);
+        if (shift) {
+            w_put(p, '.');
+        }
+    }
+}
+
+// The spec's IPv6 parser, code point for code point
+static bool w_parse_ipv6(const char *s, size_t n, uint16_t address[8]) {
+    memset(address, 0, 8 * sizeof(*address));
+    size_t piece = 0, i = 0;
+    int compress = -1;
+#define W_C (i < n ? (unsigned char)s[i] : W_EOF)
+    if (W_C == ':') {
+        if (i + 1 >= n || s[i + 1] != ':') {
+            return false;
+        }
+        i += 2;
+        compress = (int)++piece;
+    }
+    while (W_C != W_EOF) {
+        if (piece == 8) {
+            return false;
+        }
+        if (W_C == ':') {
+            if (compress >= 0) {
+                return false;
+            }
+            ++i;
+            compress = (int)++piece;
+            continue;
+        }
+        unsigned value = 0, length = 0;
+        while (length < 4 && w_hex_value(W_C) >= 0) {
+            value = value * 16 + (unsigned)w_hex_value(W_C);
+            ++i;
+            ++length;
+        }
+        if (W_C == '.') {
+            // IPv4 in the last two pieces
+            if (!length || piece > 6) {
+                return false;
+            }
+            i -= length;
+            int seen = 0;
+            while (W_C != W_EOF) {
+                if (seen > 0) {
+                    if (W_C != '.' || seen >= 4) {
+                        return false;
+                    }
+                    ++i;
+                }
+                if (!w_is_digit(W_C)) {
+                    return false;
+                }
+                int part = -1;
+                while (w_is_digit(W_C)) {
+                    if (part == 0) {
+                        return false;
+                    }
+                    part = (part < 0 ? 0 : part * 10) + (W_C - '0');
+                    if (part > 255) {
+                        return false;
+                    }
+                    ++i;
+                }
+                address[piece] = (uint16_t)(address[piece] * 0x100 + part);
+                if (++seen == 2 || seen == 4) {
+                    ++piece;
+                }
+            }
+            if (seen != 4) {
+                return false;
+            }
+            break;
+        }
+        if (W_C == ':') {
+            if (++i >= n) {
+                return false;
+            }
+        } else if (W_C != W_EOF) {
+            return false;
+        }
+        address[piece++] = (uint16_t)value;
+    }
+#undef W_C
+    if (compress >= 0) {
+        size_t swaps = piece - (size_t)compress;
+        for (size_t k = 7; k != 0 && swaps > 0; --k, --swaps) {
+            uint16_t tmp = address[k];
+            address[k] = address[(size_t)compress + swaps - 1];
+            address[(size_t)compress + swaps - 1] = tmp;
+        }
+    } else if (piece != 8) {
+        return false;
+    }
+    return true;
+}
+
+// Lowercase hex pieces, the first longest run of 2+ zero pieces as "::"
+static void w_write_ipv6(w_parser_t *p, const uint16_t address[8]) {
+    int compress = -1, best = 1;
+    for (int i = 0; i < 8;) {
+        int j = i;
+        while (j < 8 && !address[j]) {
+            ++j;
+        }
+        if (j - i > best) {
+            best = j - i;
+            compress = i;
+        }
+        i = j > i ? j : i + 1;
+    }
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < 8; ++i) {
+        if (i == compress) {
+            w_write(p, i ? ":" : "::", i ? 1 : 2);
+            i += best - 1;
+            continue;
+        }
+        char digits[4];
+        int k = 4;
+        unsigned v = address[i];
+        do {
+            digits[--k] = hex[v & 0xF];
+            v >>= 4;
+        } while (v);
+        w_write(p, digits + k, (size_t)(4 - k));
+        if (i != 7) {
+            w_put(p, ':');
+        }
+    }
+}
+
+static bool w_has_xn_label(const char *s, size_t n) {
+    for (size_t i = 0; i + 4 <= n; ++i) {
+        if ((i == 0 || s[i - 1] == '.') && memcmp(s + i, "xn--", 4) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Special-scheme host: percent-decode, to ASCII, then IPv4 or domain
+static whatwg_error_t w_domain(w_parser_t *p, const char *s, size_t n) {
+    size_t start = p->n;
+    if (!w_reserve(p, n)) {
+        return WHATWG_OK;
+    }
+    bool ascii = true;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '%' && i + 2 < n) {
+            int hi = w_hex_value((unsigned char)s[i + 1]);
+            int lo = w_hex_value((unsigned char)s[i + 2]);
+            if (hi >= 0 && lo >= 0) {
+                c = (unsigned char)(hi * 16 + lo);
+                i += 2;
+            }
+        }
+        if (c >= 'A' && c <= 'Z') {
+            c |= 0x20;
+        }
+        ascii &= c < 0x80;
+        p->out[p->n++] = (char)c;
+    }
+
+    if (!ascii || (p->to_ascii && w_has_xn_label(p->out + start,
+                                                 p->n - start))) {
+        if (!p->to_ascii) {
+            return WHATWG_ERROR_HOST;
+        }
+        ptrdiff_t k = p->to_ascii(p->ctx, p->out + start, p->n - start,
+                                  p->out + p->n, p->cap - p->n);
+        if (k == -2) {
+            p->overflow = true;
+            return WHATWG_OK;
+        }
+        if (k < 0) {
+            return WHATWG_ERROR_HOST;
+        }
+        memmove(p->out + start, p->out + p->n, (size_t)k);
+        p->n = start + (size_t)k;
+    }
+
+    const char *domain = p->out + start;
+    size_t len = p->n - start;
+    if (!len) {
+        return WHATWG_ERROR_HOST;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (w_forbidden_domain((unsigned char)domain[i])) {
+            return WHATWG_ERROR_HOST;
+        }
+    }
+    if (w_ends_in_number(domain, len)) {
+        uint32_t addr;
+        if (!w_parse_ipv4(domain, len, &addr)) {
+            return WHATWG_ERROR_HOST;
+        }
+        p->n = start;
+        w_write_ipv4(p, addr);
+    }
+    return WHATWG_OK;
+}
+
+static whatwg_error_t w_host(w_parser_t *p, const char *s, size_t n,
+                             bool special) {
+    whatwg_error_t err = WHATWG_OK;
+    p->url->host_start = (uint32_t)p->n;
+    if (n && s[0] == '[') {
+        uint16_t address[8];
+        if (s[n - 1] != ']' || n < 2 || !w_parse_ipv6(s + 1, n - 2, address)) {
+            return WHATWG_ERROR_HOST;
+        }
+        w_put(p, '[');
+        w_write_ipv6(p, address);
+        w_put(p, ']');
+    } else if (!special) {
+        // Opaque host
+        for (size_t i = 0; i < n; ++i) {
+            unsigned char c = (unsigned char)s[i];
+            if (c < 0x80 && w_FORBIDDEN_HOST[c]) {
+                return WHATWG_ERROR_HOST;
+            }
+        }
+        w_write_encoded(p, s, n, 0);
+    } else {
+        err = w_domain(p, s, n);
+    }
+    p->url->host_end = (uint32_t)p->n;
+    return err;
+}
+
+/*
+ * Paths
+ */
+
+// "." or "%2e" (any case)
+static inline bool w_is_single_dot(const char *s, size_t n) {
+    return (n == 1 && s[0] == '.') ||
+           (n == 3 && s[0] == '%' && s[1] == '2' && (s[2] | 0x20) == 'e');
+}
+
+// "..", ".%2e", "%2e." or "%2e%2e" (any case)
+static bool w_is_double_dot(const char *s, size_t n) {
+    switch (n) {
+    case 2:
+        return s[0] == '.' && s[1] == '.';
+    case 4:
+        return (s[0] == '.' && w_is_single_dot(s + 1, 3)) ||
+               (s[3] == '.' && w_is_single_dot(s, 3));
+    case 6:
+        return w_is_single_dot(s, 3) && w_is_single_dot(s + 3, 3);
+    default:
+        return false;
+    }
+}
+
+// Windows drive letter: ASCII alpha then ':' (or '|' when not normalized)
+static inline bool w_is_drive_letter(const char *s, size_t n,
+                                     bool normalized) {
+    return n == 2 && w_is_alpha((unsigned char)s[0]) &&
+           (s[1] == ':' || (!normalized && s[1] == '|'));
+}
+
+// The input from pos starts with a drive letter followed by a delimiter
+static bool w_starts_with_drive_letter(const w_parser_t *p, size_t pos) {
+    if (p->len - pos < 2 || pos > p->len ||
+        !w_is_drive_letter(p->in + pos, 2, false)) {
+        return false;
+    }
+    int c = w_at(p, pos + 2);
+    return c == W_EOF || c == '/' || c == '\\' || c == '?' || c == '#';
+}
+
+// First segment of a parsed path (without its '/')
+static inline bool w_path_first_is_drive(const char *path, size_t len) {
+    return len >= 3 && path[0] == '/' &&
+           w_is_drive_letter(path + 1, 2, true) && (len == 3 || path[3] == '/');
+}
+
+static void w_shorten_path(w_parser_t *p) {
+    size_t start = p->url->pathname_start;
+    char *path = p->out + start;
+    size_t len = p->n - start;
+    if (!len) {
+        return;
+    }
+    if (p->url->scheme == WHATWG_SCHEME_FILE && len == 3 &&
+        w_path_first_is_drive(path, len)) {
+        return;
+    }
+    char *slash = memrchr(path, '/', len);
+    p->n = (size_t)(slash - p->out);
+}
+
+// Path state: segments from pos up to '?', '#' or the end; the '/' before
+// the first one is already consumed
+static void w_path(w_parser_t *p) {
+    bool special = w_special(p);
+    bool file = p->url->scheme == WHATWG_SCHEME_FILE;
+    for (;;) {
+        size_t start = p->pos, end = start;
+        while (end < p->len) {
+            char c = p->in[end];
+            if (c == '/' || c == '?' || c == '#' || (special && c == '\\')) {
+                break;
+            }
+            ++end;
+        }
+        const char *seg = p->in + start;
+        size_t n = end - start;
+        bool slash = w_is_slash(p, w_at(p, end));
+        if (w_is_double_dot(seg, n)) {
+            w_shorten_path(p);
+            if (!slash) {
+                w_put(p, '/');
+            }
+        } else if (w_is_single_dot(seg, n)) {
+            if (!slash) {
+                w_put(p, '/');
+            }
+        } else if (file && p->n == p->url->pathname_start &&
+                   w_is_drive_letter(seg, n, false)) {
+            char drive[3] = {'/', seg[0], ':'};
+            w_write(p, drive, sizeof(drive));
+        } else {
+            w_put(p, '/');
+            w_write_encoded(p, seg, n, W_PATH);
+        }
+        p->pos = end;
+        if (!slash) {
+            return;
+        }
+        ++p->pos;
+    }
+}
+
+// Opaque path: up to '?' or '#', C0 control set; a space right before
+// either is written as %20
+static void w_opaque_path(w_parser_t *p) {
+    p->url->has_opaque_path = true;
+    p->url->pathname_start = (uint32_t)p->n;
+    size_t end = p->pos;
+    while (end < p->len && p->in[end] != '?' && p->in[end] != '#') {
+        ++end;
+    }
+    size_t k = end - p->pos;
+    bool space = k && end < p->len && p->in[end - 1] == ' ';
+    w_write_encoded(p, p->in + p->pos, k - space, 0);
+    if (space) {
+        w_write(p, "%20", 3);
+    }
+    p->pos = end;
+}
+
+static void w_query_fragment(w_parser_t *p) {
+    int c = w_at(p, p->pos);
+    if (c == '?') {
+        p->url->search_start = (uint32_t)p->n;
+        w_put(p, '?');
+        const char *q = p->in + p->pos + 1;
+        const char *hash = memchr(q, '#', p->len - p->pos - 1);
+        size_t end = hash ? (size_t)(hash - p->in) : p->len;
+        w_write_encoded(p, q, end - p->pos - 1,
+                        w_special(p) ? W_SPECIAL_QUERY : W_QUERY);
+        p->pos = end;
+        c = w_at(p, end);
+    }
+    if (c == '#') {
+        p->url->hash_start = (uint32_t)p->n;
+        w_put(p, '#');
+        w_write_encoded(p, p->in + p->pos + 1, p->len - p->pos - 1,
+                        W_FRAGMENT);
+        p->pos = p->len;
+    }
+}
+
+// Path start state (after a host): a special URL always has a path
+static void w_path_start(w_parser_t *p) {
+    p->url->pathname_start = (uint32_t)p->n;
+    int c = w_at(p, p->pos);
+    if (w_special(p)) {
+        if (c == '/' || c == '\\') {
+            ++p->pos;
+        }
+        w_path(p);
+    } else if (c != '?' && c != '#' && c != W_EOF) {
+        if (c == '/') {
+            ++p->pos;
+        }
+        w_path(p);
+    }
+    w_query_fragment(p);
+}
+
+/*
+ * Authority
+ */
+static void w_no_credentials(whatwg_url_t *url, size_t at) {
+    url->username_start = url->username_end = (uint32_t)at;
+    url->password_start = url->password_end = (uint32_t)at;
+}
+
+static whatwg_error_t w_authority(w_parser_t *p) {
+    whatwg_url_t *url = p->url;
+    bool special = w_special(p);
+    size_t end = p->pos;
+    while (end < p->len) {
+        char c = p->in[end];
+        if (c == '/' || c == '?' || c == '#' || (special && c == '\\')) {
+            break;
+        }
+        ++end;
+    }
+    const char *s = p->in + p->pos;
+    size_t n = end - p->pos;
+
+    w_write(p, "//", 2);
+    url->has_authority = true;
+    w_no_credentials(url, p->n);
+    const char *at = n ? memrchr(s, '@', n) : NULL;
+    if (at) {
+        // Userinfo: an '@' inside it is encoded, the first ':' splits it
+        const char *colon = memchr(s, ':', (size_t)(at - s));
+        const char *user_end = colon ? colon : at;
+        w_write_encoded(p, s, (size_t)(user_end - s), W_USERINFO);
+        url->username_end = url->password_start = url->password_end =
+            (uint32_t)p->n;
+        if (colon && colon + 1 < at) {
+            w_put(p, ':');
+            url->password_start = (uint32_t)p->n;
+            w_write_encoded(p, colon + 1, (size_t)(at - colon - 1),
+                            W_USERINFO);
+            url->password_end = (uint32_t)p->n;
+        }
+        if (p->n > url->username_start) {
+            w_put(p, '@');
+        }
+        n -= (size_t)(at + 1 - s);
+        s = at + 1;
+        if (!n) {
+            return WHATWG_ERROR_HOST;
+        }
+    }
+
+    // host[:port], the ':' outside of brackets
+    const char *colon = NULL;
+    bool brackets = false;
+    for (size_t i = 0; i < n && !colon; ++i) {
+        if (s[i] == '[') {
+            brackets = true;
+        } else if (s[i] == ']') {
+            brackets = false;
+        } else if (s[i] == ':' && !brackets) {
+            colon = s + i;
+        }
+    }
+    size_t host_len = colon ? (size_t)(colon - s) : n;
+    if (!host_len && (colon || special)) {
+        return WHATWG_ERROR_HOST;
+    }
+    whatwg_error_t err = w_host(p, s, host_len, special);
+    if (err != WHATWG_OK) {
+        return err;
+    }
+    if (colon) {
+        uint32_t port = 0;
+        const char *q = colon + 1;
+        for (; q < s + n; ++q) {
+            if (!w_is_digit((unsigned char)*q)) {
+                return WHATWG_ERROR_PORT;
+            }
+            port = port * 10 + (uint32_t)(*q - '0');
+            if (port > 65535) {
+                return WHATWG_ERROR_PORT;
+            }
+        }
+        if (q > colon + 1 &&
+            (int)port != whatwg_default_port(url->scheme)) {
+            w_put(p, ':');
+            w_write_decimal(p, port);
+            url->port = (int32_t)port;
+        }
+    }
+    p->pos = end;
+    w_path_start(p);
+    return WHATWG_OK;
+}
+
+// Skip the slashes of the special authority (ignore) slashes states
+static void w_skip_slashes(w_parser_t *p) {
+    while (p->pos < p->len &&
+           (p->in[p->pos] == '/' || p->in[p->pos] == '\\')) {
+        ++p->pos;
+    }
+}
+
+/*
+ * Relative references: pieces of the base are copied as serialized, their
+ * offsets carry over since both URLs have the same scheme
+ */
+static void w_copy_authority(w_parser_t *p, const whatwg_url_t *base) {
+    whatwg_url_t *url = p->url;
+    if (!base->has_authority) {
+        w_no_credentials(url, p->n);
+        url->host_start = url->host_end = (uint32_t)p->n;
+        return;
+    }
+    w_write(p, base->href + base->protocol_end,
+            base->pathname_start - base->protocol_end);
+    url->has_authority = true;
+    url->username_start = base->username_start;
+    url->username_end = base->username_end;
+    url->password_start = base->password_start;
+    url->password_end = base->password_end;
+    url->host_start = base->host_start;
+    url->host_end = base->host_end;
+    url->port = base->port;
+}
+
+static void w_copy_path(w_parser_t *p, const whatwg_url_t *base) {
+    w_write(p, base->href + base->pathname_start,
+            w_path_end(base, base->href_len) - base->pathname_start);
+}
+
+static void w_copy_query(w_parser_t *p, const whatwg_url_t *base) {
+    if (base->search_start != WHATWG_OMITTED) {
+        p->url->search_start = (uint32_t)p->n;
+        w_write(p, base->href + base->search_start,
+                w_query_end(base, base->href_len) - base->search_start);
+    }
+}
+
+// After "?" / "#" / the end: the base path, and its query unless replaced
+static void w_inherit_rest(w_parser_t *p, const whatwg_url_t *base) {
+    w_copy_path(p, base);
+    if (w_at(p, p->pos) != '?') {
+        w_copy_query(p, base);
+    }
+    w_query_fragment(p);
+}
+
+static whatwg_error_t w_relative(w_parser_t *p) {
+    const whatwg_url_t *base = p->base;
+    bool special = w_special(p);
+    int c = w_at(p, p->pos);
+    if (w_is_slash(p, c)) {
+        // Relative slash state
+        int c2 = w_at(p, p->pos + 1);
+        if (c2 == '/' || (special && c2 == '\\')) {
+            p->pos += 2;
+            if (special) {
+                w_skip_slashes(p);
+            }
+            return w_authority(p);
+        }
+        ++p->pos;
+        w_copy_authority(p, base);
+        p->url->pathname_start = (uint32_t)p->n;
+        w_path(p);
+        w_query_fragment(p);
+        return WHATWG_OK;
+    }
+    w_copy_authority(p, base);
+    p->url->pathname_start = (uint32_t)p->n;
+    if (c == '?' || c == '#' || c == W_EOF) {
+        w_inherit_rest(p, base);
+    } else {
+        w_copy_path(p, base);
+        w_shorten_path(p);
+        w_path(p);
+        w_query_fragment(p);
+    }
+    return WHATWG_OK;
+}
+
+/*
+ * file: URLs always have a (possibly empty) host and never credentials or a
+ * port; drive letters get their own quirks
+ */
+static void w_file_empty_host(w_parser_t *p) {
+    w_write(p, "//", 2);
+    p->url->has_authority = true;
+    w_no_credentials(p->url, p->n);
+    p->url->host_start = p->url->host_end = (uint32_t)p->n;
+}
+
+static whatwg_error_t w_file_host(w_parser_t *p) {
+    size_t end = p->pos;
+    while (end < p->len && p->in[end] != '/' && p->in[end] != '\\' &&
+           p->in[end] != '?' && p->in[end] != '#') {
+        ++end;
+    }
+    const char *s = p->in + p->pos;
+    size_t n = end - p->pos;
+    w_file_empty_host(p);
+    if (w_is_drive_letter(s, n, false)) {
+        // The drive letter starts the path instead
+        p->url->pathname_start = (uint32_t)p->n;
+        w_path(p);
+        w_query_fragment(p);
+        return WHATWG_OK;
+    }
+    if (n) {
+        whatwg_error_t err = w_host(p, s, n, true);
+        if (err != WHATWG_OK) {
+            return err;
+        }
+        if (p->n - p->url->host_start == 9 &&
+            memcmp(p->out + p->url->host_start, "localhost", 9) == 0) {
+            p->n = p->url->host_end = p->url->host_start;
+        }
+    }
+    p->pos = end;
+    w_path_start(p);
+    return WHATWG_OK;
+}
+
+static whatwg_error_t w_file(w_parser_t *p) {
+    const whatwg_url_t *base =
+        p->base && p->base->scheme == WHATWG_SCHEME_FILE ? p->base : NULL;
+    int c = w_at(p, p->pos);
+    if (c == '/' || c == '\\') {
+        int c2 = w_at(p, p->pos + 1);
+        if (c2 == '/' || c2 == '\\') {
+            p->pos += 2;
+            return w_file_host(p);
+        }
+        // File slash state
+        ++p->pos;
+        if (base) {
+            w_copy_authority(p, base);
+        } else {
+            w_file_empty_host(p);
+        }
+        p->url->pathname_start = (uint32_t)p->n;
+        if (base && !w_starts_with_drive_letter(p, p->pos)) {
+            const char *path = base->href + base->pathname_start;
+            size_t len = w_path_end(base, base->href_len) - base->pathname_start;
+            if (w_path_first_is_drive(path, len)) {
+                w_write(p, path, 3);
+            }
+        }
+        w_path(p);
+        w_query_fragment(p);
+        return WHATWG_OK;
+    }
+    if (!base) {
+        w_file_empty_host(p);
+        p->url->pathname_start = (uint32_t)p->n;
+        w_path(p);
+        w_query_fragment(p);
+        return WHATWG_OK;
+    }
+    w_copy_authority(p, base);
+    p->url->pathname_start = (uint32_t)p->n;
+    if (c == '?' || c == '#' || c == W_EOF) {
+        w_inherit_rest(p, base);
+        return WHATWG_OK;
+    }
+    if (!w_starts_with_drive_letter(p, p->pos)) {
+        w_copy_path(p, base);
+        w_shorten_path(p);
+    }
+    w_path(p);
+    w_query_fragment(p);
+    return WHATWG_OK;
+}
+
+/*
+ * Entry point
+ */
+static whatwg_error_t w_parse_url(w_parser_t *p) {
+    whatwg_url_t *url = p->url;
+    const whatwg_url_t *base = p->base;
+
+    // Scheme: ASCII alpha, then alphanumerics, '+', '-', '.' up to ':'
+    size_t i = 0;
+    if (p->len && w_is_alpha((unsigned char)p->in[0])) {
+        i = 1;
+        while (i < p->len) {
+            unsigned char c = (unsigned char)p->in[i];
+            if (!w_is_alpha(c) && !w_is_digit(c) && c != '+' && c != '-' &&
+                c != '.') {
+                break;
+            }
+            ++i;
+        }
+        if (i == p->len || p->in[i] != ':') {
+            i = 0;
+        }
+    }
+
+    if (i) {
+        size_t start = p->n;
+        for (size_t k = 0; k < i; ++k) {
+            char c = p->in[k];
+            w_put(p, c >= 'A' && c <= 'Z' ? (char)(c | 0x20) : c);
+        }
+        url->scheme = (uint8_t)w_scheme_type(p->out + start, p->n - start);
+        w_put(p, ':');
+        url->protocol_end = (uint32_t)p->n;
+        w_no_credentials(url, p->n);
+        url->host_start = url->host_end = url->pathname_start =
+            (uint32_t)p->n;
+        p->pos = i + 1;
+
+        if (url->scheme == WHATWG_SCHEME_FILE) {
+            return w_file(p);
+        }
+        if (url->scheme != WHATWG_SCHEME_OTHER) {
+            // Special relative or authority state
+            if (base && base->scheme == url->scheme &&
+                !(w_at(p, p->pos) == '/' && w_at(p, p->pos + 1) == '/')) {
+                return w_relative(p);
+            }
+            w_skip_slashes(p);
+            return w_authority(p);
+        }
+        if (w_at(p, p->pos) != '/') {
+            w_opaque_path(p);
+            w_query_fragment(p);
+            return WHATWG_OK;
+        }
+        if (w_at(p, p->pos + 1) == '/') {
+            p->pos += 2;
+            return w_authority(p);
+        }
+        ++p->pos;
+        w_path(p);
+        w_query_fragment(p);
+        return WHATWG_OK;
+    }
+
+    // No scheme
+    if (!base) {
+        return WHATWG_ERROR_NO_BASE;
+    }
+    if (base->has_opaque_path) {
+        if (w_at(p, 0) != '#') {
+            return WHATWG_ERROR_NO_BASE;
+        }
+        const char *href = url->href;
+        *url = *base;
+        url->href = href;
+        url->hash_start = WHATWG_OMITTED;
+        w_write(p, base->href, w_query_end(base, base->href_len));
+        w_query_fragment(p);
+        return WHATWG_OK;
+    }
+    w_write(p, base->href, base->protocol_end);
+    url->scheme = base->scheme;
+    url->protocol_end = base->protocol_end;
+    w_no_credentials(url, p->n);
+    url->host_start = url->host_end = url->pathname_start = (uint32_t)p->n;
+    return base->scheme == WHATWG_SCHEME_FILE ? w_file(p) : w_relative(p);
+}
+
+// A hostless path starting with an empty segment serializes as "/.//..."
+static void w_finish(w_parser_t *p) {
+    whatwg_url_t *url = p->url;
+    if (url->has_authority || url->has_opaque_path) {
+        return;
+    }
+    size_t start = url->pathname_start;
+    size_t end = w_path_end(url, p->n);
+    if (end - start < 2 || p->out[start] != '/' || p->out[start + 1] != '/' ||
+        !w_reserve(p, 2)) {
+        return;
+    }
+    memmove(p->out + start + 2, p->out + start, p->n - start);
+    memcpy(p->out + start, "/.", 2);
+    p->n += 2;
+    url->pathname_start += 2;
+    if (url->search_start != WHATWG_OMITTED) {
+        url->search_start += 2;
+    }
+    if (url->hash_start != WHATWG_OMITTED) {
+        url->hash_start += 2;
+    }
+}
+
+static inline bool w_is_tab_or_newline(char c) {
+    return c == '\t' || c == '\n' || c == '\r';
+}
+
+size_t whatwg_buffer_size(size_t input_len, const whatwg_url_t *base) {
+    // 3 bytes per percent-encoded input byte, a copy of the input when it
+    // holds tabs or newlines, the base's pieces and a few added delimiters
+    return 4 * input_len + (base ? base->href_len : 0) + W_SLACK;
+}
+
+whatwg_error_t whatwg_parse(const char *input, size_t input_len,
+                            const whatwg_url_t *base,
+                            whatwg_to_ascii_fn to_ascii, void *ctx, char *buf,
+                            size_t cap, whatwg_url_t *url) {
+    // Leading and trailing C0 controls and spaces go
+    while (input_len && (unsigned char)input[0] <= 0x20) {
+        ++input;
+        --input_len;
+    }
+    while (input_len && (unsigned char)input[input_len - 1] <= 0x20) {
+        --input_len;
+    }
+    if (input_len > UINT32_MAX / 4) {
+        return WHATWG_ERROR_TOO_LONG;
+    }
+    // Tabs and newlines anywhere go too: the rare input with some is copied
+    // without them to the end of buf
+    size_t i = 0;
+    while (i < input_len && !w_is_tab_or_newline(input[i])) {
+        ++i;
+    }
+    if (i < input_len) {
+        if (cap < input_len) {
+            return WHATWG_ERROR_NO_SPACE;
+        }
+        cap -= input_len;
+        char *copy = buf + cap;
+        size_t n = 0;
+        for (i = 0; i < input_len; ++i) {
+            if (!w_is_tab_or_newline(input[i])) {
+                copy[n++] = input[i];
+            }
+        }
+        input = copy;
+        input_len = n;
+    }
+
+    memset(url, 0, sizeof(*url));
+    url->href = buf;
+    url->search_start = url->hash_start = WHATWG_OMITTED;
+    url->port = -1;
+    w_parser_t p = {.in = input,
+                    .len = input_len,
+                    .out = buf,
+                    .cap = cap < UINT32_MAX ? cap : UINT32_MAX - 1,
+                    .base = base,
+                    .url = url,
+                    .to_ascii = to_ascii,
+                    .ctx = ctx};
+    whatwg_error_t err = w_parse_url(&p);
+    if (err == WHATWG_OK) {
+        w_finish(&p);
+    }
+    if (p.overflow) {
+        return p.cap < cap ? WHATWG_ERROR_TOO_LONG : WHATWG_ERROR_NO_SPACE;
+    }
+    url->href_len = (uint32_t)p.n;
+    return err;
+}
+
+const char *whatwg_strerror(whatwg_error_t err) {
+    switch (err) {
+    case WHATWG_OK:
+        return "no error";
+    case WHATWG_ERROR_NO_BASE:
+        return "Invalid URL: relative URL without a base";
+    case WHATWG_ERROR_HOST:
+        return "Invalid URL: invalid host";
+    case WHATWG_ERROR_PORT:
+        return "Invalid URL: invalid port";
+    case WHATWG_ERROR_NO_SPACE:
+        return "output buffer too small";
+    default:
+        return "Invalid URL: too long";
+    }
+}